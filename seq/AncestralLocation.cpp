@@ -0,0 +1,189 @@
+/*
+ * AncestralLocation
+ * Reconstruct the locations of internal nodes from located leaves.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "AncestralLocation.h"
+#include "TileScheduler.h"
+
+#include <cmath>
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+
+//------------------------------------------------------------------------------
+void AncestralLocations::Reconstruct (const std::vector<int> &parent, const float *length,
+	std::vector<double> &latitude, std::vector<double> &longitude,
+	std::vector<char> &state) const
+{
+	int n = (int)parent.size();
+	if (n == 0)
+		return;
+
+	// Zero (or negative) lengths would give infinite weights
+	double shortest = 1.0;
+	if (length)
+	{
+		double total = 0.0;
+		int count = 0;
+		for (int i = 1; i < n; i++)
+			if (length[i] > 0.0f)
+			{
+				total += length[i];
+				count++;
+			}
+		shortest = (count > 0) ? 1.0e-6 * total / count : 1.0;
+	}
+	std::vector<double> edge (n, 1.0);
+	if (length)
+		for (int i = 0; i < n; i++)
+			edge[i] = (length[i] > shortest) ? length[i] : shortest;
+
+	// Known locations as unit vectors
+	const double radians = M_PI / 180.0;
+	std::vector<double> x (3 * n, 0.0);
+	for (int i = 0; i < n; i++)
+		if (state[i] == lsKnown)
+		{
+			double phi = latitude[i] * radians, lambda = longitude[i] * radians;
+			x[3 * i] = std::cos (phi) * std::cos (lambda);
+			x[3 * i + 1] = std::cos (phi) * std::sin (lambda);
+			x[3 * i + 2] = std::sin (phi);
+		}
+
+	// Postorder: sum[i] and weight[i] accumulate the children's messages, and
+	// each node's subtree estimate (x, with variance var) is sent to its
+	// parent with weight 1 / (var + edge length)
+	std::vector<double> sum (3 * n, 0.0), weight (n, 0.0), var (n, 0.0), message (n, 0.0);
+	std::vector<char> informed (n, 0);
+	for (int i = n - 1; i >= 0; i--)
+	{
+		if (state[i] == lsKnown)
+		{
+			informed[i] = 1;
+			var[i] = 0.0;
+		}
+		else if (weight[i] > 0.0)
+		{
+			informed[i] = 1;
+			for (int k = 0; k < 3; k++)
+				x[3 * i + k] = sum[3 * i + k] / weight[i];
+			var[i] = 1.0 / weight[i];
+		}
+		int p = parent[i];
+		if (p >= 0 && informed[i])
+		{
+			message[i] = 1.0 / (var[i] + edge[i]);
+			for (int k = 0; k < 3; k++)
+				sum[3 * p + k] += message[i] * x[3 * i + k];
+			weight[p] += message[i];
+		}
+	}
+
+	std::vector<double> estimate (x);
+	std::vector<char> placed (informed);
+	if (Method == amSquaredChange)
+	{
+		// Preorder: the estimate from above for child i of p combines p's
+		// other children with what came into p from above
+		std::vector<double> upSum (3 * n, 0.0), upWeight (n, 0.0);
+		for (int i = 1; i < n; i++)
+		{
+			int p = parent[i];
+			if (!placed[p])
+				continue;
+			double est[3], v;
+			if (state[p] == lsKnown)
+			{
+				for (int k = 0; k < 3; k++)
+					est[k] = estimate[3 * p + k];
+				v = 0.0;
+			}
+			else
+			{
+				double w = weight[p] + upWeight[p] - message[i];
+				if (w <= 1.0e-12 * (weight[p] + upWeight[p]))
+					continue;
+				for (int k = 0; k < 3; k++)
+					est[k] = (sum[3 * p + k] + upSum[3 * p + k] - message[i] * x[3 * i + k]) / w;
+				v = 1.0 / w;
+			}
+			upWeight[i] = 1.0 / (v + edge[i]);
+			for (int k = 0; k < 3; k++)
+				upSum[3 * i + k] = upWeight[i] * est[k];
+
+			if (state[i] != lsKnown)
+			{
+				double total = weight[i] + upWeight[i];
+				for (int k = 0; k < 3; k++)
+					estimate[3 * i + k] = (sum[3 * i + k] + upSum[3 * i + k]) / total;
+				placed[i] = 1;
+			}
+		}
+	}
+
+	for (int i = 0; i < n; i++)
+		if (placed[i] && state[i] != lsKnown)
+		{
+			const double *v = &estimate[3 * i];
+			latitude[i] = std::atan2 (v[2], std::sqrt (v[0] * v[0] + v[1] * v[1])) / radians;
+			longitude[i] = std::atan2 (v[1], v[0]) / radians;
+			state[i] = lsReconstructed;
+		}
+}
+
+//------------------------------------------------------------------------------
+bool AncestralLocations::Reconstruct (Tree &t)
+{
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return false;
+
+	std::vector<NodePtr> nodes;
+	std::vector<int> parent;
+	t.GetPreorder (nodes, parent);
+
+	int n = (int)nodes.size();
+	std::vector<float> length (n);
+	std::vector<double> latitude (n, 0.0), longitude (n, 0.0);
+	std::vector<char> state (n, lsUnknown);
+	bool any = false;
+	for (int i = 0; i < n; i++)
+	{
+		length[i] = nodes[i]->GetEdgeLength ();
+		if (nodes[i]->IsLocated ())
+		{
+			latitude[i] = nodes[i]->GetLatitude ();
+			longitude[i] = nodes[i]->GetLongitude ();
+			state[i] = lsKnown;
+			any = true;
+		}
+	}
+	if (!any)
+		return false;
+
+	bool weighted = UseEdgeLengths && t.GetHasEdgeLengths ();
+	Reconstruct (parent, weighted ? &length[0] : NULL, latitude, longitude, state);
+	for (int i = 0; i < n; i++)
+		if (state[i] == lsReconstructed && nodes[i]->GetChild ())
+			nodes[i]->SetLocation (latitude[i], longitude[i]);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void AncestralLocations::Reconstruct (const std::vector<Tree *> &trees, int threads)
+{
+	ParallelFor ((int)trees.size(), [&](int i, int) { Reconstruct (*trees[i]); }, threads);
+}
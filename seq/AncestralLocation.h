@@ -0,0 +1,80 @@
+/*
+ * AncestralLocation
+ * Reconstruct the locations of internal nodes from located leaves.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef ANCESTRALLOCATION_H
+#define ANCESTRALLOCATION_H
+
+#include <vector>
+
+#include "TreeLib.h"
+
+
+enum AncestralMethod
+{
+	amSquaredChange,	// squared-change parsimony, using the whole tree
+	amWeightedAverage	// weighted average of each node's descendants only
+};
+
+// Location states, per node
+enum { lsUnknown = 0, lsKnown = 1, lsReconstructed = 2 };
+
+
+//------------------------------------------------------------------------------
+// Locations are handled as unit vectors in 3D, so averages behave across the
+// antimeridian and near the poles, and turned back into latitude and
+// longitude at the end.
+//
+// The postorder pass gives every node the average of its subtree, each child
+// weighted by 1 / (edge length + the child's own uncertainty), as in
+// Felsenstein's independent contrasts; this is the weighted average method.
+// Squared-change parsimony (Maddison 1991) adds a preorder pass combining
+// each node's subtree average with the estimate from the rest of the tree,
+// giving the locations that minimise the sum over edges of squared change
+// divided by edge length. Edges of zero length are given a tiny length.
+//
+// Nodes with a location (leaves or internal) keep it; those without are
+// missing data. Both passes are O(n).
+class AncestralLocations
+{
+public:
+	AncestralLocations (AncestralMethod method = amSquaredChange) { Method = method; UseEdgeLengths = true; };
+	virtual ~AncestralLocations () {};
+
+	virtual void	SetMethod (AncestralMethod method) { Method = method; };
+	// Weight edges by length, or all equally
+	virtual void	SetUseEdgeLengths (bool on) { UseEdgeLengths = on; };
+
+	// Give unlocated internal nodes of t a location (marking them located).
+	// Returns false if no node of t is located.
+	virtual bool	Reconstruct (Tree &t);
+
+	// The same for each tree, in parallel
+	virtual void	Reconstruct (const std::vector<Tree *> &trees, int threads = 0);
+
+	// Flat form: nodes in preorder (parents first), parent -1 for the root,
+	// length is the edge length above each node (NULL for equal weights).
+	// Nodes with state lsKnown are used; every other node that can be placed
+	// gets a location and state lsReconstructed.
+	virtual void	Reconstruct (const std::vector<int> &parent, const float *length,
+						std::vector<double> &latitude, std::vector<double> &longitude,
+						std::vector<char> &state) const;
+
+protected:
+	AncestralMethod		Method;
+	bool				UseEdgeLengths;
+};
+
+
+#endif // ANCESTRALLOCATION_H
@@ -0,0 +1,623 @@
+/*
+ * BalancedME
+ * Balanced minimum evolution topology improvement for distance trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "BalancedME.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+//------------------------------------------------------------------------------
+// The child of parent whose sibling is x, or NULL if x is the first child
+static NodePtr predecessor (NodePtr parent, NodePtr x)
+{
+	NodePtr q = parent->GetChild ();
+	if (q == x)
+		return NULL;
+	while (q->GetSibling () != x)
+		q = q->GetSibling ();
+	return q;
+}
+
+
+//------------------------------------------------------------------------------
+BalancedME::BalancedME ()
+{
+	MaxRounds = 1000;
+	SPRRadius = 4;
+	MaxSPRMoves = 100;
+	LengthBefore = LengthAfter = 0.0;
+	NNIMoves = SPRMoves = 0;
+	Dist = NULL;
+}
+
+//------------------------------------------------------------------------------
+// Returns false if t's leaves are not the matrix's labels, each once, or t is
+// not binary apart from its root, which may have two or three children
+bool BalancedME::check (Tree &t) const
+{
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return false;
+	std::vector<char> seen (Rows.size(), 0);
+	size_t leaves = 0;
+	std::vector<NodePtr> stack (1, root);
+	while (!stack.empty ())
+	{
+		NodePtr p = stack.back ();
+		stack.pop_back ();
+		int c = 0;
+		for (NodePtr q = p->GetChild (); q; q = q->GetSibling ())
+		{
+			stack.push_back (q);
+			c++;
+		}
+		if (c == 0)
+		{
+			std::map<std::string, int>::const_iterator it = Rows.find (p->GetLabel ());
+			if (it == Rows.end () || seen[it->second])
+				return false;
+			seen[it->second] = 1;
+			leaves++;
+		}
+		else if (p == root ? (c < 2 || c > 3) : c != 2)
+			return false;
+	}
+	return leaves == Rows.size();
+}
+
+//------------------------------------------------------------------------------
+// Number the nodes of t (binary with a basal trifurcation) in preorder. The
+// numbers are kept in the nodes' Index and stay with them as moves are made,
+// so the table of averages never needs renumbering.
+void BalancedME::flatten (Tree &t)
+{
+	Nodes.clear ();
+	Leaf.clear ();
+	std::vector<NodePtr> stack (1, t.GetRoot ());
+	while (!stack.empty ())
+	{
+		NodePtr p = stack.back ();
+		stack.pop_back ();
+		p->SetIndex ((int)Nodes.size());
+		Nodes.push_back (p);
+		Leaf.push_back (p->GetChild () ? -1 : Rows[p->GetLabel ()]);
+		for (NodePtr q = p->GetChild (); q; q = q->GetSibling ())
+			stack.push_back (q);
+	}
+	link ();
+}
+
+//------------------------------------------------------------------------------
+// Parents, children, preorder and subtree extents from the nodes' current
+// links, O(N)
+void BalancedME::link ()
+{
+	int n = (int)Nodes.size();
+	Parent.assign (n, -1);
+	FirstChild.assign (n + 1, 0);
+	Children.clear ();
+	Order.clear ();
+	Pre.assign (n, 0);
+	for (int i = 0; i < n; i++)
+	{
+		FirstChild[i] = (int)Children.size();
+		for (NodePtr q = Nodes[i]->GetChild (); q; q = q->GetSibling ())
+		{
+			Children.push_back (q->GetIndex ());
+			Parent[q->GetIndex ()] = i;
+		}
+	}
+	FirstChild[n] = (int)Children.size();
+
+	std::vector<int> stack (1, 0);
+	while (!stack.empty ())
+	{
+		int i = stack.back ();
+		stack.pop_back ();
+		Pre[i] = (int)Order.size();
+		Order.push_back (i);
+		for (int c = FirstChild[i]; c < FirstChild[i + 1]; c++)
+			stack.push_back (Children[c]);
+	}
+
+	End.assign (n, 0);
+	std::vector<int> size (n, 1);
+	for (int k = n - 1; k >= 0; k--)
+	{
+		int i = Order[k];
+		End[i] = k + size[i];
+		if (Parent[i] >= 0)
+			size[Parent[i]] += size[i];
+	}
+}
+
+//------------------------------------------------------------------------------
+// Fill the table of balanced averages, O(N^2)
+void BalancedME::averages ()
+{
+	int n = (int)Nodes.size();
+	if (ScratchFile.empty () || !Avg.MapFile (ScratchFile, n))
+		Avg.SetSize (n);
+
+	// Disjoint subtrees. For x before y in preorder they are disjoint when y
+	// is at or past End[x]. Going backwards through x, the children of an
+	// internal x have already been done; for a leaf x, going backwards
+	// through y does y's children first.
+	for (int px = n - 1; px >= 0; px--)
+	{
+		int x = Order[px];
+		int cx = numChildren (x);
+		const int *kx = cx ? &Children[FirstChild[x]] : NULL;
+		for (int py = n - 1; py >= End[x]; py--)
+		{
+			int y = Order[py];
+			double v;
+			if (cx > 0)
+			{
+				v = 0.0;
+				for (int c = 0; c < cx; c++)
+					v += Avg.Get (kx[c], y);
+				v /= cx;
+			}
+			else if (numChildren (y) > 0)
+			{
+				int cy = numChildren (y);
+				const int *ky = &Children[FirstChild[y]];
+				v = 0.0;
+				for (int c = 0; c < cy; c++)
+					v += Avg.Get (x, ky[c]);
+				v /= cy;
+			}
+			else
+				v = Dist->Get (Leaf[x], Leaf[y]);
+			Avg.Set (x, y, (float)v);
+		}
+	}
+
+	// Everything above x against subtrees below x, parents first
+	for (int px = 1; px < n; px++)
+	{
+		int x = Order[px];
+		for (int py = px + 1; py < End[x]; py++)
+			Avg.Set (x, Order[py], above (x, Order[py]));
+	}
+}
+
+//------------------------------------------------------------------------------
+// Average between everything above x and the subtree below y (inside x).
+// Above x are x's siblings and, unless the parent is the root, everything
+// above the parent.
+float BalancedME::above (int x, int y) const
+{
+	int p = Parent[x];
+	int cp = numChildren (p);
+	const int *kp = &Children[FirstChild[p]];
+	double v = 0.0;
+	for (int c = 0; c < cp; c++)
+		if (kp[c] != x)
+			v += Avg.Get (kp[c], y);
+	if (p != 0)
+		v += Avg.Get (p, y);
+	return (float)(v / ((p == 0) ? cp - 1 : cp));
+}
+
+//------------------------------------------------------------------------------
+// Exchange b, a child of v, with c, v's sibling, and update the averages
+// that change. Below the edge above v the subtree has new leaves, and so do
+// the subtrees below v's ancestors, though only their shape changes; every
+// subtree above a node that is not one of those ancestors now has the
+// rearranged part in it somewhere. Those averages are recomputed, and no
+// others: O(N) for each node on the path from v to the root, plus the sizes
+// of the subtrees below the other nodes, which is O(N depth).
+void BalancedME::applyNNI (int b, int c)
+{
+	int v = Parent[b];
+	swap (Nodes[b], Nodes[c]);
+	link ();
+
+	int n = (int)Nodes.size();
+	std::vector<int> path;
+	for (int y = v; y > 0; y = Parent[y])
+		path.push_back (y);
+	std::vector<char> onPath (n, 0);
+	for (size_t k = 0; k < path.size(); k++)
+		onPath[path[k]] = 1;
+
+	// Subtrees below path nodes against the subtrees disjoint from them.
+	// For each other node z the path is taken bottom up, so children are
+	// done first, until it reaches an ancestor of z. Going through z in the
+	// outer loop keeps the inner one within z's row of the triangle.
+	for (int z = 1; z < n; z++)
+	{
+		if (onPath[z])
+			continue;
+		for (size_t k = 0; k < path.size() && !inside (z, path[k]); k++)
+		{
+			int y = path[k];
+			const int *ky = &Children[FirstChild[y]];
+			Avg.Set (y, z, (float)(0.5 * ((double)Avg.Get (ky[0], z) + Avg.Get (ky[1], z))));
+		}
+	}
+
+	// Above the ancestors of v against the path nodes below them
+	for (size_t j = 1; j < path.size(); j++)
+		for (size_t k = 0; k < j; k++)
+		{
+			int y = path[j], z = path[k];
+			int cz = numChildren (z);
+			const int *kz = &Children[FirstChild[z]];
+			double s = 0.0;
+			for (int i = 0; i < cz; i++)
+				s += Avg.Get (y, kz[i]);
+			Avg.Set (y, z, (float)(s / cz));
+		}
+
+	// Above every other node against the subtrees below it: for each z, its
+	// ancestors up to the path (or the root), top down since each uses its
+	// parent. v's ancestors are on the path, so z below v goes up to v.
+	std::vector<int> up;
+	for (int z = 1; z < n; z++)
+	{
+		if (onPath[z])
+			continue;
+		up.clear ();
+		for (int x = Parent[z]; x > 0 && (!onPath[x] || x == v); x = Parent[x])
+			up.push_back (x);
+		for (size_t k = up.size(); k > 0; k--)
+			Avg.Set (up[k - 1], z, above (up[k - 1], z));
+	}
+}
+
+//------------------------------------------------------------------------------
+// The two subtrees f divides into, looking away from the rest of the tree
+bool BalancedME::split (const Subtree &f, Subtree &q1, Subtree &q2) const
+{
+	if (!f.Up)
+	{
+		if (numChildren (f.Node) != 2)
+			return false;
+		q1.Node = Children[FirstChild[f.Node]];
+		q2.Node = Children[FirstChild[f.Node] + 1];
+		q1.Up = q2.Up = false;
+		return true;
+	}
+
+	int p = Parent[f.Node];
+	if (p < 0)
+		return false;
+	const int *kp = &Children[FirstChild[p]];
+	int cp = numChildren (p);
+	if (p == 0)
+	{
+		// Root: the other two children
+		int k = 0;
+		Subtree *q[2] = { &q1, &q2 };
+		for (int c = 0; c < cp && k < 2; c++)
+			if (kp[c] != f.Node)
+			{
+				q[k]->Node = kp[c];
+				q[k]->Up = false;
+				k++;
+			}
+		return (k == 2 && cp == 3);
+	}
+	q1.Node = (kp[0] == f.Node) ? kp[1] : kp[0];
+	q1.Up = false;
+	q2.Node = p;
+	q2.Up = true;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Balanced minimum evolution length, optionally setting the edge lengths:
+// for an internal edge with subtrees A, B on one side and C, D on the other
+// l = (AC + AD + BC + BD) / 4 - (AB + CD) / 2, and for a pendant edge to leaf
+// i, l = (iC + iD - CD) / 2.
+double BalancedME::treeLength (bool setEdges)
+{
+	double length = 0.0;
+	int n = (int)Nodes.size();
+	for (int v = 1; v < n; v++)
+	{
+		Subtree up = { v, true };
+		Subtree c, d;
+		if (!split (up, c, d))
+			continue;
+		double l;
+		if (numChildren (v) == 0)
+		{
+			Subtree i = { v, false };
+			l = 0.5 * (delta (i, c) + delta (i, d) - delta (c, d));
+		}
+		else
+		{
+			Subtree down = { v, false };
+			Subtree a, b;
+			split (down, a, b);
+			l = 0.25 * (delta (a, c) + delta (a, d) + delta (b, c) + delta (b, d))
+				- 0.5 * (delta (a, b) + delta (c, d));
+		}
+		length += l;
+		if (setEdges)
+			Nodes[v]->SetEdgeLength ((float)(l > 0.0 ? l : 0.0));
+	}
+	return length;
+}
+
+//------------------------------------------------------------------------------
+// Best NNI across the edge above internal node v, whose children are A and B,
+// with C and D on the other side. Exchanging B and C (move 1) or A and C
+// (move 2) shortens the tree by (AB + CD - AC - BD) / 4 or
+// (AB + CD - AD - BC) / 4 respectively.
+double BalancedME::bestNNI (int v, int &move) const
+{
+	move = 0;
+	Subtree down = { v, false }, up = { v, true };
+	Subtree a, b, c, d;
+	if (!split (down, a, b) || !split (up, c, d))
+		return 0.0;
+	double abcd = delta (a, b) + delta (c, d);
+	double g1 = 0.25 * (abcd - delta (a, c) - delta (b, d));
+	double g2 = 0.25 * (abcd - delta (a, d) - delta (b, c));
+	move = (g1 >= g2) ? 1 : 2;
+	return (g1 >= g2) ? g1 : g2;
+}
+
+//------------------------------------------------------------------------------
+// Exchange two subtrees with different parents
+void BalancedME::swap (NodePtr a, NodePtr b)
+{
+	NodePtr pa = a->GetAnc (), pb = b->GetAnc ();
+	NodePtr qa = predecessor (pa, a), qb = predecessor (pb, b);
+	NodePtr sa = a->GetSibling (), sb = b->GetSibling ();
+	if (qa) qa->SetSibling (b); else pa->SetChild (b);
+	b->SetSibling (sa);
+	b->SetAnc (pa);
+	if (qb) qb->SetSibling (a); else pb->SetChild (a);
+	a->SetSibling (sb);
+	a->SetAnc (pb);
+}
+
+//------------------------------------------------------------------------------
+// Move the subtree S one edge at a time away from where it is. With S on the
+// edge between W (behind) and front, where front divides into Q and R,
+// moving S onto Q's edge is an NNI gaining (SW + QR - SQ - WR) / 4, after
+// which W is the balanced join of W and R. W's averages to new subtrees are
+// weighted sums over its parts, so each step costs O(depth).
+void BalancedME::sprSearch (const Subtree &s, std::vector<Subtree> &w,
+	std::vector<double> &weight, double dsw, const Subtree &front, double gain,
+	int depth, double &best, int &target) const
+{
+	if (depth >= SPRRadius)
+		return;
+	Subtree q[2];
+	if (!split (front, q[0], q[1]))
+		return;
+
+	for (int k = 0; k < 2; k++)
+	{
+		const Subtree &Q = q[k], &R = q[1 - k];
+		double dwr = 0.0;
+		for (size_t i = 0; i < w.size(); i++)
+			dwr += weight[i] * delta (w[i], R);
+		double g = gain + 0.25 * (dsw + delta (Q, R) - delta (s, Q) - dwr);
+		if (g > best)
+		{
+			best = g;
+			target = Q.Node;
+		}
+
+		for (size_t i = 0; i < weight.size(); i++)
+			weight[i] *= 0.5;
+		w.push_back (R);
+		weight.push_back (0.5);
+		sprSearch (s, w, weight, 0.5 * (dsw + delta (s, R)), Q, g, depth + 1, best, target);
+		w.pop_back ();
+		weight.pop_back ();
+		for (size_t i = 0; i < weight.size(); i++)
+			weight[i] *= 2.0;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Best regrafting of the subtree below s, whose parent must not be the root.
+// Returns the gain; target is the node below the edge to regraft onto.
+double BalancedME::bestSPR (int s, int &target) const
+{
+	target = -1;
+	int s0 = Parent[s];
+	if (s0 <= 0)
+		return 0.0;
+	int x = (Children[FirstChild[s0]] == s) ? Children[FirstChild[s0] + 1] : Children[FirstChild[s0]];
+
+	Subtree S = { s, false }, X = { x, false }, U = { s0, true };
+	double best = 0.0;
+	std::vector<Subtree> w (1);
+	std::vector<double> weight (1, 1.0);
+
+	// Down into the sibling's subtree, leaving everything above behind
+	w[0] = U;
+	sprSearch (S, w, weight, delta (S, U), X, 0.0, 0, best, target);
+
+	// Up the tree, leaving the sibling behind
+	w[0] = X;
+	sprSearch (S, w, weight, delta (S, X), U, 0.0, 0, best, target);
+	return best;
+}
+
+//------------------------------------------------------------------------------
+// Move the subtree below s onto the edge above target as the run of NNIs
+// sprSearch scored, updating the averages after each
+void BalancedME::applySPR (int s, int target)
+{
+	for (;;)
+	{
+		int a = Parent[s];
+		int x = (Children[FirstChild[a]] == s) ? Children[FirstChild[a] + 1] : Children[FirstChild[a]];
+		if (x == target || a == target)
+			break;
+		if (inside (target, x))
+		{
+			// Down: s takes the place of the child of x away from target
+			int r = Children[FirstChild[x]];
+			if (inside (target, r))
+				r = Children[FirstChild[x] + 1];
+			applyNNI (r, s);
+			continue;
+		}
+
+		// Up: if target is below a's sibling y, s joins y's edge by
+		// exchanging x with y; otherwise s moves above a by exchanging with y
+		int p = Parent[a];
+		int y = -1;
+		for (int c = FirstChild[p]; c < FirstChild[p + 1]; c++)
+			if (Children[c] != a && (y < 0 || inside (target, Children[c])))
+				y = Children[c];
+		if (inside (target, y))
+			applyNNI (x, y);
+		else
+			applyNNI (s, y);
+	}
+}
+
+//------------------------------------------------------------------------------
+bool BalancedME::Optimize (const DistanceMatrix &D, Tree &t)
+{
+	LengthBefore = LengthAfter = 0.0;
+	NNIMoves = SPRMoves = 0;
+	Dist = &D;
+
+	int n = D.GetSize ();
+	TREELIB_TRACE_SCOPE (trace, "BalancedME::Optimize");
+	TREELIB_TRACE_ARG (trace, "taxa", n);
+	Rows.clear ();
+	for (int i = 0; i < n; i++)
+		if (!Rows.insert (std::make_pair (D.GetLabel (i), i)).second)
+			return false;
+
+	// Check before changing anything, so a tree that will not do is left as
+	// it was
+	if (n < 4 || !check (t))
+		return false;
+
+	// Unroot a rooted binary tree by making an internal child of the root the
+	// new root, with the other child as its third child
+	NodePtr root = t.GetRoot ();
+	NodePtr a = root->GetChild (), b = a->GetSibling ();
+	if (b->GetSibling () == NULL)
+	{
+		if (a->GetChild () == NULL)
+			std::swap (a, b);
+		b->SetEdgeLength (b->GetEdgeLength () + a->GetEdgeLength ());
+		a->SetEdgeLength (0.0f);
+		a->SetAnc (NULL);
+		a->SetSibling (NULL);
+		a->GetChild ()->GetRightMostSibling ()->SetSibling (b);
+		b->SetAnc (a);
+		b->SetSibling (NULL);
+		t.SetRoot (a);
+		delete root;
+		t.SetRooted (false);
+		t.Update ();
+	}
+
+	flatten (t);
+	averages ();
+	LengthBefore = treeLength (false);
+	double eps = 1.0e-6 * (std::fabs (LengthBefore) > 1.0 ? std::fabs (LengthBefore) : 1.0);
+
+	int rounds = 0;
+	for (;;)
+	{
+		// NNI rounds until nothing helps. Each round takes the improving
+		// edges best first, rescoring each against the updated table just
+		// before it is applied, so every move applied shortens the tree.
+		while (rounds < MaxRounds)
+		{
+			rounds++;
+			std::vector<std::pair<double, int> > candidates;
+			for (int v = 1; v < (int)Nodes.size(); v++)
+			{
+				if (numChildren (v) == 0)
+					continue;
+				int move;
+				double g = bestNNI (v, move);
+				if (g > eps)
+					candidates.push_back (std::make_pair (g, v));
+			}
+			if (candidates.empty ())
+				break;
+			std::sort (candidates.begin(), candidates.end(),
+				[](const std::pair<double, int> &a, const std::pair<double, int> &b) { return a.first > b.first; });
+
+			for (size_t i = 0; i < candidates.size(); i++)
+			{
+				int v = candidates[i].second;
+				int move;
+				double g = bestNNI (v, move);
+				if (g <= eps)
+					continue;
+				Subtree up = { v, true }, c, d;
+				split (up, c, d);
+				int mover = Children[FirstChild[v] + (move == 1 ? 1 : 0)];
+				applyNNI (mover, c.Node);
+				NNIMoves++;
+			}
+		}
+
+		if (SPRRadius <= 0 || SPRMoves >= MaxSPRMoves || rounds >= MaxRounds)
+			break;
+
+		int bestS = -1, bestTarget = -1;
+		double bestGain = eps;
+		for (int s = 1; s < (int)Nodes.size(); s++)
+		{
+			int target;
+			double g = bestSPR (s, target);
+			if (g > bestGain && target >= 0)
+			{
+				bestGain = g;
+				bestS = s;
+				bestTarget = target;
+			}
+		}
+		if (bestS < 0)
+			break;
+		applySPR (bestS, bestTarget);
+		SPRMoves++;
+	}
+
+	LengthAfter = treeLength (true);
+	t.SetEdgeLengths (true);
+	t.SetRooted (false);
+	t.Update ();
+	t.MakeNodeList ();
+	Avg.SetSize (0);
+	TREELIB_TRACE_ARG (trace, "nni_moves", NNIMoves);
+	TREELIB_TRACE_ARG (trace, "spr_moves", SPRMoves);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void BalancedME::WriteReport (std::ostream &f) const
+{
+	f << "Balanced minimum evolution" << std::endl;
+	f << "  Tree length before: " << LengthBefore << std::endl;
+	f << "   Tree length after: " << LengthAfter << std::endl;
+	f << "           NNI moves: " << NNIMoves << std::endl;
+	f << "           SPR moves: " << SPRMoves << std::endl;
+}
@@ -0,0 +1,132 @@
+/*
+ * BalancedME
+ * Balanced minimum evolution topology improvement for distance trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef BALANCEDME_H
+#define BALANCEDME_H
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "TreeLib.h"
+#include "DistanceMatrix.h"
+
+
+//------------------------------------------------------------------------------
+// FastME-style polishing of a tree under the balanced minimum evolution
+// criterion (Desper & Gascuel 2002). The balanced average distance between
+// every pair of disjoint subtrees is held in one lower triangle indexed by
+// node number (numbered once, in the starting tree's preorder): the entry
+// for i and j is the average between the subtrees below them if they are
+// disjoint, or between the tree above i and the subtree below j if j is
+// inside i. The whole table is built once in O(N^2) (N nodes), after which
+// every NNI is scored in O(1) and every SPR step in O(radius).
+//
+// Applying an NNI updates only the averages it changes, in O(N depth).
+// Each round scores every internal edge and applies the improving NNIs best
+// first, rescoring each just before it is applied. When no NNI helps, each
+// subtree is moved up to SPRRadius edges from where it is and the best move
+// is applied as a run of NNIs, then NNIs start again.
+//
+// The table takes N^2 / 2 floats, about 800 MB for 10,000 leaves; a scratch
+// file keeps it out of memory.
+//
+// The tree must be binary apart from a basal trifurcation (as NJBuilder
+// makes); a rooted binary tree is unrooted first. On return the tree has
+// balanced minimum evolution edge lengths.
+class BalancedME
+{
+public:
+	BalancedME ();
+	virtual ~BalancedME () {};
+
+	virtual void	SetMaxRounds (int n) { MaxRounds = n; };
+	virtual void	SetSPRRadius (int r) { SPRRadius = r; };	// 0 = NNI only
+	virtual void	SetMaxSPRMoves (int n) { MaxSPRMoves = n; };
+	// Keep the subtree table in filename rather than memory (see
+	// DistanceMatrix::MapFile)
+	virtual void	SetScratchFile (const std::string &filename) { ScratchFile = filename; };
+
+	// Returns false, leaving t alone, if t's leaves are not the matrix's
+	// labels or t is not binary
+	virtual bool	Optimize (const DistanceMatrix &D, Tree &t);
+
+	double			GetLengthBefore () const { return LengthBefore; };
+	double			GetLengthAfter () const { return LengthAfter; };
+	int				GetNNIMoves () const { return NNIMoves; };
+	int				GetSPRMoves () const { return SPRMoves; };
+
+	virtual void	WriteReport (std::ostream &f) const;
+
+protected:
+	// A subtree: everything below Node, or everything above it
+	struct Subtree
+	{
+		int		Node;
+		bool	Up;
+	};
+
+	int						MaxRounds;
+	int						SPRRadius;
+	int						MaxSPRMoves;
+	std::string				ScratchFile;
+	double					LengthBefore;
+	double					LengthAfter;
+	int						NNIMoves;
+	int						SPRMoves;
+
+	const DistanceMatrix	*Dist;
+	std::map<std::string, int>	Rows;	// matrix row of each label
+	// Indexed by node number
+	std::vector<NodePtr>	Nodes;
+	std::vector<int>		Leaf;		// matrix row for each leaf node, -1 for internals
+	std::vector<int>		Parent;
+	std::vector<int>		FirstChild;	// children of node i are Children[FirstChild[i] .. FirstChild[i + 1])
+	std::vector<int>		Children;
+	std::vector<int>		Pre;		// position in Order
+	std::vector<int>		End;		// position in Order one past the last descendant
+	std::vector<int>		Order;		// node numbers in the current preorder
+	DistanceMatrix			Avg;		// balanced averages, see above
+
+	virtual bool	check (Tree &t) const;
+	virtual void	flatten (Tree &t);
+	virtual void	link ();
+	virtual void	averages ();
+	float			above (int x, int y) const;
+	virtual double	treeLength (bool setEdges);
+
+	// Is node y in the subtree below x?
+	bool			inside (int y, int x) const { return Pre[y] >= Pre[x] && Pre[y] < End[x]; };
+
+	float			delta (const Subtree &a, const Subtree &b) const
+	{
+		return Avg.Get (a.Node, b.Node);
+	};
+	int				numChildren (int i) const { return FirstChild[i + 1] - FirstChild[i]; };
+	bool			split (const Subtree &f, Subtree &q1, Subtree &q2) const;
+
+	virtual double	bestNNI (int v, int &move) const;
+	virtual void	swap (NodePtr a, NodePtr b);
+	virtual void	applyNNI (int b, int c);
+	virtual double	bestSPR (int s, int &target) const;
+	virtual void	sprSearch (const Subtree &s, std::vector<Subtree> &w, std::vector<double> &weight,
+						double dsw, const Subtree &front, double gain, int depth,
+						double &best, int &target) const;
+	virtual void	applySPR (int s, int target);
+};
+
+
+#endif // BALANCEDME_H
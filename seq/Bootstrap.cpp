@@ -0,0 +1,209 @@
+/*
+ * Bootstrap
+ * Bootstrap support for k-tuple distance trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Bootstrap.h"
+#include "DistanceMatrix.h"
+#include "TileScheduler.h"
+#include "TreeBuilder.h"
+
+#include <map>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+
+//------------------------------------------------------------------------------
+int GetTreeSplits (Tree &t, int numLeaves, const LeafIndexFunction &leafIndex,
+	std::vector<unsigned long long> &splits, std::vector<NodePtr> *nodes)
+{
+	splits.clear ();
+	if (nodes)
+		nodes->clear ();
+	NodePtr root = t.GetRoot ();
+	if (!root || numLeaves < 1)
+		return 0;
+
+	int words = (numLeaves + 63) / 64;
+	unsigned long long lastMask = (numLeaves % 64)
+		? ((1ULL << (numLeaves % 64)) - 1) : ~0ULL;
+
+	// Preorder list with parents, so a reverse pass sees children first
+	std::vector<NodePtr> order;
+	std::vector<int> parent;
+	t.GetPreorder (order, parent);
+
+	int n = (int)order.size();
+	std::vector<unsigned long long> bits ((size_t)n * words, 0ULL);
+	std::vector<int> count (n, 0);
+	for (int i = n - 1; i >= 0; i--)
+	{
+		unsigned long long *b = &bits[(size_t)i * words];
+		NodePtr p = order[i];
+		if (p->GetChild () == NULL)
+		{
+			int leaf = leafIndex (p);
+			if (leaf < 0 || leaf >= numLeaves)
+			{
+				splits.clear ();
+				if (nodes)
+					nodes->clear ();
+				return -1;
+			}
+			b[leaf / 64] |= 1ULL << (leaf % 64);
+			count[i] = 1;
+		}
+		else if (i > 0 && count[i] > 1 && count[i] < numLeaves - 1)
+		{
+			// Non-trivial: store with leaf 0 on the outside
+			bool flip = (b[0] & 1ULL) != 0;
+			for (int w = 0; w < words; w++)
+			{
+				unsigned long long x = flip ? ~b[w] : b[w];
+				if (w == words - 1)
+					x &= lastMask;
+				splits.push_back (x);
+			}
+			if (nodes)
+				nodes->push_back (p);
+		}
+
+		if (parent[i] >= 0)
+		{
+			unsigned long long *a = &bits[(size_t)parent[i] * words];
+			for (int w = 0; w < words; w++)
+				a[w] |= b[w];
+			count[parent[i]] += count[i];
+		}
+	}
+	return (int)(splits.size() / words);
+}
+
+
+//------------------------------------------------------------------------------
+KTupleBootstrap::KTupleBootstrap (int k, DistanceModel model)
+{
+	K = k;
+	Model = model;
+	Replicates = 100;
+	Seed = 1;
+	Threads = 0;
+}
+
+//------------------------------------------------------------------------------
+void KTupleBootstrap::Resample (int r, int positions, std::vector<int> &weights) const
+{
+	std::seed_seq seq = { Seed, (unsigned int)r };
+	std::mt19937_64 rng (seq);
+	weights.assign (positions, 0);
+	if (positions < 1)
+		return;
+	std::uniform_int_distribution<int> pick (0, positions - 1);
+	for (int i = 0; i < positions; i++)
+		weights[pick (rng)]++;
+}
+
+//------------------------------------------------------------------------------
+bool KTupleBootstrap::Run (const SequenceSet &s, Tree &t)
+{
+	int n = s.GetNumSequences ();
+	if (n < 4 || !t.GetRoot ())
+		return false;
+
+	// Reference leaves to sequence indices by label
+	std::map<std::string, int> index;
+	for (int i = 0; i < n; i++)
+		if (!index.insert (std::make_pair (s.GetLabel (i), i)).second)
+			return false;	// labels must be unique
+
+	std::vector<unsigned long long> refSplits;
+	std::vector<NodePtr> refNodes;
+	int numRef = GetTreeSplits (t, n, [&index](NodePtr p)
+		{
+			std::map<std::string, int>::const_iterator it = index.find (p->GetLabel ());
+			return (it == index.end ()) ? -1 : it->second;
+		}, refSplits, &refNodes);
+	if (numRef < 0 || t.GetNumLeaves () != n)
+		return false;
+
+	int words = (n + 63) / 64;
+	// A split can occur twice in a rooted tree (either side of the root), so
+	// each reference split points at the first copy, which does the counting
+	std::unordered_map<std::string, int> lookup;
+	std::vector<int> first (numRef);
+	for (int i = 0; i < numRef; i++)
+	{
+		std::string key ((const char *)&refSplits[(size_t)i * words], words * sizeof (unsigned long long));
+		first[i] = lookup.insert (std::make_pair (key, i)).first->second;
+	}
+
+	int positions = 0;
+	for (int i = 0; i < n; i++)
+	{
+		int w = (int)s.GetSequence (i).size() - K + 1;
+		if (w > positions)
+			positions = w;
+	}
+
+	// Replicates are handed out one at a time; each thread has its own
+	// profiles, matrix and counts, and only reads s and the lookup table
+	struct Replicator
+	{
+		KTupleProfiles						Profiles;
+		DistanceMatrix						D;
+		std::vector<int>					Weights;
+		std::vector<unsigned long long>		Splits;
+		std::vector<int>					Counts;
+		std::string							Key;
+	};
+	int threads = (Threads > 0) ? Threads : DefaultThreads ();
+	Replicator proto;
+	proto.Profiles = KTupleProfiles (K, Model);
+	proto.Counts.assign (numRef, 0);
+	std::vector<Replicator> work (threads, proto);
+	ParallelFor (Replicates, [&](int r, int thread)
+		{
+			Replicator &w = work[thread];
+			Resample (r, positions, w.Weights);
+			w.Profiles.Build (s, w.Weights);
+			w.Profiles.Distances (w.D, 1);
+			Tree replicate;
+			NJBuilder nj;
+			nj.Build (w.D, replicate);
+
+			int m = GetTreeSplits (replicate, n,
+				[](NodePtr p) { return p->GetLeafNumber () - 1; }, w.Splits);
+			for (int i = 0; i < m; i++)
+			{
+				w.Key.assign ((const char *)&w.Splits[(size_t)i * words], words * sizeof (unsigned long long));
+				std::unordered_map<std::string, int>::const_iterator it = lookup.find (w.Key);
+				if (it != lookup.end ())
+					w.Counts[it->second]++;
+			}
+		}, threads);
+
+	std::vector<int> support (numRef, 0);
+	for (int t = 0; t < threads; t++)
+		for (int i = 0; i < numRef; i++)
+			support[i] += work[t].Counts[i];
+
+	for (int i = 0; i < numRef; i++)
+	{
+		std::ostringstream label;
+		label << (int)(100.0 * support[first[i]] / (Replicates > 0 ? Replicates : 1) + 0.5);
+		refNodes[i]->SetLabel (label.str());
+	}
+	t.SetInternalLabels (true);
+	return true;
+}
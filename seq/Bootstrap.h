@@ -0,0 +1,82 @@
+/*
+ * Bootstrap
+ * Bootstrap support for k-tuple distance trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "TreeLib.h"
+#include "Sequence.h"
+#include "KTuple.h"
+
+
+//------------------------------------------------------------------------------
+// Sequences are not aligned, so rather than resampling alignment columns each
+// replicate resamples k-mer window start positions: n positions are drawn
+// with replacement (n being the longest sequence's number of windows) and
+// every sequence's window at a drawn position is counted once per draw. The
+// same draw is used for every sequence, as a column resample would be, since
+// barcodes start at roughly the same place in the gene.
+//
+// Each replicate gets its own generator seeded from (seed, replicate), so the
+// results do not depend on the number of threads or the order in which
+// replicates run.
+class KTupleBootstrap
+{
+public:
+	KTupleBootstrap (int k = 5, DistanceModel model = dmSquaredEuclidean);
+	virtual ~KTupleBootstrap () {};
+
+	virtual void	SetReplicates (int n) { Replicates = n; };
+	virtual void	SetSeed (unsigned int seed) { Seed = seed; };
+	virtual void	SetThreads (int n) { Threads = n; };	// 0 = one per core
+
+	// Build NJ trees from resampled profiles of s and label the internal nodes
+	// of t with the percentage of replicate trees containing the same split
+	// (splits are compared as unrooted bipartitions of the leaf labels). The
+	// leaves of t must be the sequences of s, matched by label. Returns false,
+	// leaving t untouched, if they are not.
+	virtual bool	Run (const SequenceSet &s, Tree &t);
+
+	// Window position weights for replicate r, positions windows long
+	virtual void	Resample (int r, int positions, std::vector<int> &weights) const;
+
+	int				GetReplicates () const { return Replicates; };
+
+protected:
+	int				K;
+	DistanceModel	Model;
+	int				Replicates;
+	unsigned int	Seed;
+	int				Threads;
+};
+
+
+//------------------------------------------------------------------------------
+// Non-trivial splits of t as bitsets over leaf indices, (numLeaves + 63) / 64
+// words apiece, one after the other in splits. Each is normalised so that
+// leaf 0 is outside the set, which makes them unrooted bipartitions. If nodes
+// is not NULL it gets the node below each split. Returns the number of
+// splits, or -1 if leafIndex gives an index outside 0 .. numLeaves - 1.
+typedef std::function<int (NodePtr)> LeafIndexFunction;
+
+int GetTreeSplits (Tree &t, int numLeaves, const LeafIndexFunction &leafIndex,
+	std::vector<unsigned long long> &splits, std::vector<NodePtr> *nodes = NULL);
+
+
+#endif // BOOTSTRAP_H
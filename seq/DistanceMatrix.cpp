@@ -0,0 +1,176 @@
+/*
+ * DistanceMatrix
+ * Symmetric distance matrix stored as a packed lower triangle.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "DistanceMatrix.h"
+#include "TreeLib.h"
+#include "Trace.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+//------------------------------------------------------------------------------
+void DistanceMatrix::init ()
+{
+	N = 0;
+	Data = NULL;
+	Mapped = NULL;
+	MappedBytes = 0;
+}
+
+//------------------------------------------------------------------------------
+DistanceMatrix::DistanceMatrix (const DistanceMatrix &D)
+{
+	init ();
+	*this = D;
+}
+
+//------------------------------------------------------------------------------
+DistanceMatrix::~DistanceMatrix ()
+{
+	unmap ();
+}
+
+//------------------------------------------------------------------------------
+// Copies always live in memory, whatever backs D
+DistanceMatrix &DistanceMatrix::operator= (const DistanceMatrix &D)
+{
+	if (this == &D)
+		return *this;
+	unmap ();
+	N = D.N;
+	Store.assign (D.Data, D.Data + TriangleSize (D.N));
+	Data = Store.empty() ? NULL : &Store[0];
+	Labels = D.Labels;
+	return *this;
+}
+
+//------------------------------------------------------------------------------
+void DistanceMatrix::SetSize (int n)
+{
+	unmap ();
+	N = (n > 0) ? n : 0;
+	Store.assign (TriangleSize (N), 0.0f);
+	TREELIB_TRACE_ALLOC (Store.size() * sizeof (float));
+	Data = Store.empty() ? NULL : &Store[0];
+	Labels.assign (N, "");
+}
+
+//------------------------------------------------------------------------------
+bool DistanceMatrix::MapFile (const std::string &filename, int n, bool create)
+{
+	SetSize (0);
+	if (n < 0)
+		return false;
+	size_t bytes = TriangleSize (n) * sizeof (float);
+
+#if defined(__unix__) || defined(__APPLE__)
+	int fd = create
+		? open (filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+		: open (filename.c_str(), O_RDWR);
+	if (fd < 0)
+		return false;
+
+	bool ok = true;
+	if (create)
+		ok = (ftruncate (fd, (off_t)bytes) == 0);	// sparse, reads as zero
+	else
+	{
+		struct stat sb;
+		ok = (fstat (fd, &sb) == 0) && ((size_t)sb.st_size == bytes);
+	}
+
+	void *p = NULL;
+	if (ok && bytes > 0)
+	{
+		p = mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		ok = (p != MAP_FAILED);
+	}
+	close (fd);	// the mapping keeps the file open
+	if (!ok)
+		return false;
+
+	N = n;
+	Mapped = p;
+	MappedBytes = bytes;
+	Data = (float *)p;
+	Labels.assign (N, "");
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+void DistanceMatrix::Sync ()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	if (Mapped)
+		msync (Mapped, MappedBytes, MS_SYNC);
+#endif
+}
+
+//------------------------------------------------------------------------------
+void DistanceMatrix::unmap ()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	if (Mapped)
+		munmap (Mapped, MappedBytes);
+#endif
+	Mapped = NULL;
+	MappedBytes = 0;
+	Data = Store.empty() ? NULL : &Store[0];
+}
+
+//------------------------------------------------------------------------------
+void DistanceMatrix::WriteNexus (std::ostream &f, bool paupBlock) const
+{
+	f << "#nexus" << std::endl << std::endl;
+
+	f << "begin taxa;" << std::endl;
+	f << "\tdimensions ntax=" << N << ";" << std::endl;
+	f << "\ttaxlabels";
+	for (int i = 0; i < N; i++)
+		f << " " << NEXUSString (Labels[i]);
+	f << ";" << std::endl;
+	f << "end;" << std::endl << std::endl;
+
+	f << "begin distances;" << std::endl;
+	f << "\tdimensions ntax=" << N << ";" << std::endl;
+	f << "\tformat diagonal labels triangle=lower;" << std::endl;
+	f << "\tmatrix" << std::endl;
+	for (int i = 0; i < N; i++)
+	{
+		f << NEXUSString (Labels[i]);
+		const float *row = GetRow (i);
+		for (int j = 0; j < i; j++)
+			f << " " << row[j];
+		f << " 0" << std::endl;
+	}
+	f << "\t;" << std::endl;
+	f << "end;" << std::endl;
+
+	if (paupBlock)
+	{
+		f << "begin paup;" << std::endl;
+		f << "set root=midpoint;" << std::endl;
+		f << "nj;" << std::endl;
+		f << "end;" << std::endl;
+	}
+}
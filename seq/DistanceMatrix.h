@@ -0,0 +1,93 @@
+/*
+ * DistanceMatrix
+ * Symmetric distance matrix stored as a packed lower triangle.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef DISTANCEMATRIX_H
+#define DISTANCEMATRIX_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+//------------------------------------------------------------------------------
+// Only the strict lower triangle is stored (the diagonal is always zero), as
+// float, so an n x n matrix needs n(n-1)/2 * 4 bytes. Row i holds the
+// distances d(i,0) ... d(i,i-1) contiguously.
+//
+// The triangle is normally held in memory, but MapFile puts it in a memory
+// mapped file instead (the raw float32 triangle, row after row), so matrices
+// bigger than RAM can be filled and read back a row at a time, leaving the
+// paging to the operating system. Labels are always kept in memory.
+class DistanceMatrix
+{
+public:
+	DistanceMatrix () { init (); };
+	DistanceMatrix (int n) { init (); SetSize (n); };
+	DistanceMatrix (const DistanceMatrix &D);
+	virtual ~DistanceMatrix ();
+
+	DistanceMatrix &operator= (const DistanceMatrix &D);
+
+	virtual void	SetSize (int n);
+	int				GetSize () const { return N; };
+
+	// Back an n x n matrix by filename. If create is true the file is created
+	// (or truncated) and zeroed, otherwise an existing triangle is opened and
+	// must be exactly the right size. Returns false if the file cannot be
+	// mapped, in which case the matrix is left empty.
+	virtual bool	MapFile (const std::string &filename, int n, bool create = true);
+	bool			IsMapped () const { return Mapped != NULL; };
+	// Flush a mapped triangle to disk
+	virtual void	Sync ();
+
+	float Get (int i, int j) const
+	{
+		if (i == j) return 0.0f;
+		return (i > j) ? Data[RowOffset (i) + j] : Data[RowOffset (j) + i];
+	};
+	void Set (int i, int j, float d)
+	{
+		if (i > j) Data[RowOffset (i) + j] = d;
+		else if (j > i) Data[RowOffset (j) + i] = d;
+	};
+
+	// Row i of the lower triangle (i entries)
+	float			*GetRow (int i) { return Data + RowOffset (i); };
+	const float		*GetRow (int i) const { return Data + RowOffset (i); };
+
+	virtual const std::string &GetLabel (int i) const { return Labels[i]; };
+	virtual void	SetLabel (int i, const std::string &s) { Labels[i] = s; };
+
+	// Write as NEXUS taxa and distances blocks (as dist.php does), optionally
+	// followed by a PAUP block that builds a midpoint-rooted NJ tree
+	virtual void	WriteNexus (std::ostream &f, bool paupBlock = true) const;
+
+	static size_t	RowOffset (int i) { return ((size_t)i * (size_t)(i - 1)) / 2; };
+	static size_t	TriangleSize (int n) { return (n > 1) ? RowOffset (n) : 0; };
+
+protected:
+	int							N;
+	float						*Data;		// Store.data() or the mapping
+	std::vector<float>			Store;
+	void						*Mapped;
+	size_t						MappedBytes;
+	std::vector<std::string>	Labels;
+
+	void			init ();
+	virtual void	unmap ();
+};
+
+
+#endif // DISTANCEMATRIX_H
@@ -0,0 +1,548 @@
+/*
+ * Dwca
+ * Read Darwin Core Archives in place.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Dwca.h"
+#include "TileScheduler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+
+//------------------------------------------------------------------------------
+// Call f (offset) for every byte of s[0 .. n) equal to c, in order
+template <class F>
+static void forEachByte (const char *s, size_t n, char c, F f)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i target = _mm_set1_epi8 (c);
+	for (; i + 16 <= n; i += 16)
+	{
+		unsigned int mask = (unsigned int)_mm_movemask_epi8 (
+			_mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *)(s + i)), target));
+		while (mask)
+		{
+#if defined(__GNUC__)
+			unsigned int bit = (unsigned int)__builtin_ctz (mask);
+#else
+			unsigned int bit = 0;
+			while (!(mask & (1u << bit)))
+				bit++;
+#endif
+			f (i + bit);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; i < n; i++)
+		if (s[i] == c)
+			f (i);
+}
+
+
+//------------------------------------------------------------------------------
+bool DwcaString::Equals (const char *s) const
+{
+	return strlen (s) == Length && memcmp (s, Data, Length) == 0;
+}
+
+//------------------------------------------------------------------------------
+bool DwcaString::ToDouble (double &x) const
+{
+	if (Length == 0 || Length > 63)
+		return false;
+	char buffer[64];
+	memcpy (buffer, Data, Length);
+	buffer[Length] = '\0';
+	char *end;
+	x = strtod (buffer, &end);
+	return *end == '\0' && std::isfinite (x);
+}
+
+
+//------------------------------------------------------------------------------
+// Local name of a term URI, after the last / or #
+static std::string localName (const std::string &term)
+{
+	size_t i = term.find_last_of ("/#");
+	return (i == std::string::npos) ? term : term.substr (i + 1);
+}
+
+//------------------------------------------------------------------------------
+static bool sameName (const std::string &a, const std::string &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (tolower ((unsigned char)a[i]) != tolower ((unsigned char)b[i]))
+			return false;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Find the next element called name at or after from, returning its extent
+static bool findElement (const std::string &xml, size_t from, const std::string &name,
+	size_t &begin, size_t &end)
+{
+	std::string open = "<" + name;
+	for (size_t i = xml.find (open, from); i != std::string::npos; i = xml.find (open, i + 1))
+	{
+		char c = (i + open.size() < xml.size()) ? xml[i + open.size()] : '\0';
+		if (!isspace ((unsigned char)c) && c != '>' && c != '/')
+			continue;
+		size_t close = xml.find ('>', i);
+		if (close == std::string::npos)
+			return false;
+		begin = i;
+		if (xml[close - 1] == '/')
+			end = close + 1;
+		else
+		{
+			size_t j = xml.find ("</" + name + ">", close);
+			end = (j == std::string::npos) ? xml.size() : j + name.size() + 3;
+		}
+		return true;
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Value of attribute name in the opening tag of element, with entities and
+// the \t, \n and \r escapes meta.xml uses replaced (as dwca.php does)
+static bool attribute (const std::string &element, const std::string &name, std::string &value)
+{
+	size_t close = element.find ('>');
+	for (size_t i = element.find (name + "="); i != std::string::npos && i < close;
+		i = element.find (name + "=", i + 1))
+	{
+		if (i == 0 || !isspace ((unsigned char)element[i - 1]))
+			continue;
+		size_t q = i + name.size() + 1;
+		if (q >= element.size() || (element[q] != '"' && element[q] != '\''))
+			return false;
+		size_t e = element.find (element[q], q + 1);
+		if (e == std::string::npos)
+			return false;
+
+		value.clear ();
+		for (size_t j = q + 1; j < e; j++)
+		{
+			char c = element[j];
+			if (c == '&')
+			{
+				static const char *entity[5][2] =
+					{ { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&quot;", "\"" }, { "&apos;", "'" } };
+				int k = 0;
+				while (k < 5 && element.compare (j, strlen (entity[k][0]), entity[k][0]) != 0)
+					k++;
+				if (k < 5)
+				{
+					value += entity[k][1];
+					j += strlen (entity[k][0]) - 1;
+					continue;
+				}
+			}
+			else if (c == '\\' && j + 1 < e && strchr ("tnr", element[j + 1]))
+			{
+				c = (element[j + 1] == 't') ? '\t' : (element[j + 1] == 'n' ? '\n' : '\r');
+				j++;
+			}
+			value += c;
+		}
+		return true;
+	}
+	return false;
+}
+
+
+//------------------------------------------------------------------------------
+DwcaTable::DwcaTable ()
+{
+	Delimiter = ',';
+	Enclosure = '"';
+	IgnoreHeaderLines = 0;
+	IdColumn = -1;
+	Data = "";
+	Size = 0;
+	Mapped = NULL;
+}
+
+//------------------------------------------------------------------------------
+// Attributes missing from the element take the defaults of the Darwin Core
+// text guidelines
+bool DwcaTable::SetMeta (const std::string &element)
+{
+	std::string value;
+	RowType = attribute (element, "rowType", value) ? value : "";
+	Delimiter = ',';
+	if (attribute (element, "fieldsTerminatedBy", value))
+	{
+		if (value.size() != 1)
+			return false;
+		Delimiter = value[0];
+	}
+	Enclosure = '"';
+	if (attribute (element, "fieldsEnclosedBy", value))
+		Enclosure = value.empty () ? '\0' : value[0];
+	if (attribute (element, "linesTerminatedBy", value) && value != "\n" && value != "\r\n")
+		return false;
+	IgnoreHeaderLines = attribute (element, "ignoreHeaderLines", value) ? atoi (value.c_str()) : 0;
+
+	size_t begin, end;
+	Location.clear ();
+	if (findElement (element, 1, "location", begin, end))
+	{
+		size_t open = element.find ('>', begin) + 1;
+		size_t close = element.rfind ('<', end - 1);
+		if (close > open)
+			Location = element.substr (open, close - open);
+		Location.erase (0, Location.find_first_not_of (" \t\r\n"));
+		Location.erase (Location.find_last_not_of (" \t\r\n") + 1);
+	}
+
+	IdColumn = -1;
+	if ((findElement (element, 1, "id", begin, end) || findElement (element, 1, "coreid", begin, end))
+		&& attribute (element.substr (begin, end - begin), "index", value))
+		IdColumn = atoi (value.c_str());
+
+	Fields.clear ();
+	for (size_t from = 1; findElement (element, from, "field", begin, end); from = end)
+	{
+		std::string field = element.substr (begin, end - begin);
+		DwcaField f;
+		f.Index = attribute (field, "index", value) ? atoi (value.c_str()) : -1;
+		if (!attribute (field, "term", f.Term))
+			continue;
+		f.Name = localName (f.Term);
+		attribute (field, "default", f.Default);
+		Fields.push_back (f);
+	}
+	return !Location.empty ();
+}
+
+//------------------------------------------------------------------------------
+// Each thread finds the newlines in its share of the file; as a line can
+// start anywhere, no share has to begin on a line boundary.
+bool DwcaTable::Open (const std::string &filename, int threads)
+{
+	TREELIB_TRACE_SCOPE (trace, "DwcaTable::Open");
+	Close ();
+
+#if defined(__unix__) || defined(__APPLE__)
+	int fd = open (filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat sb;
+	bool ok = (fstat (fd, &sb) == 0);
+	if (ok && sb.st_size > 0)
+	{
+		void *p = mmap (NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		ok = (p != MAP_FAILED);
+		if (ok)
+		{
+			Mapped = p;
+			Size = (size_t)sb.st_size;
+			Data = (const char *)p;
+		}
+	}
+	close (fd);
+	if (!ok)
+		return false;
+#else
+	std::ifstream f (filename.c_str(), std::ios::binary);
+	if (!f)
+		return false;
+	std::ostringstream s;
+	s << f.rdbuf ();
+	Store = s.str ();
+	Data = Store.c_str();
+	Size = Store.size();
+#endif
+	TREELIB_TRACE_ARG (trace, "bytes", Size);
+
+	int n = (threads > 0) ? threads : DefaultThreads ();
+	if ((size_t)n > Size / (1 << 20) + 1)
+		n = (int)(Size / (1 << 20) + 1);
+	std::vector<std::vector<size_t> > ends (n);
+	auto worker = [&](int t)
+	{
+		size_t begin = Size * t / n, end = Size * (t + 1) / n;
+		std::vector<size_t> &e = ends[t];
+		forEachByte (Data + begin, end - begin, '\n', [&](size_t i) { e.push_back (begin + i + 1); });
+	};
+	std::vector<std::thread> pool;
+	for (int t = 1; t < n; t++)
+		pool.push_back (std::thread (worker, t));
+	worker (0);
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join ();
+
+	// Row starts, without header and blank lines
+	size_t count = 0;
+	for (int t = 0; t < n; t++)
+		count += ends[t].size();
+	LineStart.clear ();
+	LineStart.reserve (count + 2);
+	size_t start = 0;
+	int line = 0;
+	auto addLine = [&](size_t end)
+	{
+		size_t length = end - start;
+		while (length > 0 && (Data[start + length - 1] == '\n' || Data[start + length - 1] == '\r'))
+			length--;
+		if (line++ >= IgnoreHeaderLines && length > 0)
+			LineStart.push_back (start);
+		start = end;
+	};
+	for (int t = 0; t < n; t++)
+	{
+		for (size_t j = 0; j < ends[t].size(); j++)
+			addLine (ends[t][j]);
+		std::vector<size_t> ().swap (ends[t]);
+	}
+	if (start < Size)
+		addLine (Size);
+	LineStart.push_back (Size);
+	TREELIB_TRACE_ARG (trace, "rows", LineStart.size() - 1);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void DwcaTable::Close ()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	if (Mapped)
+		munmap (Mapped, Size);
+#endif
+	Mapped = NULL;
+	Store.clear ();
+	Data = "";
+	Size = 0;
+	LineStart.clear ();
+}
+
+//------------------------------------------------------------------------------
+int DwcaTable::GetField (const std::string &term) const
+{
+	for (size_t f = 0; f < Fields.size(); f++)
+		if (Fields[f].Term == term)
+			return (int)f;
+	for (size_t f = 0; f < Fields.size(); f++)
+		if (sameName (Fields[f].Name, term))
+			return (int)f;
+	return -1;
+}
+
+//------------------------------------------------------------------------------
+DwcaString DwcaTable::trim (const char *s, size_t n) const
+{
+	while (n > 0 && (s[n - 1] == ' ' || s[n - 1] == '\r'))
+		n--;
+	while (n > 0 && *s == ' ')
+	{
+		s++;
+		n--;
+	}
+	if (Enclosure && n >= 2 && s[0] == Enclosure && s[n - 1] == Enclosure)
+	{
+		s++;
+		n -= 2;
+	}
+	return DwcaString (s, n);
+}
+
+//------------------------------------------------------------------------------
+void DwcaTable::GetRow (int row, std::vector<DwcaString> &fields) const
+{
+	fields.clear ();
+	const char *s = Data + LineStart[row];
+	size_t n = LineStart[row + 1] - LineStart[row];
+	while (n > 0 && (s[n - 1] == '\n' || s[n - 1] == '\r'))
+		n--;
+	size_t start = 0;
+	forEachByte (s, n, Delimiter, [&](size_t i)
+	{
+		fields.push_back (trim (s + start, i - start));
+		start = i + 1;
+	});
+	fields.push_back (trim (s + start, n - start));
+}
+
+//------------------------------------------------------------------------------
+DwcaString DwcaTable::GetValue (const std::vector<DwcaString> &fields, int f) const
+{
+	if (f < 0 || f >= (int)Fields.size())
+		return DwcaString ();
+	int column = Fields[f].Index;
+	if (column >= 0 && column < (int)fields.size() && !fields[column].IsEmpty ())
+		return fields[column];
+	return DwcaString (Fields[f].Default.c_str(), Fields[f].Default.size());
+}
+
+//------------------------------------------------------------------------------
+// Column holding labels, or -1
+int DwcaTable::labelField (const std::string &labelTerm) const
+{
+	if (labelTerm.empty ())
+		return IdColumn;
+	int f = GetField (labelTerm);
+	return (f < 0) ? -1 : Fields[f].Index;
+}
+
+//------------------------------------------------------------------------------
+int DwcaTable::SetLocations (Tree &t, const std::string &labelTerm) const
+{
+	int column = labelField (labelTerm);
+	int latitude = GetField ("decimalLatitude");
+	int longitude = GetField ("decimalLongitude");
+	if (column < 0 || latitude < 0 || longitude < 0 || !t.GetRoot ())
+		return 0;
+
+	std::unordered_map<std::string, std::vector<NodePtr> > leaves;
+	std::vector<NodePtr> stack (1, t.GetRoot ());
+	while (!stack.empty ())
+	{
+		NodePtr p = stack.back ();
+		stack.pop_back ();
+		if (p->IsLeaf ())
+			leaves[p->GetLabel ()].push_back (p);
+		for (NodePtr q = p->GetChild (); q; q = q->GetSibling ())
+			stack.push_back (q);
+	}
+
+	int located = 0;
+	std::vector<DwcaString> fields;
+	std::string key;
+	for (int row = 0; row < GetNumRows (); row++)
+	{
+		GetRow (row, fields);
+		if (column >= (int)fields.size())
+			continue;
+		key.assign (fields[column].Data, fields[column].Length);
+		std::unordered_map<std::string, std::vector<NodePtr> >::iterator it = leaves.find (key);
+		if (it == leaves.end ())
+			continue;
+		double lat, lon;
+		if (!GetValue (fields, latitude).ToDouble (lat) || !GetValue (fields, longitude).ToDouble (lon)
+			|| std::fabs (lat) > 90.0 || std::fabs (lon) > 180.0)
+			continue;
+		for (size_t i = 0; i < it->second.size(); i++)
+		{
+			it->second[i]->SetLocation (lat, lon);
+			located++;
+		}
+		leaves.erase (it);
+	}
+	return located;
+}
+
+//------------------------------------------------------------------------------
+int DwcaTable::AddSequences (SequenceSet &s, const std::string &sequenceTerm,
+	const std::string &labelTerm) const
+{
+	int column = labelField (labelTerm);
+	int sequence = GetField (sequenceTerm);
+	if (column < 0 || sequence < 0)
+		return 0;
+
+	int added = 0;
+	std::vector<DwcaString> fields;
+	for (int row = 0; row < GetNumRows (); row++)
+	{
+		GetRow (row, fields);
+		DwcaString seq = GetValue (fields, sequence);
+		if (column >= (int)fields.size() || fields[column].IsEmpty () || seq.IsEmpty ())
+			continue;
+		s.Add (fields[column].ToString (), seq.ToString ());
+		added++;
+	}
+	return added;
+}
+
+
+//------------------------------------------------------------------------------
+bool DwcaArchive::Open (const std::string &directory, int threads)
+{
+	Close ();
+	std::string prefix = directory;
+	if (!prefix.empty () && prefix[prefix.size() - 1] != '/')
+		prefix += '/';
+
+	std::ifstream f ((prefix + "meta.xml").c_str(), std::ios::binary);
+	if (!f)
+		return false;
+	std::ostringstream s;
+	s << f.rdbuf ();
+	std::string meta = s.str ();
+
+	size_t begin, end;
+	if (!findElement (meta, 0, "core", begin, end)
+		|| !Core.SetMeta (meta.substr (begin, end - begin))
+		|| !Core.Open (prefix + Core.GetLocation (), threads))
+		return false;
+
+	for (size_t from = 0; findElement (meta, from, "extension", begin, end); from = end)
+	{
+		DwcaTable *t = new DwcaTable;
+		if (!t->SetMeta (meta.substr (begin, end - begin)) || !t->Open (prefix + t->GetLocation (), threads))
+		{
+			delete t;
+			Close ();
+			return false;
+		}
+		Extensions.push_back (t);
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void DwcaArchive::Close ()
+{
+	for (size_t i = 0; i < Extensions.size(); i++)
+		delete Extensions[i];
+	Extensions.clear ();
+	Core.Close ();
+}
+
+//------------------------------------------------------------------------------
+int DwcaArchive::FindExtension (const std::string &rowType) const
+{
+	for (size_t i = 0; i < Extensions.size(); i++)
+	{
+		const std::string &r = Extensions[i]->GetRowType ();
+		if (r == rowType || localName (r) == rowType)
+			return (int)i;
+	}
+	return -1;
+}
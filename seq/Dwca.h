@@ -0,0 +1,151 @@
+/*
+ * Dwca
+ * Read Darwin Core Archives in place.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef DWCA_H
+#define DWCA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Sequence.h"
+#include "TreeLib.h"
+
+
+//------------------------------------------------------------------------------
+// A field of a table: a pointer into the mapped file (or into the default
+// value from meta.xml) and a length. It stays valid while the table is open.
+struct DwcaString
+{
+	const char	*Data;
+	size_t		Length;
+
+	DwcaString () { Data = ""; Length = 0; };
+	DwcaString (const char *s, size_t n) { Data = s; Length = n; };
+
+	// Empty, or "\N" as dwca.php treats it
+	bool		IsEmpty () const { return Length == 0 || (Length == 2 && Data[0] == '\\' && Data[1] == 'N'); };
+	bool		Equals (const char *s) const;
+	// False unless the whole field is a number
+	bool		ToDouble (double &x) const;
+	std::string	ToString () const { return std::string (Data, Length); };
+};
+
+// A column as meta.xml describes it
+struct DwcaField
+{
+	int			Index;		// -1 for a constant (default only)
+	std::string	Term;		// e.g. http://rs.tdwg.org/dwc/terms/decimalLatitude
+	std::string	Name;		// local name of the term, e.g. decimalLatitude
+	std::string	Default;
+};
+
+
+//------------------------------------------------------------------------------
+// The core or an extension of an archive. The data file is memory-mapped and
+// its lines are found once, in parallel, with SSE2 when it is available;
+// rows are then split into fields on demand, as views into the file, so
+// reading a table allocates nothing per field.
+//
+// Lines end in \n (a \r before it is dropped). Fields may be enclosed in
+// fieldsEnclosedBy, which is stripped, but a delimiter inside an enclosed
+// field is not supported, and nor are escaped quotes.
+class DwcaTable
+{
+public:
+	DwcaTable ();
+	virtual ~DwcaTable () { Close (); };
+
+	// Take the description from a <core> or <extension> element of meta.xml
+	virtual bool	SetMeta (const std::string &element);
+	// Map the data file and index its lines (0 threads = one per core)
+	virtual bool	Open (const std::string &filename, int threads = 0);
+	virtual void	Close ();
+
+	const std::string &GetLocation () const { return Location; };
+	const std::string &GetRowType () const { return RowType; };
+	const std::vector<DwcaField> &GetFields () const { return Fields; };
+	// Column of the record id (the coreid for an extension), or -1
+	int				GetIdColumn () const { return IdColumn; };
+	// Index of the field with this term (full URI or local name), or -1
+	virtual int		GetField (const std::string &term) const;
+
+	int				GetNumRows () const { return (int)LineStart.size() - 1; };
+	// Split row into fields, indexed by column
+	virtual void	GetRow (int row, std::vector<DwcaString> &fields) const;
+	// Value of field f (an index into GetFields) in fields, or its default
+	virtual DwcaString GetValue (const std::vector<DwcaString> &fields, int f) const;
+
+	// Locate the leaves of t whose labels match a record's labelTerm (the id
+	// if empty) from its decimalLatitude and decimalLongitude. Returns the
+	// number of leaves located.
+	virtual int		SetLocations (Tree &t, const std::string &labelTerm = "") const;
+	// Add each record with a sequenceTerm value to s, labelled by labelTerm
+	// (the id if empty). Returns the number added.
+	virtual int		AddSequences (SequenceSet &s, const std::string &sequenceTerm,
+						const std::string &labelTerm = "") const;
+
+protected:
+	std::string				Location;
+	std::string				RowType;
+	char					Delimiter;
+	char					Enclosure;		// '\0' if none
+	int						IgnoreHeaderLines;
+	int						IdColumn;
+	std::vector<DwcaField>	Fields;
+
+	const char				*Data;
+	size_t					Size;
+	void					*Mapped;
+	std::string				Store;			// the file, where it cannot be mapped
+	std::vector<size_t>		LineStart;		// row i is [LineStart[i], LineStart[i + 1])
+
+	int				labelField (const std::string &labelTerm) const;
+	DwcaString		trim (const char *s, size_t n) const;
+
+private:
+	DwcaTable (const DwcaTable &);
+	DwcaTable &operator= (const DwcaTable &);
+};
+
+
+//------------------------------------------------------------------------------
+// An unpacked archive: meta.xml with the core and extension files beside it.
+class DwcaArchive
+{
+public:
+	DwcaArchive () {};
+	virtual ~DwcaArchive () { Close (); };
+
+	virtual bool	Open (const std::string &directory, int threads = 0);
+	virtual void	Close ();
+
+	DwcaTable		&GetCore () { return Core; };
+	int				GetNumExtensions () const { return (int)Extensions.size(); };
+	DwcaTable		&GetExtension (int i) { return *Extensions[i]; };
+	// Extension whose rowType is (or ends in) rowType, or -1
+	virtual int		FindExtension (const std::string &rowType) const;
+
+protected:
+	DwcaTable					Core;
+	std::vector<DwcaTable *>	Extensions;
+
+private:
+	DwcaArchive (const DwcaArchive &);
+	DwcaArchive &operator= (const DwcaArchive &);
+};
+
+
+#endif // DWCA_H
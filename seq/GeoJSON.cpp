@@ -0,0 +1,248 @@
+/*
+ * GeoJSON
+ * Write trees with node locations as GeoJSON for the map views.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "GeoJSON.h"
+
+#include <cmath>
+#include <cstdio>
+
+
+//------------------------------------------------------------------------------
+GeoJSONWriter::GeoJSONWriter ()
+{
+	InternalNodes = true;
+	Edges = true;
+	Digits = 5;		// about a metre
+	Out = NULL;
+	Stream = NULL;
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::flatten (Tree &t)
+{
+	t.GetPreorder (Nodes, Parent);
+	if (Nodes.empty ())
+		return;
+
+	int n = (int)Nodes.size();
+	Length.clear ();
+	if (t.GetHasEdgeLengths ())
+	{
+		Length.resize (n);
+		for (int i = 0; i < n; i++)
+			Length[i] = Nodes[i]->GetEdgeLength ();
+	}
+	Latitude.assign (n, 0.0);
+	Longitude.assign (n, 0.0);
+	State.assign (n, lsUnknown);
+	for (int i = 0; i < n; i++)
+		if (Nodes[i]->IsLocated ())
+		{
+			Latitude[i] = Nodes[i]->GetLatitude ();
+			Longitude[i] = Nodes[i]->GetLongitude ();
+			State[i] = lsKnown;
+		}
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::reconstruct ()
+{
+	AncestralLocations a;
+	a.Reconstruct (Parent, Length.empty () ? NULL : &Length[0], Latitude, Longitude, State);
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::flush (bool force)
+{
+	if (Stream && (force || Out->size() >= 65536))
+	{
+		Stream->write (Out->data(), Out->size());
+		Out->clear ();
+	}
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::appendInteger (long x)
+{
+	char buf[24];
+	int n = 0;
+	unsigned long u = (x < 0) ? -(unsigned long)x : (unsigned long)x;
+	do
+	{
+		buf[n++] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (x < 0)
+		buf[n++] = '-';
+	while (n > 0)
+		Out->push_back (buf[--n]);
+}
+
+//------------------------------------------------------------------------------
+// Fixed point with trailing zeros dropped
+void GeoJSONWriter::appendNumber (double x, int digits)
+{
+	if (!std::isfinite (x))
+	{
+		Out->append ("null");
+		return;
+	}
+	static const double scale[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+	double r = std::floor (std::fabs (x) * scale[digits] + 0.5);
+	if (r >= 9.0e18)
+	{
+		char buf[32];
+		int n = snprintf (buf, sizeof (buf), "%g", x);
+		Out->append (buf, n);
+		return;
+	}
+	unsigned long long v = (unsigned long long)r;
+	unsigned long long whole = v / (unsigned long long)scale[digits];
+	unsigned long long frac = v % (unsigned long long)scale[digits];
+	if (x < 0.0 && v > 0)
+		Out->push_back ('-');
+	appendInteger ((long)whole);
+	if (frac)
+	{
+		char buf[16];
+		int n = digits;
+		while (frac % 10 == 0)
+		{
+			frac /= 10;
+			n--;
+		}
+		for (int i = n - 1; i >= 0; i--)
+		{
+			buf[i] = (char)('0' + frac % 10);
+			frac /= 10;
+		}
+		Out->push_back ('.');
+		Out->append (buf, n);
+	}
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::appendString (const std::string &s)
+{
+	static const char hex[] = "0123456789abcdef";
+	Out->push_back ('"');
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		unsigned char c = (unsigned char)s[i];
+		switch (c)
+		{
+			case '"':	Out->append ("\\\""); break;
+			case '\\':	Out->append ("\\\\"); break;
+			case '\n':	Out->append ("\\n"); break;
+			case '\r':	Out->append ("\\r"); break;
+			case '\t':	Out->append ("\\t"); break;
+			default:
+				if (c < 0x20)
+				{
+					Out->append ("\\u00");
+					Out->push_back (hex[c >> 4]);
+					Out->push_back (hex[c & 0xf]);
+				}
+				else
+					Out->push_back ((char)c);
+				break;
+		}
+	}
+	Out->push_back ('"');
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::appendPosition (int i)
+{
+	Out->push_back ('[');
+	appendNumber (Longitude[i], Digits);
+	Out->push_back (',');
+	appendNumber (Latitude[i], Digits);
+	Out->push_back (']');
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::write (Tree &t)
+{
+	flatten (t);
+	if (InternalNodes)
+		reconstruct ();
+
+	Out->append ("{\"type\":\"FeatureCollection\",\"features\":[");
+	bool first = true;
+	int n = (int)Nodes.size();
+	for (int i = 0; i < n; i++)
+	{
+		if (State[i] == lsUnknown)
+			continue;
+		bool leaf = (Nodes[i]->GetChild () == NULL);
+		if (leaf ? (State[i] != lsKnown) : !InternalNodes)
+			continue;
+
+		if (!first)
+			Out->push_back (',');
+		first = false;
+		Out->append ("{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":");
+		appendPosition (i);
+		Out->append ("},\"properties\":{\"id\":");
+		appendInteger (i);
+		Out->append (",\"parent\":");
+		appendInteger (Parent[i]);
+		Out->append (",\"label\":");
+		appendString (Nodes[i]->GetLabel ());
+		Out->append (leaf ? ",\"leaf\":true" : ",\"leaf\":false");
+		Out->append ((State[i] == lsReconstructed) ? ",\"reconstructed\":true}}" : ",\"reconstructed\":false}}");
+
+		int p = Parent[i];
+		if (Edges && InternalNodes && p >= 0 && State[p] != lsUnknown)
+		{
+			Out->append (",{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[");
+			appendPosition (p);
+			Out->push_back (',');
+			appendPosition (i);
+			Out->append ("]},\"properties\":{\"parent\":");
+			appendInteger (p);
+			Out->append (",\"child\":");
+			appendInteger (i);
+			Out->append (",\"length\":");
+			appendNumber (Nodes[i]->GetEdgeLength (), 6);
+			Out->append ("}}");
+		}
+		flush (false);
+	}
+	Out->append ("]}\n");
+	flush (true);
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::Write (Tree &t, std::ostream &f)
+{
+	std::string buffer;
+	buffer.reserve (65536 + 4096);
+	Out = &buffer;
+	Stream = &f;
+	write (t);
+	Out = NULL;
+	Stream = NULL;
+}
+
+//------------------------------------------------------------------------------
+void GeoJSONWriter::Write (Tree &t, std::string &s)
+{
+	Out = &s;
+	Stream = NULL;
+	write (t);
+	Out = NULL;
+}
@@ -0,0 +1,84 @@
+/*
+ * GeoJSON
+ * Write trees with node locations as GeoJSON for the map views.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef GEOJSON_H
+#define GEOJSON_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TreeLib.h"
+#include "AncestralLocation.h"
+
+
+//------------------------------------------------------------------------------
+// A FeatureCollection with a Point for every node that has a location and,
+// optionally, a LineString from each such node to its parent. Leaves are
+// located by Node::SetLocation. Internal nodes keep their own location if
+// they have one; otherwise, if internal nodes are wanted, reconstruct ()
+// places them (by default by squared-change parsimony, see
+// AncestralLocations). Leaves with no location are left out, along with
+// their edges.
+//
+// Point properties are "id" (preorder number), "parent" (-1 for the root),
+// "label", "leaf" and "reconstructed"; LineString properties are "parent",
+// "child" and "length" (edge length).
+//
+// The JSON is written straight into a string, a feature at a time, with
+// hand-rolled number formatting, and handed to the stream in large pieces,
+// so no document is ever built in memory.
+class GeoJSONWriter
+{
+public:
+	GeoJSONWriter ();
+	virtual ~GeoJSONWriter () {};
+
+	virtual void	SetInternalNodes (bool on) { InternalNodes = on; };
+	virtual void	SetEdges (bool on) { Edges = on; };
+	virtual void	SetPrecision (int digits) { Digits = (digits < 0) ? 0 : (digits > 9 ? 9 : digits); };	// decimal places
+
+	virtual void	Write (Tree &t, std::ostream &f);
+	// Append to s rather than writing to a stream
+	virtual void	Write (Tree &t, std::string &s);
+
+protected:
+	bool					InternalNodes;
+	bool					Edges;
+	int						Digits;
+
+	std::vector<NodePtr>	Nodes;		// preorder
+	std::vector<int>		Parent;
+	std::vector<float>		Length;		// edge lengths, empty if the tree has none
+	std::vector<double>		Latitude;
+	std::vector<double>		Longitude;
+	std::vector<char>		State;		// lsUnknown, lsKnown or lsReconstructed
+
+	std::string				*Out;
+	std::ostream			*Stream;
+
+	virtual void	flatten (Tree &t);
+	virtual void	reconstruct ();
+	virtual void	write (Tree &t);
+
+	void			flush (bool force);
+	void			appendNumber (double x, int digits);
+	void			appendInteger (long x);
+	void			appendString (const std::string &s);
+	void			appendPosition (int i);
+};
+
+
+#endif // GEOJSON_H
@@ -0,0 +1,174 @@
+/*
+ * Haplotypes
+ * Collapse identical sequences before building trees, and expand them after.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Haplotypes.h"
+#include "HashMix.h"
+#include "Trace.h"
+
+
+//------------------------------------------------------------------------------
+// Hash the bases eight bytes at a time, then the runs of other residues
+static unsigned long long hashPacked (const PackedSequence &p)
+{
+	const std::vector<unsigned char> &bases = p.GetBases ();
+	unsigned long long h = HashMix ((unsigned long long)p.GetLength () + 0x9e3779b97f4a7c15ULL);
+	size_t n = bases.size();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		unsigned long long w = 0;
+		for (int j = 7; j >= 0; j--)
+			w = (w << 8) | bases[i + j];
+		h = HashMix (h ^ w) + 0x9e3779b97f4a7c15ULL;
+	}
+	unsigned long long w = 0;
+	for (; i < n; i++)
+		w = (w << 8) | bases[i];
+	h = HashMix (h ^ w);
+	const std::vector<std::pair<int, int> > &other = p.GetOther ();
+	for (size_t j = 0; j < other.size(); j++)
+		h = HashMix (h ^ (((unsigned long long)other[j].first << 32) | (unsigned int)other[j].second));
+	return h;
+}
+
+//------------------------------------------------------------------------------
+static bool samePacked (const PackedSequence &a, const PackedSequence &b)
+{
+	return a.GetLength () == b.GetLength ()
+		&& a.GetBases () == b.GetBases ()
+		&& a.GetOther () == b.GetOther ();
+}
+
+
+//------------------------------------------------------------------------------
+void UniqueSequences::Clear ()
+{
+	Index.clear ();
+	Packed.clear ();
+	Members.clear ();
+	HaplotypeOf.clear ();
+	Labels.clear ();
+	Unique.Clear ();
+}
+
+//------------------------------------------------------------------------------
+int UniqueSequences::Add (const std::string &label, const std::string &seq, bool *isNew)
+{
+	Work.Pack (seq.data(), (int)seq.size());
+	std::vector<int> &candidates = Index[hashPacked (Work)];
+	int h = -1;
+	for (size_t i = 0; i < candidates.size() && h < 0; i++)
+		if (samePacked (Packed[candidates[i]], Work))
+			h = candidates[i];
+	if (isNew)
+		*isNew = (h < 0);
+	if (h < 0)
+	{
+		h = (int)Members.size();
+		candidates.push_back (h);
+		Packed.push_back (Work);
+		Members.push_back (std::vector<int> ());
+		Unique.Add (label, seq);
+	}
+	Members[h].push_back ((int)HaplotypeOf.size());
+	HaplotypeOf.push_back (h);
+	Labels.push_back (label);
+	return h;
+}
+
+//------------------------------------------------------------------------------
+void UniqueSequences::Add (const SequenceSet &s)
+{
+	TREELIB_TRACE_SCOPE (trace, "UniqueSequences::Add");
+	for (int i = 0; i < s.GetNumSequences (); i++)
+		Add (s.GetLabel (i), s.GetSequence (i));
+	TREELIB_TRACE_ARG (trace, "sequences", s.GetNumSequences ());
+	TREELIB_TRACE_ARG (trace, "haplotypes", GetNumHaplotypes ());
+}
+
+//------------------------------------------------------------------------------
+NodePtr UniqueSequences::makeLeaf (Tree &t, int i) const
+{
+	NodePtr p = t.NewNode ();
+	p->SetLeaf (true);
+	p->SetLabel (Labels[i]);
+	p->SetLeafNumber (i + 1);
+	p->SetWeight (1);
+	p->SetEdgeLength (0.0);
+	return p;
+}
+
+//------------------------------------------------------------------------------
+bool UniqueSequences::Expand (Tree &t) const
+{
+	TREELIB_TRACE_SCOPE (trace, "UniqueSequences::Expand");
+	// Every haplotype must be a leaf exactly once, otherwise the renumbered
+	// leaves would not be 1..n
+	int n = GetNumHaplotypes ();
+	std::vector<NodePtr> leaves (n, (NodePtr)NULL);
+	std::vector<NodePtr> stack;
+	if (t.GetRoot ())
+		stack.push_back (t.GetRoot ());
+	int found = 0;
+	while (!stack.empty ())
+	{
+		NodePtr q = stack.back ();
+		stack.pop_back ();
+		for (NodePtr c = q->GetChild (); c; c = c->GetSibling ())
+			stack.push_back (c);
+		if (q->GetChild ())
+			continue;
+		int h = q->GetLeafNumber () - 1;
+		if (h < 0 || h >= n || leaves[h])
+			return false;
+		leaves[h] = q;
+		found++;
+	}
+	if (found != n)
+		return false;
+
+	for (int i = 0; i < n; i++)
+	{
+		NodePtr p = leaves[i];
+		const std::vector<int> &members = Members[i];
+		p->SetLabel (Labels[members[0]]);
+		p->SetLeafNumber (members[0] + 1);
+		if (members.size() == 1)
+			continue;
+
+		// The first duplicate makes a new node on the leaf's edge, which
+		// takes over the edge length; the rest join it as further children.
+		// Children are put in the order the sequences were added.
+		NodePtr last = makeLeaf (t, members[1]);
+		t.AddNodeBelow (last, p);
+		NodePtr anc = p->GetAnc ();
+		anc->SetEdgeLength (p->GetEdgeLength ());
+		p->SetEdgeLength (0.0);
+		anc->SetChild (p);
+		p->SetSibling (last);
+		last->SetSibling (NULL);
+		for (size_t j = 2; j < members.size(); j++)
+		{
+			NodePtr q = makeLeaf (t, members[j]);
+			q->SetAnc (anc);
+			last->SetSibling (q);
+			last = q;
+		}
+	}
+	t.Update ();
+	t.MakeNodeList ();
+	TREELIB_TRACE_ARG (trace, "leaves", t.GetNumLeaves ());
+	return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * Haplotypes
+ * Collapse identical sequences before building trees, and expand them after.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef HAPLOTYPES_H
+#define HAPLOTYPES_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Sequence.h"
+#include "TreeLib.h"
+
+
+//------------------------------------------------------------------------------
+// Sequences grouped into haplotypes: sequences that are the same once packed
+// (so ignoring case, and with every residue other than A, C, G and T counted
+// as N). Such sequences have the same k-mers, so their profiles are equal
+// and they are at distance zero from each other and the same distance from
+// everything else; a matrix and tree over one sequence per haplotype loses
+// nothing, and Expand puts the duplicates back as zero-length polytomies.
+//
+// Packed sequences are hashed, and sequences with the same hash are
+// compared in full, so haplotypes are exact.
+class UniqueSequences
+{
+public:
+	UniqueSequences () {};
+	virtual ~UniqueSequences () {};
+
+	virtual void	Clear ();
+
+	// Add a sequence, returning the index of its haplotype. isNew, if not
+	// NULL, is set to whether this is the first sequence of the haplotype.
+	virtual int		Add (const std::string &label, const std::string &seq, bool *isNew = NULL);
+	virtual void	Add (const SequenceSet &s);
+
+	virtual int		GetNumSequences () const { return (int)HaplotypeOf.size(); };
+	virtual int		GetNumHaplotypes () const { return (int)Members.size(); };
+	// Haplotype of each sequence added
+	virtual int		GetHaplotype (int i) const { return HaplotypeOf[i]; };
+	const std::string &GetLabel (int i) const { return Labels[i]; };
+	// Sequences with haplotype h, in order added; the first is its representative
+	virtual const std::vector<int> &GetMembers (int h) const { return Members[h]; };
+	// The representative of each haplotype, in haplotype order, to build
+	// profiles, matrices and trees from
+	virtual const SequenceSet &GetUnique () const { return Unique; };
+
+	// t is a tree over the haplotypes, with leaf number h + 1 for haplotype h
+	// (as DistanceTreeBuilder makes them). Each leaf whose haplotype has more
+	// than one sequence becomes a polytomy of all of them with zero-length
+	// edges, on the leaf's edge. Leaves are relabelled and renumbered so that
+	// sequence i is leaf number i + 1, and the node list is remade, so t[i] is
+	// the leaf for sequence i. Returns false, leaving t alone, unless its
+	// leaves are the haplotypes, each exactly once.
+	virtual bool	Expand (Tree &t) const;
+
+protected:
+	std::unordered_map<unsigned long long, std::vector<int> > Index;	// hash to haplotypes
+	std::vector<PackedSequence>		Packed;		// of each haplotype
+	std::vector<std::vector<int> >	Members;
+	std::vector<int>				HaplotypeOf;
+	std::vector<std::string>		Labels;
+	SequenceSet						Unique;
+	PackedSequence					Work;
+
+	virtual NodePtr	makeLeaf (Tree &t, int i) const;
+};
+
+
+#endif // HAPLOTYPES_H
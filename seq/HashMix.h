@@ -0,0 +1,33 @@
+/*
+ * HashMix
+ * Bit mixing shared by the sequence, k-mer and topology hashes.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef HASHMIX_H
+#define HASHMIX_H
+
+
+//------------------------------------------------------------------------------
+// MurmurHash3's 64-bit finaliser: every input bit affects every output bit
+inline unsigned long long HashMix (unsigned long long x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+
+#endif // HASHMIX_H
@@ -0,0 +1,538 @@
+/*
+ * Ingest
+ * Turn sequence dumps into Elasticsearch bulk requests and a profile store.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Ingest.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+const char *IngestFieldNames[ifNumFields] =
+{
+	"processid", "phylum", "class", "order", "family", "subfamily", "genus",
+	"species", "seq", "lat", "lon"
+};
+
+// Header names for each field, most preferred first
+static const char *columnNames[ifNumFields][5] =
+{
+	{ "processid", "id", "occurrenceid", "catalognumber", NULL },
+	{ "phylum_reg", "phylum", NULL },
+	{ "class_reg", "class", NULL },
+	{ "order_reg", "order", NULL },
+	{ "family_reg", "family", NULL },
+	{ "subfamily_reg", "subfamily", NULL },
+	{ "genus_reg", "genus", NULL },
+	{ "species_reg", "species_name", "species", "scientificname", NULL },
+	{ "nucraw", "nucleotides", "sequence", "seq", NULL },
+	{ "lat", "decimallatitude", "latitude", NULL },
+	{ "lon", "decimallongitude", "longitude", NULL }
+};
+
+// Largest k whose k-mers are counted in a table rather than sorted
+static const int denseKmerLength = 8;
+
+static const char storeMagic[4] = { 'T', 'L', 'P', 'S' };
+static const unsigned int storeVersion = 1;
+
+
+//------------------------------------------------------------------------------
+static std::string lowerCase (const std::string &s)
+{
+	std::string t (s);
+	for (size_t i = 0; i < t.size(); i++)
+		t[i] = (char)tolower ((unsigned char)t[i]);
+	return t;
+}
+
+//------------------------------------------------------------------------------
+IngestColumns::IngestColumns ()
+{
+	for (int f = 0; f < ifNumFields; f++)
+		Column[f] = -1;
+	Override.resize (ifNumFields);
+}
+
+//------------------------------------------------------------------------------
+void IngestColumns::SetColumnName (IngestField field, const std::string &name)
+{
+	Override[field] = lowerCase (name);
+}
+
+//------------------------------------------------------------------------------
+bool IngestColumns::ReadHeader (const std::string &line)
+{
+	std::vector<std::string> names;
+	size_t start = 0;
+	for (;;)
+	{
+		size_t end = line.find ('\t', start);
+		std::string name = line.substr (start, (end == std::string::npos) ? std::string::npos : end - start);
+		if (!name.empty () && name[name.size() - 1] == '\r')
+			name.erase (name.size() - 1);
+		names.push_back (lowerCase (name));
+		if (end == std::string::npos)
+			break;
+		start = end + 1;
+	}
+
+	for (int f = 0; f < ifNumFields; f++)
+	{
+		Column[f] = -1;
+		int rank = 1000;
+		for (int c = 0; c < (int)names.size(); c++)
+		{
+			if (!Override[f].empty ())
+			{
+				if (names[c] == Override[f])
+				{
+					Column[f] = c;
+					break;
+				}
+				continue;
+			}
+			for (int r = 0; r < rank && columnNames[f][r]; r++)
+				if (names[c] == columnNames[f][r])
+				{
+					Column[f] = c;
+					rank = r;
+					break;
+				}
+		}
+	}
+	return Column[ifProcessID] >= 0;
+}
+
+
+//------------------------------------------------------------------------------
+void AppendProfileStoreHeader (int k, std::string &out)
+{
+	unsigned int header[2] = { storeVersion, (unsigned int)k };
+	out.append (storeMagic, 4);
+	out.append ((const char *)header, sizeof (header));
+}
+
+//------------------------------------------------------------------------------
+// Sized once and filled with memcpy, as a record can have a thousand k-mers
+void AppendProfileRecord (const std::string &id, const PackedSequence &seq,
+	const std::vector<unsigned int> &kmers, const std::vector<unsigned int> &counts, std::string &out)
+{
+	const std::vector<std::pair<int, int> > &other = seq.GetOther ();
+	const std::vector<unsigned char> &bases = seq.GetBases ();
+	size_t at = out.size();
+	out.resize (at + (4 + 2 * other.size() + 2 * kmers.size()) * sizeof (unsigned int)
+		+ id.size() + bases.size());
+	char *p = &out[at];
+	unsigned int header[3] = { (unsigned int)id.size(), (unsigned int)seq.GetLength (), (unsigned int)other.size() };
+	memcpy (p, &header[0], sizeof (unsigned int));
+	p += sizeof (unsigned int);
+	memcpy (p, id.data(), id.size());
+	p += id.size();
+	memcpy (p, &header[1], 2 * sizeof (unsigned int));
+	p += 2 * sizeof (unsigned int);
+	if (!bases.empty ())
+		memcpy (p, &bases[0], bases.size());
+	p += bases.size();
+	for (size_t i = 0; i < other.size(); i++)
+	{
+		unsigned int run[2] = { (unsigned int)other[i].first, (unsigned int)other[i].second };
+		memcpy (p, run, sizeof (run));
+		p += sizeof (run);
+	}
+	unsigned int n = (unsigned int)kmers.size();
+	memcpy (p, &n, sizeof (n));
+	p += sizeof (n);
+	for (size_t i = 0; i < kmers.size(); i++)
+	{
+		unsigned int pair[2] = { kmers[i], counts[i] };
+		memcpy (p, pair, sizeof (pair));
+		p += sizeof (pair);
+	}
+}
+
+//------------------------------------------------------------------------------
+static bool readUInt (std::istream &f, unsigned int &x)
+{
+	return (bool)f.read ((char *)&x, sizeof (x));
+}
+
+//------------------------------------------------------------------------------
+bool ProfileStoreReader::Open (std::istream &f)
+{
+	In = NULL;
+	char magic[4];
+	unsigned int version, k;
+	if (!f.read (magic, 4) || memcmp (magic, storeMagic, 4) != 0
+		|| !readUInt (f, version) || version != storeVersion || !readUInt (f, k))
+		return false;
+	In = &f;
+	K = (int)k;
+
+	End = -1;
+	std::streamoff at = f.tellg ();
+	if (at >= 0 && f.seekg (0, std::ios::end))
+	{
+		End = f.tellg ();
+		f.seekg (at);
+	}
+	f.clear ();
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Could bytes more be read?
+bool ProfileStoreReader::fits (unsigned long long bytes) const
+{
+	if (End < 0)
+		return true;
+	std::streamoff at = In->tellg ();
+	return at >= 0 && at <= End && bytes <= (unsigned long long)(End - at);
+}
+
+//------------------------------------------------------------------------------
+// Read n bytes into s, growing it a block at a time so a bad n fails at
+// the end of the stream rather than in the allocator
+bool ProfileStoreReader::readBytes (size_t n, std::string &s)
+{
+	const size_t block = 1 << 20;
+	s.clear ();
+	while (s.size() < n)
+	{
+		size_t at = s.size();
+		size_t m = std::min (block, n - at);
+		s.resize (at + m);
+		if (!In->read (&s[at], m))
+			return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+bool ProfileStoreReader::Read (ProfileRecord &r)
+{
+	if (!In)
+		return false;
+	unsigned int n, length, runs;
+	if (!readUInt (*In, n) || !fits (n) || !readBytes (n, r.ID))
+		return false;
+	if (!readUInt (*In, length) || length > INT_MAX || !readUInt (*In, runs)
+		|| !fits (PackedSequence::GetPackedSize ((int)length) + 8ULL * runs))
+		return false;
+	if (!readBytes (PackedSequence::GetPackedSize ((int)length), Buffer))
+		return false;
+	Runs.clear ();
+	for (unsigned int j = 0; j < runs; j++)
+	{
+		unsigned int start, count;
+		if (!readUInt (*In, start) || !readUInt (*In, count) || start > INT_MAX || count > INT_MAX)
+			return false;
+		Runs.push_back (std::make_pair ((int)start, (int)count));
+	}
+	if (!r.Sequence.Set ((int)length, (const unsigned char *)Buffer.data(), Runs))
+		return false;
+
+	if (!readUInt (*In, n) || !fits (8ULL * n))
+		return false;
+	r.Kmers.clear ();
+	r.Counts.clear ();
+	for (unsigned int i = 0; i < n; i++)
+	{
+		unsigned int pair[2];
+		if (!In->read ((char *)pair, sizeof (pair)))
+			return false;
+		r.Kmers.push_back (pair[0]);
+		r.Counts.push_back (pair[1]);
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+static void appendJSONString (const char *s, size_t n, std::string &out)
+{
+	static const char hex[] = "0123456789abcdef";
+	out += '"';
+	for (size_t i = 0; i < n; i++)
+	{
+		unsigned char c = (unsigned char)s[i];
+		switch (c)
+		{
+			case '"':	out += "\\\""; break;
+			case '\\':	out += "\\\\"; break;
+			case '\n':	out += "\\n"; break;
+			case '\r':	out += "\\r"; break;
+			case '\t':	out += "\\t"; break;
+			default:
+				if (c < 0x20)
+				{
+					out += "\\u00";
+					out += hex[c >> 4];
+					out += hex[c & 15];
+				}
+				else
+					out += (char)c;
+				break;
+		}
+	}
+	out += '"';
+}
+
+//------------------------------------------------------------------------------
+// A coordinate is a decimal number in range. strtod also takes hex, "inf"
+// and "nan", which are not coordinates, so only digits, signs, points and
+// exponents are allowed.
+static bool isCoordinate (const char *s, size_t n, double limit, double &x)
+{
+	if (n == 0 || n > 63)
+		return false;
+	char buffer[64];
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!isdigit ((unsigned char)s[i]) && !strchr ("+-.eE ", s[i]))
+			return false;
+		buffer[i] = s[i];
+	}
+	buffer[n] = '\0';
+	char *end;
+	x = strtod (buffer, &end);
+	return end != buffer && *end == '\0' && std::isfinite (x) && std::fabs (x) <= limit;
+}
+
+//------------------------------------------------------------------------------
+// Write a coordinate as a JSON number, whatever form the dump had it in
+// (".5", "+12.5", "007" and "-1." are not JSON), in the fewest digits that
+// read back as the same double
+static void appendCoordinate (double x, std::string &out)
+{
+	char buf[32];
+	int n = snprintf (buf, sizeof (buf), "%.15g", x);
+	if (strtod (buf, NULL) != x)
+		n = snprintf (buf, sizeof (buf), "%.17g", x);
+	out.append (buf, n);
+}
+
+
+//------------------------------------------------------------------------------
+SequenceIngest::SequenceIngest ()
+{
+	Index = "dna";
+	Type = "sequence";
+	K = 5;
+	Threads = 0;
+	BatchSize = 4096;
+}
+
+//------------------------------------------------------------------------------
+void SequenceIngest::process (const std::string &line, bool bulk, bool store, Output &out, Workspace &w) const
+{
+	// Field boundaries, without copying
+	size_t n = line.size();
+	if (n > 0 && line[n - 1] == '\r')
+		n--;
+	if (n == 0)
+		return;
+	const char *text = line.c_str();
+	const char *begin[ifNumFields];
+	size_t length[ifNumFields];
+	for (int f = 0; f < ifNumFields; f++)
+	{
+		begin[f] = text;
+		length[f] = 0;
+	}
+	int column = 0;
+	size_t start = 0;
+	for (size_t i = 0; i <= n; i++)
+		if (i == n || text[i] == '\t')
+		{
+			for (int f = 0; f < ifNumFields; f++)
+				if (Columns.GetColumn ((IngestField)f) == column)
+				{
+					begin[f] = text + start;
+					length[f] = i - start;
+				}
+			column++;
+			start = i + 1;
+		}
+
+	// Process id without the marker suffix, as import-bulk.php does
+	const char *id = begin[ifProcessID];
+	size_t idLength = length[ifProcessID];
+	if (idLength >= 7 && memcmp (id + idLength - 7, ".COI-5P", 7) == 0)
+		idLength -= 7;
+	if (idLength == 0)
+	{
+		out.Skipped++;
+		return;
+	}
+	out.Records++;
+
+	if (bulk)
+	{
+		std::string &s = out.Bulk;
+		s += "{\"index\":{\"_index\":";
+		appendJSONString (Index.c_str(), Index.size(), s);
+		if (!Type.empty ())
+		{
+			s += ",\"_type\":";
+			appendJSONString (Type.c_str(), Type.size(), s);
+		}
+		s += ",\"_id\":";
+		appendJSONString (id, idLength, s);
+		s += "}}\n{\"processid\":";
+		appendJSONString (id, idLength, s);
+		for (int f = ifPhylum; f <= ifGenus; f++)
+			if (length[f] > 0)
+			{
+				s += ",\"";
+				s += IngestFieldNames[f];
+				s += "\":";
+				appendJSONString (begin[f], length[f], s);
+			}
+		s += ",\"species\":";
+		appendJSONString (begin[ifSpecies], length[ifSpecies], s);
+		s += ",\"seq\":";
+		appendJSONString (begin[ifSequence], length[ifSequence], s);
+		double latitude, longitude;
+		if (isCoordinate (begin[ifLatitude], length[ifLatitude], 90.0, latitude)
+			&& isCoordinate (begin[ifLongitude], length[ifLongitude], 180.0, longitude))
+		{
+			s += ",\"geometry\":{\"type\":\"Point\",\"coordinates\":[";
+			appendCoordinate (longitude, s);
+			s += ',';
+			appendCoordinate (latitude, s);
+			s += "]}";
+		}
+		s += "}\n";
+	}
+
+	if (store)
+	{
+		w.Packed.Pack (begin[ifSequence], (int)length[ifSequence]);
+
+		// Distinct k-mers and their counts, in increasing order. Short k-mers
+		// are counted in a table that is scanned in order; longer ones are
+		// sorted and run-length counted.
+		std::vector<unsigned int> &kmers = w.Kmers;
+		kmers.clear ();
+		w.Counts.clear ();
+		KmerIterator it (begin[ifSequence], (int)length[ifSequence], K);
+		unsigned int code;
+		if (K <= denseKmerLength)
+		{
+			std::vector<unsigned int> &table = w.Table;
+			table.resize (1u << (2 * K));
+			while (it.Next (code))
+				table[code]++;
+			for (unsigned int i = 0; i < table.size(); i++)
+				if (table[i])
+				{
+					kmers.push_back (i);
+					w.Counts.push_back (table[i]);
+					table[i] = 0;
+				}
+		}
+		else
+		{
+			while (it.Next (code))
+				kmers.push_back (code);
+			std::sort (kmers.begin(), kmers.end());
+			size_t distinct = 0;
+			for (size_t i = 0; i < kmers.size(); )
+			{
+				size_t j = i;
+				while (j < kmers.size() && kmers[j] == kmers[i])
+					j++;
+				kmers[distinct++] = kmers[i];
+				w.Counts.push_back ((unsigned int)(j - i));
+				i = j;
+			}
+			kmers.resize (distinct);
+		}
+		AppendProfileRecord (std::string (id, idLength), w.Packed, kmers, w.Counts, out.Store);
+	}
+}
+
+//------------------------------------------------------------------------------
+bool SequenceIngest::Run (std::istream &in, std::ostream *bulk, std::ostream *store, IngestStats &stats)
+{
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now ();
+	stats.Records = stats.Skipped = stats.Bytes = 0;
+	stats.Seconds = 0.0;
+
+	std::string line;
+	if (!std::getline (in, line) || !Columns.ReadHeader (line))
+		return false;
+	stats.Bytes += line.size() + 1;
+
+	if (store)
+	{
+		std::string header;
+		AppendProfileStoreHeader (K, header);
+		store->write (header.data(), header.size());
+	}
+
+	int threads = (Threads > 0) ? Threads : DefaultThreads ();
+	std::vector<std::string> batch (BatchSize);
+	std::vector<Output> outputs;
+	std::vector<Workspace> workspaces (threads);
+	for (;;)
+	{
+		int lines = 0;
+		while (lines < BatchSize && std::getline (in, batch[lines]))
+		{
+			stats.Bytes += batch[lines].size() + 1;
+			lines++;
+		}
+		if (lines == 0)
+			break;
+
+		// Contiguous chunks, a few per thread so that uneven lines balance
+		int chunk = lines / (4 * threads) + 1;
+		int chunks = (lines + chunk - 1) / chunk;
+		outputs.resize (chunks);
+		ParallelFor (chunks, [&](int c, int thread)
+			{
+				Output &out = outputs[c];
+				out.Bulk.clear ();
+				out.Store.clear ();
+				out.Records = out.Skipped = 0;
+				int end = std::min (lines, (c + 1) * chunk);
+				for (int i = c * chunk; i < end; i++)
+					process (batch[i], bulk != NULL, store != NULL, out, workspaces[thread]);
+			}, threads);
+
+		for (int c = 0; c < chunks; c++)
+		{
+			if (bulk)
+				bulk->write (outputs[c].Bulk.data(), outputs[c].Bulk.size());
+			if (store)
+				store->write (outputs[c].Store.data(), outputs[c].Store.size());
+			stats.Records += outputs[c].Records;
+			stats.Skipped += outputs[c].Skipped;
+		}
+		if (lines < BatchSize)
+			break;
+	}
+
+	stats.Seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - started).count ();
+	return true;
+}
@@ -0,0 +1,193 @@
+/*
+ * Ingest
+ * Turn sequence dumps into Elasticsearch bulk requests and a profile store.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Sequence.h"
+
+
+// Columns of a record, as import-bulk.php reads them from ibol_public
+enum IngestField
+{
+	ifProcessID,
+	ifPhylum,
+	ifClass,
+	ifOrder,
+	ifFamily,
+	ifSubfamily,
+	ifGenus,
+	ifSpecies,
+	ifSequence,
+	ifLatitude,
+	ifLongitude,
+	ifNumFields
+};
+
+// Names of the JSON keys for each field (the taxonomy without "_reg")
+extern const char *IngestFieldNames[ifNumFields];
+
+
+//------------------------------------------------------------------------------
+// Which column of a tab-separated dump holds each field, found from the
+// header line. Both the ibol_public column names (processid, class_reg,
+// nucraw, lat, ...) and Darwin Core terms (id, class, decimalLatitude, ...)
+// are recognised, ignoring case.
+class IngestColumns
+{
+public:
+	IngestColumns ();
+	virtual ~IngestColumns () {};
+
+	// Returns false if there is no id column
+	virtual bool	ReadHeader (const std::string &line);
+	// Use column name for field, overriding the header's guess
+	virtual void	SetColumnName (IngestField field, const std::string &name);
+
+	int				GetColumn (IngestField field) const { return Column[field]; };
+
+protected:
+	int							Column[ifNumFields];
+	std::vector<std::string>	Override;
+};
+
+
+//------------------------------------------------------------------------------
+// Binary store of packed sequences and their k-mer profiles, one record per
+// sequence after a header:
+//
+//	"TLPS", version, k					(uint32 after the magic)
+//	id length, id bytes
+//	sequence length, runs of other residues, packed bases, (start, length)
+//	number of distinct k-mers, (k-mer, count) in increasing k-mer order
+//
+// All integers are 32-bit in the byte order of the machine writing them.
+struct ProfileRecord
+{
+	std::string					ID;
+	PackedSequence				Sequence;
+	std::vector<unsigned int>	Kmers;
+	std::vector<unsigned int>	Counts;
+};
+
+class ProfileStoreReader
+{
+public:
+	ProfileStoreReader () { In = NULL; K = 0; End = -1; };
+	virtual ~ProfileStoreReader () {};
+
+	// Returns false if f does not start with a store header
+	virtual bool	Open (std::istream &f);
+	// Returns false at the end of the store, or at a record that is corrupt
+	// or cut short. Lengths in the file are checked against what is left of
+	// it (where the stream can tell), and otherwise read a block at a time,
+	// so a bad length cannot cause a huge allocation.
+	virtual bool	Read (ProfileRecord &r);
+
+	int				GetK () const { return K; };
+
+protected:
+	std::istream	*In;
+	int				K;
+	std::streamoff	End;		// size of the stream, -1 if unknown
+	std::string		Buffer;
+	std::vector<std::pair<int, int> > Runs;
+
+	bool			fits (unsigned long long bytes) const;
+	bool			readBytes (size_t n, std::string &s);
+};
+
+// Append a store header, or a record, to out
+void AppendProfileStoreHeader (int k, std::string &out);
+void AppendProfileRecord (const std::string &id, const PackedSequence &seq,
+	const std::vector<unsigned int> &kmers, const std::vector<unsigned int> &counts, std::string &out);
+
+
+//------------------------------------------------------------------------------
+struct IngestStats
+{
+	long long	Records;	// records written
+	long long	Skipped;	// lines with no id
+	long long	Bytes;		// input read
+	double		Seconds;
+
+	double		GetRecordsPerSecond () const { return (Seconds > 0.0) ? Records / Seconds : 0.0; };
+};
+
+//------------------------------------------------------------------------------
+// Read a tab-separated dump with a header line in one pass, writing an
+// Elasticsearch _bulk request (action and document lines, NDJSON) and/or a
+// profile store. Documents have the fields import-bulk.php sends: processid
+// (without ".COI-5P"), the taxonomy, species, seq, and a GeoJSON Point when
+// there are coordinates.
+//
+// Lines are read in batches; each batch is split between threads, which
+// parse, pack, count k-mers and format their records into buffers that are
+// then written in input order, so the output does not depend on the number
+// of threads.
+class SequenceIngest
+{
+public:
+	SequenceIngest ();
+	virtual ~SequenceIngest () {};
+
+	virtual void	SetIndex (const std::string &index, const std::string &type = "")
+	{
+		Index = index;
+		Type = type;
+	};
+	virtual void	SetK (int k) { K = (k < 1) ? 1 : (k > MAX_KMER_LENGTH ? MAX_KMER_LENGTH : k); };
+	virtual void	SetThreads (int n) { Threads = n; };	// 0 = one per core
+	virtual void	SetBatchSize (int n) { BatchSize = (n > 0) ? n : 1; };
+
+	IngestColumns	&GetColumns () { return Columns; };
+
+	// Either output may be NULL. Returns false if the header has no id column.
+	virtual bool	Run (std::istream &in, std::ostream *bulk, std::ostream *store, IngestStats &stats);
+
+protected:
+	IngestColumns	Columns;
+	std::string		Index;
+	std::string		Type;
+	int				K;
+	int				Threads;
+	int				BatchSize;
+
+	struct Output
+	{
+		std::string		Bulk;
+		std::string		Store;
+		long long		Records;
+		long long		Skipped;
+	};
+
+	// Per-thread buffers, reused between records
+	struct Workspace
+	{
+		PackedSequence				Packed;
+		std::vector<unsigned int>	Kmers;
+		std::vector<unsigned int>	Counts;
+		std::vector<unsigned int>	Table;		// counts of short k-mers
+	};
+
+	virtual void	process (const std::string &line, bool bulk, bool store, Output &out, Workspace &w) const;
+};
+
+
+#endif // INGEST_H
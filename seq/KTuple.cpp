@@ -0,0 +1,552 @@
+/*
+ * KTuple
+ * Alignment-free k-tuple profiles and distances (Yang & Zhang 2008).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "KTuple.h"
+#include "TileScheduler.h"
+#include "Trace.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+
+//------------------------------------------------------------------------------
+// Four independent accumulators so the compiler can keep the loop in SIMD
+// registers without needing -ffast-math to reassociate the sum.
+float SquaredEuclidean (const float *x, const float *y, int n)
+{
+	float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		float d0 = x[i] - y[i];
+		float d1 = x[i + 1] - y[i + 1];
+		float d2 = x[i + 2] - y[i + 2];
+		float d3 = x[i + 3] - y[i + 3];
+		s0 += d0 * d0;
+		s1 += d1 * d1;
+		s2 += d2 * d2;
+		s3 += d3 * d3;
+	}
+	for (; i < n; i++)
+	{
+		float d = x[i] - y[i];
+		s0 += d * d;
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+
+//------------------------------------------------------------------------------
+float DotProduct (const float *x, const float *y, int n)
+{
+	float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		s0 += x[i] * y[i];
+		s1 += x[i + 1] * y[i + 1];
+		s2 += x[i + 2] * y[i + 2];
+		s3 += x[i + 3] * y[i + 3];
+	}
+	for (; i < n; i++)
+		s0 += x[i] * y[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+//------------------------------------------------------------------------------
+// Natural log for normal x > 0, using the range reduction and polynomial of
+// the Cephes logf (accurate to about one ulp). It has no libm call or branch
+// so it can be evaluated four lanes at a time (vecLog4 below).
+static inline float vecLog (float x)
+{
+	unsigned int bits;
+	memcpy (&bits, &x, sizeof (bits));
+	float e = (float)((int)((bits >> 23) & 0xff) - 126);
+	bits = (bits & 0x007fffffu) | 0x3f000000u;	// mantissa in [0.5, 1)
+	float m;
+	memcpy (&m, &bits, sizeof (m));
+
+	// Shift mantissa to [sqrt(1/2), sqrt(2)) without a branch
+	float small = (m < 0.707106781f) ? 1.0f : 0.0f;
+	e -= small;
+	float t = m - 1.0f + small * m;
+
+	float z = t * t;
+	float y = 7.0376836292e-2f;
+	y = y * t - 1.1514610310e-1f;
+	y = y * t + 1.1676998740e-1f;
+	y = y * t - 1.2420140846e-1f;
+	y = y * t + 1.4249322787e-1f;
+	y = y * t - 1.6668057665e-1f;
+	y = y * t + 2.0000714765e-1f;
+	y = y * t - 2.4999993993e-1f;
+	y = y * t + 3.3333331174e-1f;
+	y = y * t * z;
+	y += -2.12194440e-4f * e;
+	y += -0.5f * z;
+	t += y;
+	t += 0.693359375f * e;
+	return t;
+}
+
+
+#ifdef __SSE2__
+//------------------------------------------------------------------------------
+// vecLog on four floats at once
+static inline __m128 vecLog4 (__m128 x)
+{
+	__m128i bits = _mm_castps_si128 (x);
+	__m128 e = _mm_cvtepi32_ps (_mm_sub_epi32 (
+		_mm_and_si128 (_mm_srli_epi32 (bits, 23), _mm_set1_epi32 (0xff)),
+		_mm_set1_epi32 (126)));
+	__m128 m = _mm_castsi128_ps (_mm_or_si128 (
+		_mm_and_si128 (bits, _mm_set1_epi32 (0x007fffff)),
+		_mm_set1_epi32 (0x3f000000)));
+
+	__m128 one = _mm_set1_ps (1.0f);
+	__m128 small = _mm_and_ps (_mm_cmplt_ps (m, _mm_set1_ps (0.707106781f)), one);
+	e = _mm_sub_ps (e, small);
+	__m128 t = _mm_add_ps (_mm_sub_ps (m, one), _mm_mul_ps (small, m));
+
+	__m128 z = _mm_mul_ps (t, t);
+	__m128 y = _mm_set1_ps (7.0376836292e-2f);
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (-1.1514610310e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (1.1676998740e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (-1.2420140846e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (1.4249322787e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (-1.6668057665e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (2.0000714765e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (-2.4999993993e-1f));
+	y = _mm_add_ps (_mm_mul_ps (y, t), _mm_set1_ps (3.3333331174e-1f));
+	y = _mm_mul_ps (_mm_mul_ps (y, t), z);
+	y = _mm_add_ps (y, _mm_mul_ps (_mm_set1_ps (-2.12194440e-4f), e));
+	y = _mm_add_ps (y, _mm_mul_ps (_mm_set1_ps (-0.5f), z));
+	t = _mm_add_ps (t, y);
+	return _mm_add_ps (t, _mm_mul_ps (_mm_set1_ps (0.693359375f), e));
+}
+#endif
+
+
+//------------------------------------------------------------------------------
+const char *DistanceModelName (DistanceModel m)
+{
+	switch (m)
+	{
+		case dmSquaredEuclidean:	return "euclidean";
+		case dmD2:					return "d2";
+		case dmD2Star:				return "d2star";
+		case dmD2S:					return "d2s";
+		case dmJensenShannon:		return "js";
+		case dmCosine:				return "cosine";
+	}
+	return "";
+}
+
+//------------------------------------------------------------------------------
+bool ParseDistanceModel (const std::string &name, DistanceModel &m)
+{
+	static const DistanceModel models[] =
+		{ dmSquaredEuclidean, dmD2, dmD2Star, dmD2S, dmJensenShannon, dmCosine };
+	for (size_t i = 0; i < sizeof (models) / sizeof (models[0]); i++)
+	{
+		if (name == DistanceModelName (models[i]))
+		{
+			m = models[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Pairwise kernels, one per model. Each is a struct with a static inline
+// Distance so fillMatrix<Kernel> is compiled separately for every model.
+
+// Convert a normalised similarity in [-1, 1] to (1 - c) / 2
+static inline float halfDissimilarity (float dot, float normX, float normY)
+{
+	float d = normX * normY;
+	float c = (d > 0.0f) ? dot / d : 0.0f;
+	return (c < 1.0f) ? 0.5f * (1.0f - c) : 0.0f;
+}
+
+struct SquaredEuclideanKernel
+{
+	static inline float Distance (const KTupleProfiles &P, int i, int j)
+	{
+		return SquaredEuclidean (P.GetProfile (i), P.GetProfile (j), P.GetProfileLength ());
+	}
+};
+
+struct D2Kernel
+{
+	static inline float Distance (const KTupleProfiles &P, int i, int j)
+	{
+		float dot = DotProduct (P.GetProfile (i), P.GetProfile (j), P.GetProfileLength ());
+		return halfDissimilarity (dot, P.GetNorm (i), P.GetNorm (j));
+	}
+};
+
+// The derived profiles are (X_w - E_w) / sqrt (E_w), so d2* is again a
+// normalised dot product
+struct D2StarKernel
+{
+	static inline float Distance (const KTupleProfiles &P, int i, int j)
+	{
+		float dot = DotProduct (P.GetDerived (i), P.GetDerived (j), P.GetProfileLength ());
+		return halfDissimilarity (dot, P.GetNorm (i), P.GetNorm (j));
+	}
+};
+
+// The derived profiles are X_w - E_w. The weight 1 / sqrt (x^2 + y^2)
+// depends on both profiles, so d2S needs its own loop.
+struct D2SKernel
+{
+	static inline float Distance (const KTupleProfiles &P, int i, int j)
+	{
+		const float *x = P.GetDerived (i);
+		const float *y = P.GetDerived (j);
+		int n = P.GetProfileLength ();
+
+#ifdef __SSE2__
+		// Written out with intrinsics because std::sqrt may set errno, which
+		// stops the compiler vectorising the loop itself
+		__m128 vdot = _mm_setzero_ps ();
+		__m128 vxx = _mm_setzero_ps ();
+		__m128 vyy = _mm_setzero_ps ();
+		__m128 tiny = _mm_set1_ps (1e-30f);
+		__m128 one = _mm_set1_ps (1.0f);
+		for (int w = 0; w < n; w += 4)	// n = 4^k
+		{
+			__m128 vx = _mm_loadu_ps (x + w);
+			__m128 vy = _mm_loadu_ps (y + w);
+			__m128 x2 = _mm_mul_ps (vx, vx);
+			__m128 y2 = _mm_mul_ps (vy, vy);
+			__m128 r = _mm_div_ps (one, _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (x2, y2), tiny)));
+			vdot = _mm_add_ps (vdot, _mm_mul_ps (_mm_mul_ps (vx, vy), r));
+			vxx = _mm_add_ps (vxx, _mm_mul_ps (x2, r));
+			vyy = _mm_add_ps (vyy, _mm_mul_ps (y2, r));
+		}
+		float dot[4], xx[4], yy[4];
+		_mm_storeu_ps (dot, vdot);
+		_mm_storeu_ps (xx, vxx);
+		_mm_storeu_ps (yy, vyy);
+#else
+		float dot[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float xx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float yy[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int w = 0; w < n; w += 4)	// n = 4^k
+		{
+			for (int l = 0; l < 4; l++)
+			{
+				float x2 = x[w + l] * x[w + l];
+				float y2 = y[w + l] * y[w + l];
+				float r = 1.0f / std::sqrt (x2 + y2 + 1e-30f);
+				dot[l] += x[w + l] * y[w + l] * r;
+				xx[l] += x2 * r;
+				yy[l] += y2 * r;
+			}
+		}
+#endif
+		float d = (dot[0] + dot[1]) + (dot[2] + dot[3]);
+		float a = (xx[0] + xx[1]) + (xx[2] + xx[3]);
+		float b = (yy[0] + yy[1]) + (yy[2] + yy[3]);
+		return halfDissimilarity (d, std::sqrt (a), std::sqrt (b));
+	}
+};
+
+// JSD = 1/2 sum p log2 (2p / m) + q log2 (2q / m), m = p + q. With
+// r = (p - q) / m, 2p / m = 1 + r and 2q / m = 1 - r, so near-identical
+// profiles give terms near zero rather than differences of large logs, and
+// identical ones give exactly zero. Zero frequencies need no special case
+// (0 * log (tiny) = 0).
+struct JensenShannonKernel
+{
+	static inline float Distance (const KTupleProfiles &P, int i, int j)
+	{
+		const float *x = P.GetProfile (i);
+		const float *y = P.GetProfile (j);
+		int n = P.GetProfileLength ();
+		float ix = P.GetTotal (i) > 0.0f ? 1.0f / P.GetTotal (i) : 0.0f;
+		float iy = P.GetTotal (j) > 0.0f ? 1.0f / P.GetTotal (j) : 0.0f;
+#ifdef __SSE2__
+		__m128 vs = _mm_setzero_ps ();
+		__m128 vix = _mm_set1_ps (ix);
+		__m128 viy = _mm_set1_ps (iy);
+		__m128 tiny = _mm_set1_ps (1e-30f);
+		__m128 one = _mm_set1_ps (1.0f);
+		for (int w = 0; w < n; w += 4)	// n = 4^k
+		{
+			__m128 p = _mm_mul_ps (_mm_loadu_ps (x + w), vix);
+			__m128 q = _mm_mul_ps (_mm_loadu_ps (y + w), viy);
+			__m128 r = _mm_div_ps (_mm_sub_ps (p, q), _mm_add_ps (_mm_add_ps (p, q), tiny));
+			__m128 lp = vecLog4 (_mm_add_ps (_mm_add_ps (one, r), tiny));
+			__m128 lq = vecLog4 (_mm_add_ps (_mm_sub_ps (one, r), tiny));
+			vs = _mm_add_ps (vs, _mm_add_ps (_mm_mul_ps (p, lp), _mm_mul_ps (q, lq)));
+		}
+		float s[4];
+		_mm_storeu_ps (s, vs);
+#else
+		float s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int w = 0; w < n; w += 4)	// n = 4^k
+		{
+			for (int l = 0; l < 4; l++)
+			{
+				float p = x[w + l] * ix;
+				float q = y[w + l] * iy;
+				float r = (p - q) / (p + q + 1e-30f);
+				s[l] += p * vecLog (1.0f + r + 1e-30f) + q * vecLog (1.0f - r + 1e-30f);
+			}
+		}
+#endif
+		float jsd = 0.5f * 1.4426950f * ((s[0] + s[1]) + (s[2] + s[3]));
+		return (jsd > 0.0f) ? std::sqrt (jsd) : 0.0f;
+	}
+};
+
+struct CosineKernel
+{
+	static inline float Distance (const KTupleProfiles &P, int i, int j)
+	{
+		float dot = DotProduct (P.GetProfile (i), P.GetProfile (j), P.GetProfileLength ());
+		float d = P.GetNorm (i) * P.GetNorm (j);
+		float c = (d > 0.0f) ? dot / d : 0.0f;
+		if (c > 1.0f) c = 1.0f;
+		if (c < -1.0f) c = -1.0f;
+		return (float)(std::acos (c) / M_PI);
+	}
+};
+
+//------------------------------------------------------------------------------
+// Fill the matrix a tile at a time, so the profiles for a tile's rows and
+// columns stay in cache while every pair between them is computed, and the
+// tiles are shared out over the threads.
+template <class Kernel>
+static void fillMatrix (const KTupleProfiles &P, DistanceMatrix &D, int threads)
+{
+	int n = P.GetNumProfiles ();
+	int b = TileSizeForCache ((size_t)P.GetProfileLength () * sizeof (float));
+	ForEachTile (n, b, [&P, &D](const Tile &t)
+	{
+		for (int i = t.RowBegin; i < t.RowEnd; i++)
+		{
+			float *row = D.GetRow (i);
+			int end = (t.ColEnd < i) ? t.ColEnd : i;
+			for (int j = t.ColBegin; j < end; j++)
+				row[j] = Kernel::Distance (P, i, j);
+		}
+	}, threads);
+}
+
+
+//------------------------------------------------------------------------------
+KTupleProfiles::KTupleProfiles (int k, DistanceModel model)
+{
+	if (k < 1) k = 1;
+	if (k > 12) k = 12;	// 4^12 floats per profile is already 64 Mb
+	K = k;
+	ProfileLength = 1 << (2 * K);
+	NumProfiles = 0;
+	Model = model;
+}
+
+//------------------------------------------------------------------------------
+void KTupleProfiles::Build (const SequenceSet &s)
+{
+	std::vector<int> none;
+	Build (s, none);
+}
+
+//------------------------------------------------------------------------------
+// With weights, the window starting at position p is counted weights[p]
+// times (and not at all past the end of weights)
+void KTupleProfiles::Build (const SequenceSet &s, const std::vector<int> &weights)
+{
+	TREELIB_TRACE_SCOPE (trace, "KTupleProfiles::Build");
+	NumProfiles = s.GetNumSequences ();
+	TREELIB_TRACE_ARG (trace, "sequences", NumProfiles);
+	Counts.assign ((size_t)NumProfiles * ProfileLength, 0.0f);
+	TREELIB_TRACE_ALLOC (Counts.size() * sizeof (float));
+	BaseFreqs.assign ((size_t)NumProfiles * 4, 0.0f);
+	Totals.assign (NumProfiles, 0.0f);
+	Labels.resize (NumProfiles);
+
+	for (int i = 0; i < NumProfiles; i++)
+	{
+		count (i, s.GetSequence (i), weights);
+		Labels[i] = s.GetLabel (i);
+	}
+	prepare ();
+}
+
+//------------------------------------------------------------------------------
+int KTupleProfiles::Add (const std::string &label, const std::string &seq)
+{
+	int i = NumProfiles++;
+	Counts.resize ((size_t)NumProfiles * ProfileLength, 0.0f);
+	BaseFreqs.resize ((size_t)NumProfiles * 4, 0.0f);
+	Totals.push_back (0.0f);
+	Labels.push_back (label);
+	std::vector<int> none;
+	count (i, seq, none);
+	return i;
+}
+
+//------------------------------------------------------------------------------
+// Count the k-mers and base composition of seq into profile i, which is zero
+void KTupleProfiles::count (int i, const std::string &seq, const std::vector<int> &weights)
+{
+	bool weighted = !weights.empty ();
+	int numWeights = (int)weights.size();
+	float *profile = &Counts[(size_t)i * ProfileLength];
+	KmerIterator it (seq.c_str(), (int)seq.size(), K);
+	unsigned int code;
+	int total = 0;
+	while (it.Next (code))
+	{
+		int w = 1;
+		if (weighted)
+		{
+			int pos = it.GetPosition ();
+			w = (pos < numWeights) ? weights[pos] : 0;
+		}
+		profile[code] += (float)w;
+		total += w;
+	}
+	Totals[i] = (float)total;
+
+	int bases[5] = { 0, 0, 0, 0, 0 };
+	for (size_t j = 0; j < seq.size(); j++)
+		bases[NucleotideCode[(unsigned char)seq[j]]]++;
+	int acgt = bases[0] + bases[1] + bases[2] + bases[3];
+	for (int b = 0; b < 4; b++)
+		BaseFreqs[(size_t)i * 4 + b] = acgt ? (float)bases[b] / acgt : 0.25f;
+}
+
+//------------------------------------------------------------------------------
+void KTupleProfiles::SetModel (DistanceModel model)
+{
+	Model = model;
+	prepare ();
+}
+
+//------------------------------------------------------------------------------
+// Expected count of every k-mer in profile i under an i.i.d. model with the
+// sequence's own base composition, E_w = total * prod p(b), b in w
+void KTupleProfiles::expected (int i, std::vector<float> &e) const
+{
+	const float *p = &BaseFreqs[(size_t)i * 4];
+	e.assign (ProfileLength, 0.0f);
+	e[0] = 1.0f;
+	int n = 1;
+	for (int len = 0; len < K; len++)
+	{
+		// Extend all n words of length len by one base, in place, working
+		// backwards so we don't overwrite words we still need
+		for (int w = n - 1; w >= 0; w--)
+		{
+			float pw = e[w];
+			for (int b = 3; b >= 0; b--)
+				e[4 * w + b] = pw * p[b];
+		}
+		n *= 4;
+	}
+	for (int w = 0; w < ProfileLength; w++)
+		e[w] *= Totals[i];
+}
+
+//------------------------------------------------------------------------------
+// Fill in the derived profiles and norms the current model needs
+void KTupleProfiles::prepare ()
+{
+	Derived.clear ();
+	Norms.assign (NumProfiles, 0.0f);
+
+	switch (Model)
+	{
+		case dmD2:
+		case dmCosine:
+			for (int i = 0; i < NumProfiles; i++)
+				Norms[i] = std::sqrt (DotProduct (GetProfile (i), GetProfile (i), ProfileLength));
+			break;
+
+		case dmD2Star:
+		case dmD2S:
+			{
+				Derived.assign ((size_t)NumProfiles * ProfileLength, 0.0f);
+				std::vector<float> e;
+				for (int i = 0; i < NumProfiles; i++)
+				{
+					expected (i, e);
+					const float *x = GetProfile (i);
+					float *d = &Derived[(size_t)i * ProfileLength];
+					for (int w = 0; w < ProfileLength; w++)
+					{
+						d[w] = x[w] - e[w];
+						if (Model == dmD2Star)
+							d[w] = (e[w] > 0.0f) ? d[w] / std::sqrt (e[w]) : 0.0f;
+					}
+					Norms[i] = std::sqrt (DotProduct (d, d, ProfileLength));
+				}
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+//------------------------------------------------------------------------------
+float KTupleProfiles::Distance (int i, int j) const
+{
+	if (i == j)
+		return 0.0f;
+	switch (Model)
+	{
+		case dmD2:				return D2Kernel::Distance (*this, i, j);
+		case dmD2Star:			return D2StarKernel::Distance (*this, i, j);
+		case dmD2S:				return D2SKernel::Distance (*this, i, j);
+		case dmJensenShannon:	return JensenShannonKernel::Distance (*this, i, j);
+		case dmCosine:			return CosineKernel::Distance (*this, i, j);
+		default:				return SquaredEuclideanKernel::Distance (*this, i, j);
+	}
+}
+
+//------------------------------------------------------------------------------
+void KTupleProfiles::Distances (DistanceMatrix &D, int threads) const
+{
+	TREELIB_TRACE_SCOPE (trace, "KTupleProfiles::Distances");
+	TREELIB_TRACE_ARG (trace, "pairs", (long long)NumProfiles * (NumProfiles - 1) / 2);
+	// A matrix already mapped to a file of the right size is filled in place
+	if (!D.IsMapped () || D.GetSize () != NumProfiles)
+		D.SetSize (NumProfiles);
+	for (int i = 0; i < NumProfiles; i++)
+		D.SetLabel (i, Labels[i]);
+
+	switch (Model)
+	{
+		case dmD2:				fillMatrix<D2Kernel> (*this, D, threads); break;
+		case dmD2Star:			fillMatrix<D2StarKernel> (*this, D, threads); break;
+		case dmD2S:				fillMatrix<D2SKernel> (*this, D, threads); break;
+		case dmJensenShannon:	fillMatrix<JensenShannonKernel> (*this, D, threads); break;
+		case dmCosine:			fillMatrix<CosineKernel> (*this, D, threads); break;
+		default:				fillMatrix<SquaredEuclideanKernel> (*this, D, threads); break;
+	}
+}
@@ -0,0 +1,110 @@
+/*
+ * KTuple
+ * Alignment-free k-tuple profiles and distances (Yang & Zhang 2008).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef KTUPLE_H
+#define KTUPLE_H
+
+#include <string>
+#include <vector>
+
+#include "Sequence.h"
+#include "DistanceMatrix.h"
+
+
+// Alignment-free distance models. All share the count profile layout; the
+// models that need more than the raw counts get a derived per-profile array
+// (or norm) when the model is selected, so the pairwise kernels stay
+// straight loops over contiguous floats.
+enum DistanceModel
+{
+	dmSquaredEuclidean,		// sum (X_w - Y_w)^2 on counts, as dist.php
+	dmD2,					// (1 - D2 / (|X| |Y|)) / 2
+	dmD2Star,				// d2* of Reinert et al. 2009, i.i.d. background per sequence
+	dmD2S,					// d2S of Reinert et al. 2009, same background
+	dmJensenShannon,		// square root of the Jensen-Shannon divergence (base 2) of frequencies
+	dmCosine				// angle between profiles / pi
+};
+
+const char *DistanceModelName (DistanceModel m);
+
+// Model from its name ("euclidean", "d2", "d2star", "d2s", "js", "cosine"),
+// returns false if the name is not recognised
+bool ParseDistanceModel (const std::string &name, DistanceModel &m);
+
+
+//------------------------------------------------------------------------------
+// Dense k-tuple count profiles, one row of 4^k floats per sequence. Tuples
+// containing residues other than A, C, G, T are not counted.
+class KTupleProfiles
+{
+public:
+	KTupleProfiles (int k = 5, DistanceModel model = dmSquaredEuclidean);
+	virtual ~KTupleProfiles () {};
+
+	virtual void	Build (const SequenceSet &s);
+	// Build with each k-mer window weighted by its start position, as used to
+	// bootstrap by resampling window positions
+	virtual void	Build (const SequenceSet &s, const std::vector<int> &weights);
+	// Add one sequence as a new profile, so profiles can be built while
+	// sequences are still arriving. Call Finish once they are all added.
+	virtual int		Add (const std::string &label, const std::string &seq);
+	virtual void	Finish () { prepare (); };
+
+	// Select the distance model, computing any derived profiles it needs
+	virtual void	SetModel (DistanceModel model);
+	DistanceModel	GetModel () const { return Model; };
+
+	// The whole matrix is computed by a kernel specialised for the model, so
+	// the model is only tested once rather than for every pair. The work is
+	// split into cache-sized tiles spread over threads (0 = one per core).
+	// If D is already mapped to a file for this many profiles the distances
+	// are written straight into the file.
+	virtual void	Distances (DistanceMatrix &D, int threads = 0) const;
+	virtual float	Distance (int i, int j) const;
+
+	int				GetK () const { return K; };
+	int				GetNumProfiles () const { return NumProfiles; };
+	int				GetProfileLength () const { return ProfileLength; };
+	const float		*GetProfile (int i) const { return &Counts[(size_t)i * ProfileLength]; };
+	const float		*GetDerived (int i) const { return &Derived[(size_t)i * ProfileLength]; };
+	float			GetNorm (int i) const { return Norms[i]; };
+	float			GetTotal (int i) const { return Totals[i]; };
+	const std::string &GetLabel (int i) const { return Labels[i]; };
+
+protected:
+	int							K;
+	int							ProfileLength;
+	int							NumProfiles;
+	DistanceModel				Model;
+	std::vector<float>			Counts;
+	std::vector<float>			BaseFreqs;	// A, C, G, T frequencies, 4 per profile
+	std::vector<float>			Totals;		// k-mers counted per profile
+	std::vector<float>			Derived;	// model-specific profiles (d2*, d2S)
+	std::vector<float>			Norms;		// model-specific norm per profile
+	std::vector<std::string>	Labels;
+
+	virtual void	count (int i, const std::string &seq, const std::vector<int> &weights);
+	virtual void	prepare ();
+	virtual void	expected (int i, std::vector<float> &e) const;
+};
+
+// Squared Euclidean distance between two profiles of length n
+float SquaredEuclidean (const float *x, const float *y, int n);
+
+// Dot product of two profiles of length n
+float DotProduct (const float *x, const float *y, int n);
+
+
+#endif // KTUPLE_H
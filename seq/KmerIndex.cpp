@@ -0,0 +1,301 @@
+/*
+ * KmerIndex
+ * In-memory inverted index from k-mers to the sequences containing them.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "KmerIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+#ifdef __SSSE3__
+	#include <tmmintrin.h>
+#endif
+
+
+//------------------------------------------------------------------------------
+// Number of bytes needed to store a delta
+static inline unsigned int deltaBytes (unsigned int delta)
+{
+	if (delta < (1u << 8)) return 1;
+	if (delta < (1u << 16)) return 2;
+	if (delta < (1u << 24)) return 3;
+	return 4;
+}
+
+//------------------------------------------------------------------------------
+// Decoding tables for a control byte: total bytes in the group, and the
+// shuffle that spreads the packed bytes into four 32-bit lanes.
+struct GroupTables
+{
+	unsigned char	Length[256];
+	unsigned char	Shuffle[256][16];
+
+	GroupTables ()
+	{
+		for (int c = 0; c < 256; c++)
+		{
+			int offset = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				int len = ((c >> (2 * i)) & 3) + 1;
+				for (int b = 0; b < 4; b++)
+					Shuffle[c][4 * i + b] = (b < len) ? (unsigned char)(offset + b) : 0x80;
+				offset += len;
+			}
+			Length[c] = (unsigned char)offset;
+		}
+	}
+};
+
+static const GroupTables groupTables;
+
+
+//------------------------------------------------------------------------------
+// Decode the n ids stored at p, calling sink (id) for each in order.
+template <class Sink>
+static void decodeList (const unsigned char *p, unsigned int n, Sink &sink)
+{
+	const unsigned char *ctrl = p;
+	const unsigned char *data = p + (n + 3) / 4;
+	unsigned int prev = 0;
+
+#ifdef __SSSE3__
+	unsigned int groups = n / 4;
+	// Data is padded so a 16 byte load past the last group is safe
+	__attribute__((aligned(16))) unsigned int out[4];
+	for (unsigned int g = 0; g < groups; g++)
+	{
+		unsigned char c = ctrl[g];
+		__m128i v = _mm_loadu_si128 ((const __m128i *)data);
+		v = _mm_shuffle_epi8 (v, _mm_loadu_si128 ((const __m128i *)groupTables.Shuffle[c]));
+		v = _mm_add_epi32 (v, _mm_slli_si128 (v, 4));
+		v = _mm_add_epi32 (v, _mm_slli_si128 (v, 8));
+		v = _mm_add_epi32 (v, _mm_set1_epi32 ((int)prev));
+		_mm_store_si128 ((__m128i *)out, v);
+		sink (out[0]);
+		sink (out[1]);
+		sink (out[2]);
+		sink (out[3]);
+		prev = out[3];
+		data += groupTables.Length[c];
+	}
+	unsigned int done = groups * 4;
+#else
+	unsigned int done = 0;
+#endif
+
+	for (unsigned int i = done; i < n; i++)
+	{
+		unsigned int len = ((ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1;
+		unsigned int delta = 0;
+		for (unsigned int b = 0; b < len; b++)
+			delta |= (unsigned int)data[b] << (8 * b);
+		data += len;
+		prev += delta;
+		sink (prev);
+	}
+}
+
+//------------------------------------------------------------------------------
+struct ScoreSink
+{
+	unsigned int *Scores;
+	void operator() (unsigned int id) { Scores[id]++; }
+};
+
+struct CollectSink
+{
+	std::vector<unsigned int> *Ids;
+	void operator() (unsigned int id) { Ids->push_back (id); }
+};
+
+
+//------------------------------------------------------------------------------
+KmerIndex::KmerIndex (int k)
+{
+	if (k < 1) k = 1;
+	if (k > MAX_INDEX_K) k = MAX_INDEX_K;
+	K = k;
+	NumSequences = 0;
+	NumLists = 1u << (2 * K);
+}
+
+//------------------------------------------------------------------------------
+// Sorted, distinct k-mers of a sequence
+void KmerIndex::distinctKmers (const std::string &s, std::vector<unsigned int> &kmers) const
+{
+	kmers.clear ();
+	KmerIterator it (s.c_str(), (int)s.size(), K);
+	unsigned int code;
+	while (it.Next (code))
+		kmers.push_back (code);
+	std::sort (kmers.begin(), kmers.end());
+	kmers.erase (std::unique (kmers.begin(), kmers.end()), kmers.end());
+}
+
+//------------------------------------------------------------------------------
+// Two passes over the sequences: the first sizes every list exactly, the
+// second encodes straight into the final buffer, so we never hold the raw
+// (uncompressed) postings in memory.
+void KmerIndex::Build (const SequenceSet &s)
+{
+	NumSequences = s.GetNumSequences ();
+	Lengths.assign (NumLists, 0);
+	Offsets.assign (NumLists + 1, 0);
+
+	std::vector<unsigned int> last (NumLists, 0);
+	std::vector<unsigned int> kmers;
+
+	// Pass 1: count ids and data bytes per list
+	for (int id = 0; id < NumSequences; id++)
+	{
+		distinctKmers (s.GetSequence (id), kmers);
+		for (size_t i = 0; i < kmers.size(); i++)
+		{
+			unsigned int km = kmers[i];
+			unsigned int delta = id - last[km];
+			Offsets[km] += deltaBytes (delta);
+			Lengths[km]++;
+			last[km] = id;
+		}
+	}
+
+	// List sizes to offsets
+	size_t total = 0;
+	for (unsigned int km = 0; km < NumLists; km++)
+	{
+		size_t size = (Lengths[km] + 3) / 4 + Offsets[km];
+		Offsets[km] = total;
+		total += size;
+	}
+	Offsets[NumLists] = total;
+	Data.assign (total + 16, 0);
+
+	// Pass 2: encode
+	std::vector<size_t> cursor (NumLists);
+	std::vector<unsigned int> count (NumLists, 0);
+	for (unsigned int km = 0; km < NumLists; km++)
+	{
+		cursor[km] = Offsets[km] + (Lengths[km] + 3) / 4;
+		last[km] = 0;
+	}
+	for (int id = 0; id < NumSequences; id++)
+	{
+		distinctKmers (s.GetSequence (id), kmers);
+		for (size_t i = 0; i < kmers.size(); i++)
+		{
+			unsigned int km = kmers[i];
+			unsigned int delta = id - last[km];
+			unsigned int len = deltaBytes (delta);
+			unsigned int c = count[km]++;
+			Data[Offsets[km] + c / 4] |= (unsigned char)((len - 1) << (2 * (c % 4)));
+			unsigned char *out = &Data[cursor[km]];
+			for (unsigned int b = 0; b < len; b++)
+				out[b] = (unsigned char)(delta >> (8 * b));
+			cursor[km] += len;
+			last[km] = id;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+void KmerIndex::scoreList (unsigned int kmer, unsigned int *scores) const
+{
+	ScoreSink sink;
+	sink.Scores = scores;
+	decodeList (&Data[Offsets[kmer]], Lengths[kmer], sink);
+}
+
+//------------------------------------------------------------------------------
+void KmerIndex::GetPostings (unsigned int kmer, std::vector<unsigned int> &ids) const
+{
+	ids.clear ();
+	if (kmer >= NumLists || Data.empty())
+		return;
+	ids.reserve (Lengths[kmer]);
+	CollectSink sink;
+	sink.Ids = &ids;
+	decodeList (&Data[Offsets[kmer]], Lengths[kmer], sink);
+}
+
+//------------------------------------------------------------------------------
+void KmerIndex::Search (const std::string &query, int maxHits,
+	std::vector<KmerHit> &hits) const
+{
+	hits.clear ();
+	if (NumSequences == 0 || maxHits <= 0)
+		return;
+
+	std::vector<unsigned int> kmers;
+	distinctKmers (query, kmers);
+
+	std::vector<unsigned int> scores (NumSequences, 0);
+	for (size_t i = 0; i < kmers.size(); i++)
+		scoreList (kmers[i], &scores[0]);
+
+	// Keep the best maxHits in a min-heap keyed on (score, -id)
+	typedef std::pair<unsigned int, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+	for (int id = 0; id < NumSequences; id++)
+	{
+		unsigned int score = scores[id];
+		if (score == 0)
+			continue;
+		if ((int)heap.size() < maxHits)
+			heap.push (Entry (score, -id));
+		else if (Entry (score, -id) > heap.top())
+		{
+			heap.pop ();
+			heap.push (Entry (score, -id));
+		}
+	}
+
+	hits.resize (heap.size());
+	for (int i = (int)heap.size() - 1; i >= 0; i--)
+	{
+		hits[i].Id = -heap.top().second;
+		hits[i].Score = (int)heap.top().first;
+		heap.pop ();
+	}
+}
+
+//------------------------------------------------------------------------------
+size_t KmerIndex::GetNumPostings () const
+{
+	size_t n = 0;
+	for (size_t i = 0; i < Lengths.size(); i++)
+		n += Lengths[i];
+	return n;
+}
+
+//------------------------------------------------------------------------------
+size_t KmerIndex::GetMemoryUsage () const
+{
+	return Data.size()
+		+ Offsets.size() * sizeof (size_t)
+		+ Lengths.size() * sizeof (unsigned int);
+}
+
+
+//------------------------------------------------------------------------------
+void GetHitSequences (const std::vector<KmerHit> &hits, const SequenceSet &indexed,
+	SequenceSet &result)
+{
+	std::vector<int> ids (hits.size());
+	for (size_t i = 0; i < hits.size(); i++)
+		ids[i] = hits[i].Id;
+	indexed.Extract (ids, result);
+}
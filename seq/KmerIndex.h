@@ -0,0 +1,87 @@
+/*
+ * KmerIndex
+ * In-memory inverted index from k-mers to the sequences containing them.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef KMERINDEX_H
+#define KMERINDEX_H
+
+#include <string>
+#include <vector>
+
+#include "Sequence.h"
+
+// Largest k we index; posting list offsets take 8 * 4^k bytes
+#define MAX_INDEX_K		12
+
+// Default k. The Elasticsearch index uses 5-grams, but nearly every 5-mer
+// occurs in every COI barcode, so posting lists are as long as the database.
+// With 11-mers the lists are short enough for millisecond queries over a
+// million barcodes and the ranking of close hits is the same.
+#define DEFAULT_INDEX_K	11
+
+
+struct KmerHit
+{
+	int		Id;			// index of sequence in the indexed SequenceSet
+	int		Score;		// number of distinct k-mers shared with the query
+};
+
+
+//------------------------------------------------------------------------------
+// Posting lists are stored back to back in one buffer. Each list holds the
+// ids of the sequences containing that k-mer in increasing order, as deltas
+// in "stream VByte" layout: a block of 2-bit length codes (four per byte)
+// followed by the 1-4 byte little-endian deltas. Groups of four deltas are
+// decoded with a single SSSE3 shuffle and an SSE2 prefix sum when available.
+class KmerIndex
+{
+public:
+	KmerIndex (int k = DEFAULT_INDEX_K);
+	virtual ~KmerIndex () {};
+
+	// Index all sequences in s (replaces any existing index)
+	virtual void	Build (const SequenceSet &s);
+
+	// Return up to maxHits sequences sharing the most distinct k-mers with
+	// query, best first (ties broken by id)
+	virtual void	Search (const std::string &query, int maxHits,
+						std::vector<KmerHit> &hits) const;
+
+	// Decode the posting list for a k-mer into ids
+	virtual void	GetPostings (unsigned int kmer, std::vector<unsigned int> &ids) const;
+
+	int				GetK () const { return K; };
+	int				GetNumSequences () const { return NumSequences; };
+	size_t			GetNumPostings () const;
+	size_t			GetMemoryUsage () const;
+
+protected:
+	int							K;
+	int							NumSequences;
+	unsigned int				NumLists;
+	std::vector<size_t>			Offsets;	// start of each list in Data
+	std::vector<unsigned int>	Lengths;	// number of ids in each list
+	std::vector<unsigned char>	Data;
+
+	void			distinctKmers (const std::string &s, std::vector<unsigned int> &kmers) const;
+	void			scoreList (unsigned int kmer, unsigned int *scores) const;
+};
+
+// Copy the sequences of a hit list from the indexed set, ready for profiling
+// and tree building
+void GetHitSequences (const std::vector<KmerHit> &hits, const SequenceSet &indexed,
+	SequenceSet &result);
+
+
+#endif // KMERINDEX_H
@@ -0,0 +1,171 @@
+/*
+ * LabelCodec
+ * Classify, quote and translate tree labels without per-character copies.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "LabelCodec.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+
+const unsigned char LabelCharClass[256] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	6, 0, 0, 0, 0, 0, 0, 8, 0, 0, 0, 0, 0, 0, 2, 0,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 0, 0, 0,
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 2,
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+
+//------------------------------------------------------------------------------
+bool LabelIsPlain (const char *s, size_t n, bool *hasSpaces)
+{
+	if (hasSpaces)
+		*hasSpaces = false;
+	if (n == 0 || !(LabelCharClass[(unsigned char)s[0]] & LC_LETTER))
+		return false;
+
+	bool spaces = false;
+	size_t i = 1;
+#ifdef __SSE2__
+	// Signed compares, so bytes from 0x80 up (negative) fail every range
+	const __m128i space = _mm_set1_epi8 (' ');
+	const __m128i underscore = _mm_set1_epi8 ('_');
+	const __m128i period = _mm_set1_epi8 ('.');
+	const __m128i lowerA = _mm_set1_epi8 ('a' - 1), lowerZ = _mm_set1_epi8 ('z' + 1);
+	const __m128i digit0 = _mm_set1_epi8 ('0' - 1), digit9 = _mm_set1_epi8 ('9' + 1);
+	const __m128i caseBit = _mm_set1_epi8 (0x20);
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(s + i));
+		__m128i lower = _mm_or_si128 (v, caseBit);
+		__m128i letter = _mm_and_si128 (_mm_cmpgt_epi8 (lower, lowerA), _mm_cmplt_epi8 (lower, lowerZ));
+		__m128i digit = _mm_and_si128 (_mm_cmpgt_epi8 (v, digit0), _mm_cmplt_epi8 (v, digit9));
+		__m128i isSpace = _mm_cmpeq_epi8 (v, space);
+		__m128i plain = _mm_or_si128 (_mm_or_si128 (letter, digit),
+			_mm_or_si128 (isSpace, _mm_or_si128 (_mm_cmpeq_epi8 (v, underscore), _mm_cmpeq_epi8 (v, period))));
+		if (_mm_movemask_epi8 (plain) != 0xffff)
+			return false;
+		if (_mm_movemask_epi8 (isSpace))
+			spaces = true;
+	}
+#endif
+	for (; i < n; i++)
+	{
+		unsigned char c = LabelCharClass[(unsigned char)s[i]];
+		if (!(c & LC_PLAIN))
+			return false;
+		if (c & LC_SPACE)
+			spaces = true;
+	}
+	if (hasSpaces)
+		*hasSpaces = spaces;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Quoted, copying the runs between quotes whole
+static void appendQuoted (const std::string &label, std::string &out)
+{
+	out += '\'';
+	const char *s = label.data();
+	const char *end = s + label.size();
+	for (;;)
+	{
+		const char *q = (const char *)memchr (s, '\'', end - s);
+		if (!q)
+		{
+			out.append (s, end - s);
+			break;
+		}
+		out.append (s, q - s + 1);
+		out += '\'';
+		s = q + 1;
+	}
+	out += '\'';
+}
+
+//------------------------------------------------------------------------------
+void AppendNEXUSLabel (const std::string &label, std::string &out)
+{
+	bool spaces;
+	if (LabelIsPlain (label.data(), label.size(), &spaces))
+	{
+		size_t start = out.size();
+		out += label;
+		if (spaces)
+		{
+			for (size_t i = start; i < out.size(); i++)
+				if (out[i] == ' ')
+					out[i] = '_';
+		}
+	}
+	else
+		appendQuoted (label, out);
+}
+
+//------------------------------------------------------------------------------
+void WriteNEXUSLabel (std::ostream &f, const std::string &label)
+{
+	bool spaces;
+	if (LabelIsPlain (label.data(), label.size(), &spaces) && !spaces)
+		f.write (label.data(), label.size());
+	else
+	{
+		std::string s;
+		s.reserve (label.size() + 2);
+		AppendNEXUSLabel (label, s);
+		f.write (s.data(), s.size());
+	}
+}
+
+//------------------------------------------------------------------------------
+void TranslateLabel (std::string &s, char needle, char replacement)
+{
+	if (s.empty ())
+		return;
+	char *p = &s[0];
+	size_t n = s.size();
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i from = _mm_set1_epi8 (needle);
+	const __m128i to = _mm_set1_epi8 (replacement);
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i v = _mm_loadu_si128 ((const __m128i *)(p + i));
+		__m128i hit = _mm_cmpeq_epi8 (v, from);
+		if (_mm_movemask_epi8 (hit))
+			_mm_storeu_si128 ((__m128i *)(p + i),
+				_mm_or_si128 (_mm_and_si128 (hit, to), _mm_andnot_si128 (hit, v)));
+	}
+#endif
+	for (; i < n; i++)
+		if (p[i] == needle)
+			p[i] = replacement;
+}
@@ -0,0 +1,50 @@
+/*
+ * LabelCodec
+ * Classify, quote and translate tree labels without per-character copies.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef LABELCODEC_H
+#define LABELCODEC_H
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+
+// Character classes of LabelCharClass
+#define LC_LETTER	1	// A-Z, a-z
+#define LC_PLAIN	2	// may follow the first character of an unquoted label:
+						// letters, digits, space, underscore and period
+#define LC_SPACE	4
+#define LC_QUOTE	8
+
+extern const unsigned char LabelCharClass[256];
+
+// True if the label can be written without quotes: it starts with a letter
+// and the rest is LC_PLAIN. If hasSpaces is not NULL it is set to whether
+// the label has spaces (which are written as underscores). With SSE2, 16
+// characters are classified at a time.
+bool LabelIsPlain (const char *s, size_t n, bool *hasSpaces = NULL);
+
+// Append label to out, or write it to f, as NEXUSString formats it: plain
+// labels with spaces made underscores, anything else in single quotes with
+// quotes doubled. WriteNEXUSLabel writes plain labels without spaces (the
+// usual case) straight from label, with no temporary string.
+void AppendNEXUSLabel (const std::string &label, std::string &out);
+void WriteNEXUSLabel (std::ostream &f, const std::string &label);
+
+// Replace every needle in s with replacement, in place
+void TranslateLabel (std::string &s, char needle, char replacement);
+
+
+#endif // LABELCODEC_H
@@ -0,0 +1,141 @@
+/*
+ * LabelParser
+ * Split leaf labels such as "MRMSR00510_Squamata_sp._BOLDAAL6056" into
+ * process ID, taxon and BIN.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "LabelParser.h"
+
+
+//------------------------------------------------------------------------------
+LabelParser::LabelParser ()
+{
+	Separators = "_ |";
+	ProcessIDFirst = true;
+	BINPrefix = "BOLD";
+	TaxonWords = 0;
+}
+
+//------------------------------------------------------------------------------
+void LabelParser::ParseLabel (const std::string &label, LabelFields &fields) const
+{
+	fields.ProcessID.clear ();
+	fields.Taxon.clear ();
+	fields.BIN.clear ();
+
+	// Word boundaries
+	std::vector<std::pair<size_t, size_t> > words;
+	size_t i = 0, n = label.size();
+	while (i < n)
+	{
+		while (i < n && Separators.find (label[i]) != std::string::npos)
+			i++;
+		size_t start = i;
+		while (i < n && Separators.find (label[i]) == std::string::npos)
+			i++;
+		if (i > start)
+			words.push_back (std::make_pair (start, i - start));
+	}
+
+	size_t first = 0, last = words.size();
+	if (ProcessIDFirst && first < last)
+	{
+		fields.ProcessID = label.substr (words[0].first, words[0].second);
+		first++;
+	}
+	if (!BINPrefix.empty () && first < last
+		&& words[last - 1].second > BINPrefix.size()
+		&& label.compare (words[last - 1].first, BINPrefix.size(), BINPrefix) == 0)
+	{
+		size_t start = words[last - 1].first + BINPrefix.size();
+		size_t length = words[last - 1].second - BINPrefix.size();
+		if (label[start] == ':')
+		{
+			start++;
+			length--;
+		}
+		fields.BIN = BINPrefix + ":" + label.substr (start, length);
+		last--;
+	}
+	if (TaxonWords > 0 && last - first > (size_t)TaxonWords)
+		last = first + TaxonWords;
+	for (size_t w = first; w < last; w++)
+	{
+		if (w > first)
+			fields.Taxon += ' ';
+		fields.Taxon.append (label, words[w].first, words[w].second);
+	}
+}
+
+//------------------------------------------------------------------------------
+int LabelParser::intern (const std::string &name, std::unordered_map<std::string, int> &index,
+	std::vector<std::string> &names)
+{
+	if (name.empty ())
+		return -1;
+	std::pair<std::unordered_map<std::string, int>::iterator, bool> r
+		= index.insert (std::make_pair (name, (int)names.size()));
+	if (r.second)
+		names.push_back (name);
+	return r.first->second;
+}
+
+//------------------------------------------------------------------------------
+bool LabelParser::Parse (Tree &t)
+{
+	ProcessIDs.clear ();
+	Taxa.clear ();
+	BINs.clear ();
+	TaxonNames.clear ();
+	BINNames.clear ();
+	TaxonIndex.clear ();
+	BINIndex.clear ();
+
+	std::vector<NodePtr> leaves;
+	std::vector<NodePtr> stack;
+	if (t.GetRoot ())
+		stack.push_back (t.GetRoot ());
+	while (!stack.empty ())
+	{
+		NodePtr p = stack.back ();
+		stack.pop_back ();
+		if (p->GetChild () == NULL)
+			leaves.push_back (p);
+		for (NodePtr q = p->GetChild (); q; q = q->GetSibling ())
+			stack.push_back (q);
+	}
+
+	// Leaves in leaf number order, so taxa and BINs are numbered in that order
+	int n = (int)leaves.size();
+	std::vector<NodePtr> byIndex (n, (NodePtr)NULL);
+	for (int i = 0; i < n; i++)
+	{
+		int leaf = leaves[i]->GetLeafNumber () - 1;
+		if (leaf < 0 || leaf >= n || byIndex[leaf])
+			return false;
+		byIndex[leaf] = leaves[i];
+	}
+
+	ProcessIDs.resize (n);
+	Taxa.resize (n);
+	BINs.resize (n);
+	LabelFields fields;
+	for (int i = 0; i < n; i++)
+	{
+		ParseLabel (byIndex[i]->GetLabel (), fields);
+		ProcessIDs[i] = fields.ProcessID;
+		Taxa[i] = intern (fields.Taxon, TaxonIndex, TaxonNames);
+		BINs[i] = intern (fields.BIN, BINIndex, BINNames);
+	}
+	return true;
+}
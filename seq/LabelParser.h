@@ -0,0 +1,91 @@
+/*
+ * LabelParser
+ * Split leaf labels such as "MRMSR00510_Squamata_sp._BOLDAAL6056" into
+ * process ID, taxon and BIN.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef LABELPARSER_H
+#define LABELPARSER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+struct LabelFields
+{
+	std::string	ProcessID;
+	std::string	Taxon;		// words joined by spaces
+	std::string	BIN;		// "BOLD:AAL6056", empty if none
+};
+
+
+//------------------------------------------------------------------------------
+// Labels are split into words at any of the separator characters. dist.php
+// writes the process ID (without its dashes), then the species field with
+// spaces made underscores and colons removed, so by default the first word
+// is the process ID, a last word starting with "BOLD" is the BIN (the colon
+// is put back), and the words in between are the taxon. FASTA titles such as
+// "MRMSR005-10|Squamata sp. BOLD:AAL6056" parse the same way.
+//
+// Parse () fills per-leaf columns indexed by GetLeafNumber () - 1, with taxa
+// and BINs numbered (first come, first numbered) so they can be used as
+// groups by MonophylyReport and TreeClusters::Compare.
+class LabelParser
+{
+public:
+	LabelParser ();
+	virtual ~LabelParser () {};
+
+	virtual void	SetSeparators (const std::string &s) { Separators = s; };
+	virtual void	SetProcessIDFirst (bool on) { ProcessIDFirst = on; };
+	virtual void	SetBINPrefix (const std::string &s) { BINPrefix = s; };
+	// Keep only the first n words of the taxon (2 = genus and species), 0 = all
+	virtual void	SetTaxonWords (int n) { TaxonWords = n; };
+
+	virtual void	ParseLabel (const std::string &label, LabelFields &fields) const;
+
+	// Returns false if t's leaf numbers are not 1 .. leaves
+	virtual bool	Parse (Tree &t);
+
+	int				GetNumLeaves () const { return (int)ProcessIDs.size(); };
+	const std::string &GetProcessID (int leaf) const { return ProcessIDs[leaf]; };
+	int				GetTaxon (int leaf) const { return Taxa[leaf]; };	// -1 if none
+	int				GetBIN (int leaf) const { return BINs[leaf]; };
+	const std::vector<int> &GetTaxonColumn () const { return Taxa; };
+	const std::vector<int> &GetBINColumn () const { return BINs; };
+	const std::vector<std::string> &GetTaxonNames () const { return TaxonNames; };
+	const std::vector<std::string> &GetBINNames () const { return BINNames; };
+
+protected:
+	std::string					Separators;
+	bool						ProcessIDFirst;
+	std::string					BINPrefix;
+	int							TaxonWords;
+
+	std::vector<std::string>	ProcessIDs;
+	std::vector<int>			Taxa;
+	std::vector<int>			BINs;
+	std::vector<std::string>	TaxonNames;
+	std::vector<std::string>	BINNames;
+	std::unordered_map<std::string, int> TaxonIndex;
+	std::unordered_map<std::string, int> BINIndex;
+
+	int				intern (const std::string &name, std::unordered_map<std::string, int> &index,
+						std::vector<std::string> &names);
+};
+
+
+#endif // LABELPARSER_H
@@ -0,0 +1,278 @@
+/*
+ * MinHash
+ * Bottom-k MinHash sketches and Mash distances for large hit lists.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "MinHash.h"
+#include "HashMix.h"
+#include "TileScheduler.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+//------------------------------------------------------------------------------
+// Seed and k-mer mixed together, keeping the high 32 bits
+static inline unsigned int hashKmer (unsigned int kmer, unsigned int seed)
+{
+	return (unsigned int)(HashMix (((unsigned long long)seed << 32) ^ kmer) >> 32);
+}
+
+
+//------------------------------------------------------------------------------
+MinHashSketches::MinHashSketches (int k, int sketchSize, unsigned int seed)
+{
+	if (k < 1) k = 1;
+	if (k > MAX_KMER_LENGTH) k = MAX_KMER_LENGTH;
+	if (sketchSize < 1) sketchSize = 1;
+	K = k;
+	SketchSize = sketchSize;
+	Seed = seed;
+}
+
+//------------------------------------------------------------------------------
+void MinHashSketches::Build (const SequenceSet &s)
+{
+	int n = s.GetNumSequences ();
+	TREELIB_TRACE_SCOPE (trace, "MinHashSketches::Build");
+	TREELIB_TRACE_ARG (trace, "sequences", n);
+	Hashes.assign ((size_t)n * SketchSize, 0);
+	TREELIB_TRACE_ALLOC (Hashes.size() * sizeof (Hashes[0]));
+	Sizes.assign (n, 0);
+	Labels.resize (n);
+
+	std::vector<unsigned int> h;
+	for (int i = 0; i < n; i++)
+	{
+		const std::string &seq = s.GetSequence (i);
+		h.clear ();
+		KmerIterator it (seq.c_str(), (int)seq.size(), K);
+		unsigned int code;
+		while (it.Next (code))
+			h.push_back (hashKmer (code, Seed));
+		std::sort (h.begin(), h.end());
+		h.erase (std::unique (h.begin(), h.end()), h.end());
+
+		int m = (int)h.size() < SketchSize ? (int)h.size() : SketchSize;
+		std::copy (h.begin(), h.begin() + m, Hashes.begin() + (size_t)i * SketchSize);
+		Sizes[i] = m;
+		Labels[i] = s.GetLabel (i);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Merge the two sorted sketches until the bottom SketchSize hashes of the
+// union have been seen, counting those shared by both.
+double MinHashSketches::Jaccard (int i, int j) const
+{
+	const unsigned int *a = &Hashes[(size_t)i * SketchSize];
+	const unsigned int *b = &Hashes[(size_t)j * SketchSize];
+	int na = Sizes[i];
+	int nb = Sizes[j];
+	int ia = 0, ib = 0, common = 0, total = 0;
+
+	// Branch-free merge step: the comparisons are unpredictable, so
+	// advancing by the comparison results is much faster than if/else
+	while (total < SketchSize && ia < na && ib < nb)
+	{
+		unsigned int x = a[ia];
+		unsigned int y = b[ib];
+		common += (x == y);
+		ia += (x <= y);
+		ib += (y <= x);
+		total++;
+	}
+	if (total < SketchSize)
+	{
+		int rest = (na - ia) + (nb - ib);
+		total += (rest < SketchSize - total) ? rest : SketchSize - total;
+	}
+	return (total == 0) ? 0.0 : (double)common / total;
+}
+
+//------------------------------------------------------------------------------
+double MinHashSketches::Distance (int i, int j) const
+{
+	if (i == j)
+		return 0.0;
+	double J = Jaccard (i, j);
+	if (J <= 0.0)
+		return 1.0;
+	double d = -std::log (2.0 * J / (1.0 + J)) / K;
+	return (d < 1.0) ? d : 1.0;
+}
+
+//------------------------------------------------------------------------------
+void MinHashSketches::Distances (DistanceMatrix &D, int threads) const
+{
+	int n = GetNumSketches ();
+	TREELIB_TRACE_SCOPE (trace, "MinHashSketches::Distances");
+	TREELIB_TRACE_ARG (trace, "pairs", (long long)n * (n - 1) / 2);
+	if (!D.IsMapped () || D.GetSize () != n)
+		D.SetSize (n);
+	for (int i = 0; i < n; i++)
+		D.SetLabel (i, Labels[i]);
+
+	int b = TileSizeForCache ((size_t)SketchSize * sizeof (unsigned int));
+	ForEachTile (n, b, [this, &D](const Tile &t)
+	{
+		for (int i = t.RowBegin; i < t.RowEnd; i++)
+		{
+			float *row = D.GetRow (i);
+			int end = (t.ColEnd < i) ? t.ColEnd : i;
+			for (int j = t.ColBegin; j < end; j++)
+				row[j] = (float)Distance (i, j);
+		}
+	}, threads);
+}
+
+
+//------------------------------------------------------------------------------
+static double pearson (const std::vector<double> &x, const std::vector<double> &y)
+{
+	size_t n = x.size();
+	if (n < 2)
+		return 0.0;
+	double mx = 0.0, my = 0.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		mx += x[i];
+		my += y[i];
+	}
+	mx /= n;
+	my /= n;
+	double sxy = 0.0, sxx = 0.0, syy = 0.0;
+	for (size_t i = 0; i < n; i++)
+	{
+		sxy += (x[i] - mx) * (y[i] - my);
+		sxx += (x[i] - mx) * (x[i] - mx);
+		syy += (y[i] - my) * (y[i] - my);
+	}
+	return (sxx > 0.0 && syy > 0.0) ? sxy / std::sqrt (sxx * syy) : 0.0;
+}
+
+//------------------------------------------------------------------------------
+// Ranks with ties given their average rank
+static void ranks (const std::vector<double> &x, std::vector<double> &r)
+{
+	size_t n = x.size();
+	std::vector<size_t> order (n);
+	for (size_t i = 0; i < n; i++)
+		order[i] = i;
+	std::sort (order.begin(), order.end(),
+		[&x](size_t a, size_t b) { return x[a] < x[b]; });
+	r.resize (n);
+	size_t i = 0;
+	while (i < n)
+	{
+		size_t j = i;
+		while (j + 1 < n && x[order[j + 1]] == x[order[i]])
+			j++;
+		double rank = 0.5 * (i + j);
+		for (size_t k = i; k <= j; k++)
+			r[order[k]] = rank;
+		i = j + 1;
+	}
+}
+
+//------------------------------------------------------------------------------
+SketchAccuracy CompareSketchDistances (const MinHashSketches &sketches,
+	const KTupleProfiles &profiles, int maxPairs, unsigned int seed)
+{
+	SketchAccuracy a;
+	a.Pairs = 0;
+	a.Pearson = a.Spearman = a.NearestNeighbour = 0.0;
+
+	int n = sketches.GetNumSketches ();
+	if (n < 2 || profiles.GetNumProfiles() != n)
+		return a;
+
+	std::vector<double> exact, approx;
+	std::mt19937 rng (seed);
+	double allPairs = 0.5 * (double)n * (n - 1);
+	if (allPairs <= maxPairs)
+	{
+		for (int i = 1; i < n; i++)
+			for (int j = 0; j < i; j++)
+			{
+				exact.push_back (profiles.Distance (i, j));
+				approx.push_back (sketches.Distance (i, j));
+			}
+	}
+	else
+	{
+		std::uniform_int_distribution<int> pick (0, n - 1);
+		while ((int)exact.size() < maxPairs)
+		{
+			int i = pick (rng);
+			int j = pick (rng);
+			if (i == j)
+				continue;
+			exact.push_back (profiles.Distance (i, j));
+			approx.push_back (sketches.Distance (i, j));
+		}
+	}
+	a.Pairs = (int)exact.size();
+	a.Pearson = pearson (exact, approx);
+
+	std::vector<double> re, ra;
+	ranks (exact, re);
+	ranks (approx, ra);
+	a.Spearman = pearson (re, ra);
+
+	// Nearest neighbour agreement on up to 100 rows; a row agrees if the
+	// sketch's nearest neighbour is also (one of) the exact nearest
+	int rows = n < 100 ? n : 100;
+	std::vector<int> sample (n);
+	for (int i = 0; i < n; i++)
+		sample[i] = i;
+	std::shuffle (sample.begin(), sample.end(), rng);
+	int agree = 0;
+	for (int r = 0; r < rows; r++)
+	{
+		int i = sample[r];
+		double bestExact = 0.0, bestApprox = 0.0, exactOfApprox = 0.0;
+		bool first = true;
+		for (int j = 0; j < n; j++)
+		{
+			if (j == i)
+				continue;
+			double e = profiles.Distance (i, j);
+			double s = sketches.Distance (i, j);
+			if (first || e < bestExact)
+				bestExact = e;
+			if (first || s < bestApprox)
+			{
+				bestApprox = s;
+				exactOfApprox = e;
+			}
+			first = false;
+		}
+		if (exactOfApprox <= bestExact)
+			agree++;
+	}
+	a.NearestNeighbour = (double)agree / rows;
+	return a;
+}
+
+//------------------------------------------------------------------------------
+void WriteSketchAccuracy (std::ostream &f, const SketchAccuracy &a)
+{
+	f << "Sketch accuracy against exact k-tuple distance" << std::endl;
+	f << "             Pairs: " << a.Pairs << std::endl;
+	f << "         Pearson r: " << a.Pearson << std::endl;
+	f << "      Spearman rho: " << a.Spearman << std::endl;
+	f << " Nearest neighbour: " << a.NearestNeighbour << std::endl;
+}
@@ -0,0 +1,80 @@
+/*
+ * MinHash
+ * Bottom-k MinHash sketches and Mash distances for large hit lists.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Sequence.h"
+#include "DistanceMatrix.h"
+#include "KTuple.h"
+
+
+//------------------------------------------------------------------------------
+// Each sequence is reduced to the SketchSize smallest distinct 32-bit hashes
+// of its k-mers. The Jaccard index of two k-mer sets is estimated from the
+// bottom-k of the union of their sketches, and converted to the Mash distance
+// D = -1/k ln (2J / (1 + J)) (Ondov et al. 2016). Comparing two sketches is a
+// single O(SketchSize) merge, independent of 4^k.
+class MinHashSketches
+{
+public:
+	MinHashSketches (int k = 16, int sketchSize = 256, unsigned int seed = 42);
+	virtual ~MinHashSketches () {};
+
+	virtual void	Build (const SequenceSet &s);
+
+	// Tiled and threaded as KTupleProfiles::Distances
+	virtual void	Distances (DistanceMatrix &D, int threads = 0) const;
+	virtual double	Distance (int i, int j) const;
+	virtual double	Jaccard (int i, int j) const;
+
+	int				GetK () const { return K; };
+	int				GetSketchSize () const { return SketchSize; };
+	int				GetNumSketches () const { return (int)Sizes.size(); };
+	const std::string &GetLabel (int i) const { return Labels[i]; };
+	size_t			GetMemoryUsage () const { return Hashes.size() * sizeof (unsigned int); };
+
+protected:
+	int							K;
+	int							SketchSize;
+	unsigned int				Seed;
+	std::vector<unsigned int>	Hashes;		// SketchSize slots per sequence, sorted
+	std::vector<int>			Sizes;		// slots used (short sequences)
+	std::vector<std::string>	Labels;
+};
+
+
+//------------------------------------------------------------------------------
+// How well sketch distances track the exact k-tuple distance, over all pairs
+// (or a random sample of maxPairs pairs for large sets).
+struct SketchAccuracy
+{
+	int		Pairs;
+	double	Pearson;			// linear correlation
+	double	Spearman;			// rank correlation
+	double	NearestNeighbour;	// fraction of sampled rows with the same nearest neighbour
+};
+
+SketchAccuracy CompareSketchDistances (const MinHashSketches &sketches,
+	const KTupleProfiles &profiles, int maxPairs = 100000, unsigned int seed = 1);
+
+void WriteSketchAccuracy (std::ostream &f, const SketchAccuracy &a);
+
+
+#endif // MINHASH_H
@@ -0,0 +1,130 @@
+/*
+ * Monophyly
+ * Which taxa (or BINs) form clades in a tree.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Monophyly.h"
+
+#include <algorithm>
+
+
+//------------------------------------------------------------------------------
+bool MonophylyReport::Compute (Tree &t, const std::vector<int> &groups, const std::vector<std::string> &names)
+{
+	Names = names;
+	Results.clear ();
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return false;
+
+	// Preorder with parents and the end of each subtree
+	std::vector<NodePtr> nodes;
+	std::vector<int> parent;
+	t.GetPreorder (nodes, parent);
+
+	int n = (int)nodes.size();
+	std::vector<int> size (n, 1), leaves (n, 0);
+	for (int i = n - 1; i >= 0; i--)
+	{
+		if (nodes[i]->GetChild () == NULL)
+			leaves[i] = 1;
+		if (parent[i] >= 0)
+		{
+			size[parent[i]] += size[i];
+			leaves[parent[i]] += leaves[i];
+		}
+	}
+	if ((int)groups.size() != leaves[0])
+		return false;
+
+	// Each group's first and last leaf in preorder
+	int numGroups = (int)names.size();
+	for (size_t i = 0; i < groups.size(); i++)
+		if (groups[i] >= numGroups)
+			numGroups = groups[i] + 1;
+	std::vector<int> first (numGroups, -1), last (numGroups, -1);
+	std::vector<int> group (n, -1);
+	std::vector<char> seen (groups.size(), 0);
+	Results.resize (numGroups);
+	for (int g = 0; g < numGroups; g++)
+	{
+		Results[g].Leaves = Results[g].CladeLeaves = 0;
+		Results[g].Ancestor = NULL;
+	}
+	for (int i = 0; i < n; i++)
+		if (nodes[i]->GetChild () == NULL)
+		{
+			int leaf = nodes[i]->GetLeafNumber () - 1;
+			if (leaf < 0 || leaf >= (int)groups.size() || seen[leaf])
+			{
+				Results.clear ();
+				return false;
+			}
+			seen[leaf] = 1;
+			int g = groups[leaf];
+			if (g < 0)
+				continue;
+			group[i] = g;
+			if (first[g] < 0)
+				first[g] = i;
+			last[g] = i;
+			Results[g].Leaves++;
+		}
+
+	// Path from the root to the current node; nodes on it are in increasing
+	// preorder, and those at or before a group's first leaf are its ancestors
+	std::vector<int> path;
+	for (int i = 0; i < n; i++)
+	{
+		while (!path.empty () && path.back () + size[path.back ()] <= i)
+			path.pop_back ();
+		int g = group[i];
+		if (g >= 0 && last[g] == i)
+		{
+			int a = i;
+			if (first[g] != i)
+				a = *(std::upper_bound (path.begin(), path.end(), first[g]) - 1);
+			Results[g].Ancestor = nodes[a];
+			Results[g].CladeLeaves = leaves[a];
+		}
+		path.push_back (i);
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+int MonophylyReport::GetNumMonophyletic () const
+{
+	int count = 0;
+	for (size_t g = 0; g < Results.size(); g++)
+		if (Results[g].IsMonophyletic ())
+			count++;
+	return count;
+}
+
+//------------------------------------------------------------------------------
+void MonophylyReport::WriteReport (std::ostream &f) const
+{
+	int groups = 0;
+	for (size_t g = 0; g < Results.size(); g++)
+	{
+		if (Results[g].Leaves == 0)
+			continue;
+		groups++;
+		f << ((g < Names.size()) ? Names[g] : std::string ("?"))
+			<< '\t' << Results[g].Leaves
+			<< '\t' << Results[g].CladeLeaves
+			<< '\t' << (Results[g].IsMonophyletic () ? "yes" : "no") << std::endl;
+	}
+	f << GetNumMonophyletic () << " of " << groups << " groups monophyletic" << std::endl;
+}
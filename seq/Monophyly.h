@@ -0,0 +1,73 @@
+/*
+ * Monophyly
+ * Which taxa (or BINs) form clades in a tree.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef MONOPHYLY_H
+#define MONOPHYLY_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+struct MonophylyResult
+{
+	int		Leaves;			// leaves in the group
+	int		CladeLeaves;	// leaves below the group's most recent common ancestor
+	NodePtr	Ancestor;		// most recent common ancestor, NULL if the group has no leaves
+
+	bool	IsMonophyletic () const { return Leaves > 0 && Leaves == CladeLeaves; };
+};
+
+
+//------------------------------------------------------------------------------
+// A group is monophyletic if the clade below its most recent common ancestor
+// has no other leaves. In preorder the group's ancestor is the ancestor of
+// its first leaf and its last leaf, so one preorder pass keeping the path to
+// the current node on a stack finds every group's ancestor when it meets the
+// group's last leaf, as the deepest node on the path at or before the first
+// leaf (a binary search). Leaf counts come from one reverse pass, so the
+// whole report is linear in the size of the tree plus the number of groups.
+//
+// Monophyly is with respect to the tree's root, so unrooted trees such as NJ
+// trees should be rooted (e.g. on an outgroup) first.
+class MonophylyReport
+{
+public:
+	MonophylyReport () {};
+	virtual ~MonophylyReport () {};
+
+	// groups gives each leaf's group by leaf index (GetLeafNumber () - 1),
+	// -1 for none, such as LabelParser::GetTaxonColumn (); names are the
+	// groups' names. Returns false if t's leaf numbers are not 1 .. leaves or
+	// groups is the wrong size.
+	virtual bool	Compute (Tree &t, const std::vector<int> &groups, const std::vector<std::string> &names);
+
+	int				GetNumGroups () const { return (int)Results.size(); };
+	const MonophylyResult &GetResult (int g) const { return Results[g]; };
+	int				GetNumMonophyletic () const;
+
+	// Tab-separated line per group with leaves: name, leaves, clade leaves,
+	// "yes" or "no"; then a summary line
+	virtual void	WriteReport (std::ostream &f) const;
+
+protected:
+	std::vector<std::string>		Names;
+	std::vector<MonophylyResult>	Results;
+};
+
+
+#endif // MONOPHYLY_H
@@ -0,0 +1,191 @@
+/*
+ * PDIndex
+ * Phylogenetic diversity of arbitrary sets of leaves.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "PDIndex.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+
+//------------------------------------------------------------------------------
+bool PDIndex::Build (Tree &t)
+{
+	LeafNode.clear ();
+	Depth.clear ();
+	Level.clear ();
+	First.clear ();
+	Tour.clear ();
+	Table.clear ();
+	Log2.clear ();
+	LeafIndex.clear ();
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return false;
+
+	// Preorder with depths; parents come before children
+	std::vector<NodePtr> nodes;
+	std::vector<int> parent;
+	t.GetPreorder (nodes, parent);
+	int n = (int)nodes.size();
+	Depth.assign (n, 0.0);
+	Level.assign (n, 0);
+	for (int i = 1; i < n; i++)
+	{
+		float length = nodes[i]->GetEdgeLength ();
+		Depth[i] = Depth[parent[i]] + (length > 0.0f ? length : 0.0);
+		Level[i] = Level[parent[i]] + 1;
+	}
+
+	std::vector<int> end (n);
+	for (int i = n - 1; i >= 0; i--)
+		end[i] = i + 1;
+	for (int i = n - 1; i > 0; i--)
+		if (end[i] > end[parent[i]])
+			end[parent[i]] = end[i];
+
+	int leaves = 0;
+	for (int i = 0; i < n; i++)
+		if (nodes[i]->GetChild () == NULL)
+			leaves++;
+	LeafNode.assign (leaves, -1);
+	for (int i = 0; i < n; i++)
+		if (nodes[i]->GetChild () == NULL)
+		{
+			int leaf = nodes[i]->GetLeafNumber () - 1;
+			if (leaf < 0 || leaf >= leaves || LeafNode[leaf] >= 0)
+			{
+				LeafNode.clear ();
+				return false;
+			}
+			LeafNode[leaf] = i;
+			LeafIndex[nodes[i]->GetLabel ()] = leaf;
+		}
+
+	// Euler tour: each node when it is entered, and its parent again each
+	// time one of its children is finished
+	First.assign (n, 0);
+	Tour.reserve (2 * n - 1);
+	std::vector<int> path;
+	for (int i = 0; i < n; i++)
+	{
+		while (!path.empty () && end[path.back ()] <= i)
+		{
+			path.pop_back ();
+			Tour.push_back (path.back ());
+		}
+		First[i] = (int)Tour.size();
+		Tour.push_back (i);
+		path.push_back (i);
+	}
+	while (path.size() > 1)
+	{
+		path.pop_back ();
+		Tour.push_back (path.back ());
+	}
+
+	// Sparse table: row j holds the shallowest node in Tour[i .. i + 2^j)
+	int m = (int)Tour.size();
+	Log2.assign (m + 1, 0);
+	for (int i = 2; i <= m; i++)
+		Log2[i] = Log2[i / 2] + 1;
+	int rows = Log2[m] + 1;
+	Table.resize ((size_t)rows * m);
+	std::copy (Tour.begin(), Tour.end(), Table.begin());
+	for (int j = 1; j < rows; j++)
+	{
+		const int *prev = &Table[(size_t)(j - 1) * m];
+		int *row = &Table[(size_t)j * m];
+		int half = 1 << (j - 1);
+		for (int i = 0; i + 2 * half <= m; i++)
+		{
+			int a = prev[i], b = prev[i + half];
+			row[i] = (Level[a] <= Level[b]) ? a : b;
+		}
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+int PDIndex::GetLeafIndex (const std::string &label) const
+{
+	std::unordered_map<std::string, int>::const_iterator it = LeafIndex.find (label);
+	return (it == LeafIndex.end ()) ? -1 : it->second;
+}
+
+//------------------------------------------------------------------------------
+int PDIndex::LCA (int a, int b) const
+{
+	int i = First[a], j = First[b];
+	if (i > j)
+		std::swap (i, j);
+	int m = (int)Tour.size();
+	int k = Log2[j - i + 1];
+	int x = Table[(size_t)k * m + i];
+	int y = Table[(size_t)k * m + j - (1 << k) + 1];
+	return (Level[x] <= Level[y]) ? x : y;
+}
+
+//------------------------------------------------------------------------------
+double PDIndex::PD (const std::vector<int> &leaves, bool includeRoot) const
+{
+	// Leaves' nodes in preorder, which is the order of their first (and only)
+	// appearance in the tour
+	std::vector<int> v;
+	v.reserve (leaves.size());
+	for (size_t i = 0; i < leaves.size(); i++)
+		if (leaves[i] >= 0 && leaves[i] < (int)LeafNode.size())
+			v.push_back (LeafNode[leaves[i]]);
+	if (v.empty ())
+		return 0.0;
+	std::sort (v.begin(), v.end());
+	v.erase (std::unique (v.begin(), v.end()), v.end());
+
+	double pd = Depth[v[0]];
+	int top = v[0];
+	for (size_t i = 1; i < v.size(); i++)
+	{
+		int a = LCA (v[i - 1], v[i]);
+		pd += Depth[v[i]] - Depth[a];
+		if (Level[a] < Level[top])
+			top = a;
+	}
+	if (!includeRoot)
+		pd -= Depth[top];
+	return pd;
+}
+
+//------------------------------------------------------------------------------
+void PDIndex::PD (const std::vector<std::vector<int> > &sets, std::vector<double> &pd,
+	bool includeRoot, int threads) const
+{
+	pd.assign (sets.size(), 0.0);
+	ParallelFor ((int)sets.size(), [&](int i, int) { pd[i] = PD (sets[i], includeRoot); }, threads);
+}
+
+
+//------------------------------------------------------------------------------
+void LeavesInBox (const std::vector<float> &longitude, const std::vector<float> &latitude,
+	const BoundingBox &box, std::vector<int> &leaves)
+{
+	leaves.clear ();
+	size_t n = std::min (longitude.size(), latitude.size());
+	for (size_t i = 0; i < n; i++)
+	{
+		// Comparisons with NaN are false, so unknown points are left out
+		if (longitude[i] >= box.MinLongitude && longitude[i] <= box.MaxLongitude
+			&& latitude[i] >= box.MinLatitude && latitude[i] <= box.MaxLatitude)
+			leaves.push_back ((int)i);
+	}
+}
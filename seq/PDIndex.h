@@ -0,0 +1,90 @@
+/*
+ * PDIndex
+ * Phylogenetic diversity of arbitrary sets of leaves.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef PDINDEX_H
+#define PDINDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+//------------------------------------------------------------------------------
+// Faith's PD of a set of leaves is the total length of the edges connecting
+// them. Sorted by their position in an Euler tour of the tree, consecutive
+// leaves a, b add the path from b up to lca(a, b), so with the path length
+// from the root to every node and constant time LCA queries (a sparse table
+// over the tour) the PD of k leaves takes O(k log k), for the sort, however
+// big the tree is.
+//
+// Leaves are identified by index, GetLeafNumber () - 1. Negative edge lengths
+// (as NJ can give) count as zero.
+class PDIndex
+{
+public:
+	PDIndex () {};
+	virtual ~PDIndex () {};
+
+	// Returns false if t is empty or its leaf numbers are not 1 .. leaves
+	virtual bool	Build (Tree &t);
+
+	int				GetNumLeaves () const { return (int)LeafNode.size(); };
+	int				GetLeafIndex (const std::string &label) const;	// -1 if not found
+
+	// PD of the leaves (duplicates and indices out of range are ignored). With
+	// includeRoot the path from the root to the leaves' common ancestor is
+	// included (the usual definition for rooted trees); without it the
+	// result is the length of the subtree spanning the leaves.
+	virtual double	PD (const std::vector<int> &leaves, bool includeRoot = true) const;
+
+	// PD of many sets in parallel
+	virtual void	PD (const std::vector<std::vector<int> > &sets, std::vector<double> &pd,
+						bool includeRoot = true, int threads = 0) const;
+
+	// Lowest common ancestor of two nodes by preorder number
+	int				LCA (int a, int b) const;
+
+protected:
+	std::vector<int>		LeafNode;	// preorder number of each leaf
+	std::vector<double>		Depth;		// path length from the root, by preorder number
+	std::vector<int>		Level;		// edges from the root
+	std::vector<int>		First;		// first position of each node in the tour
+	std::vector<int>		Tour;		// Euler tour, 2 * nodes - 1 long
+	std::vector<int>		Table;		// sparse table, log levels of Tour.size() entries
+	std::vector<unsigned char> Log2;	// floor (log2 (i)) for 1 .. Tour.size()
+	std::unordered_map<std::string, int> LeafIndex;
+};
+
+
+//------------------------------------------------------------------------------
+// A latitude and longitude box, such as a province from
+// IDN_province_bbox.geojson
+struct BoundingBox
+{
+	double	MinLongitude;
+	double	MinLatitude;
+	double	MaxLongitude;
+	double	MaxLatitude;
+};
+
+// Indices of the points (by leaf index, NaN if unknown) inside box, to use as
+// a set for PDIndex::PD
+void LeavesInBox (const std::vector<float> &longitude, const std::vector<float> &latitude,
+	const BoundingBox &box, std::vector<int> &leaves);
+
+
+#endif // PDINDEX_H
@@ -0,0 +1,475 @@
+/*
+ * SearchHits
+ * Stream sequences out of Elasticsearch search responses.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "SearchHits.h"
+#include "Trace.h"
+
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+
+//------------------------------------------------------------------------------
+int JSONScanner::peek ()
+{
+	if (Pos == End)
+	{
+		Offset += End;
+		Pos = End = 0;
+		if (In && In->good ())
+		{
+			In->read (Buffer, sizeof (Buffer));
+			End = (size_t)In->gcount ();
+		}
+		if (End == 0)
+			return -1;
+	}
+	return (unsigned char)Buffer[Pos];
+}
+
+//------------------------------------------------------------------------------
+int JSONScanner::skipSpace ()
+{
+	int c;
+	while ((c = peek ()) == ' ' || c == '\t' || c == '\n' || c == '\r')
+		Pos++;
+	return c;
+}
+
+//------------------------------------------------------------------------------
+static void appendUTF8 (unsigned int u, std::string &s)
+{
+	if (u < 0x80)
+		s += (char)u;
+	else if (u < 0x800)
+	{
+		s += (char)(0xc0 | (u >> 6));
+		s += (char)(0x80 | (u & 0x3f));
+	}
+	else if (u < 0x10000)
+	{
+		s += (char)(0xe0 | (u >> 12));
+		s += (char)(0x80 | ((u >> 6) & 0x3f));
+		s += (char)(0x80 | (u & 0x3f));
+	}
+	else
+	{
+		s += (char)(0xf0 | (u >> 18));
+		s += (char)(0x80 | ((u >> 12) & 0x3f));
+		s += (char)(0x80 | ((u >> 6) & 0x3f));
+		s += (char)(0x80 | (u & 0x3f));
+	}
+}
+
+//------------------------------------------------------------------------------
+// After the opening quote. Runs of plain characters are copied (or skipped)
+// a block at a time; s is NULL to skip the string.
+bool JSONScanner::readString (std::string *s)
+{
+	if (s)
+		s->clear ();
+	for (;;)
+	{
+		if (peek () < 0)
+			return false;
+		const char *p = Buffer + Pos;
+		const char *end = Buffer + End;
+		const char *q = p;
+		while (q < end && *q != '"' && *q != '\\')
+			q++;
+		if (s)
+			s->append (p, q - p);
+		Pos += q - p;
+		if (q == end)
+			continue;
+
+		Pos++;
+		if (*q == '"')
+			return true;
+
+		// Escape
+		int c = get ();
+		unsigned int u;
+		switch (c)
+		{
+			case '"': case '\\': case '/':	u = (unsigned int)c; break;
+			case 'b':	u = '\b'; break;
+			case 'f':	u = '\f'; break;
+			case 'n':	u = '\n'; break;
+			case 'r':	u = '\r'; break;
+			case 't':	u = '\t'; break;
+			case 'u':
+				{
+					u = 0;
+					for (int i = 0; i < 4; i++)
+					{
+						int h = get ();
+						if (h >= '0' && h <= '9')		u = (u << 4) | (h - '0');
+						else if (h >= 'a' && h <= 'f')	u = (u << 4) | (h - 'a' + 10);
+						else if (h >= 'A' && h <= 'F')	u = (u << 4) | (h - 'A' + 10);
+						else return false;
+					}
+					// A high surrogate is followed by \u and the low one
+					if (u >= 0xd800 && u < 0xdc00 && peek () == '\\')
+					{
+						Pos++;
+						if (get () != 'u')
+							return false;
+						unsigned int low = 0;
+						for (int i = 0; i < 4; i++)
+						{
+							int h = get ();
+							if (h >= '0' && h <= '9')		low = (low << 4) | (h - '0');
+							else if (h >= 'a' && h <= 'f')	low = (low << 4) | (h - 'a' + 10);
+							else if (h >= 'A' && h <= 'F')	low = (low << 4) | (h - 'A' + 10);
+							else return false;
+						}
+						if (low >= 0xdc00 && low < 0xe000)
+							u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+					}
+				}
+				break;
+			default:
+				return false;
+		}
+		if (s)
+			appendUTF8 (u, *s);
+	}
+}
+
+//------------------------------------------------------------------------------
+// A number, true, false or null: anything up to the next delimiter
+bool JSONScanner::readOther ()
+{
+	int c;
+	size_t n = 0;
+	while ((c = peek ()) >= 0 && !strchr (",:]}[{\" \t\r\n", c))
+	{
+		if (!isalnum (c) && !strchr ("+-.", c))
+			return false;
+		Pos++;
+		n++;
+	}
+	return n > 0;
+}
+
+//------------------------------------------------------------------------------
+bool JSONScanner::Scan (std::istream &f)
+{
+	In = &f;
+	Pos = End = 0;
+	Offset = 0;
+	Stopped = false;
+
+	enum { stValue, stValueOrEnd, stKey, stKeyOrEnd, stAfterValue } state = stValue;
+	std::vector<char> stack;
+	for (;;)
+	{
+		if (Stopped)
+			return true;
+		int c = skipSpace ();
+		if (c < 0)
+			return false;
+
+		switch (state)
+		{
+			case stValueOrEnd:
+				if (c == ']')
+				{
+					Pos++;
+					stack.pop_back ();
+					endArray ();
+					state = stAfterValue;
+					break;
+				}
+				// fall through
+			case stValue:
+				if (c == '{')
+				{
+					Pos++;
+					stack.push_back ('{');
+					startObject ();
+					state = stKeyOrEnd;
+				}
+				else if (c == '[')
+				{
+					Pos++;
+					stack.push_back ('[');
+					startArray ();
+					state = stValueOrEnd;
+				}
+				else if (c == '"')
+				{
+					Pos++;
+					if (wantString ())
+					{
+						if (!readString (&Token))
+							return false;
+						stringValue (Token);
+					}
+					else if (!readString (NULL))
+						return false;
+					state = stAfterValue;
+				}
+				else
+				{
+					if (!readOther ())
+						return false;
+					otherValue ();
+					state = stAfterValue;
+				}
+				break;
+
+			case stKeyOrEnd:
+				if (c == '}')
+				{
+					Pos++;
+					stack.pop_back ();
+					endObject ();
+					state = stAfterValue;
+					break;
+				}
+				// fall through
+			case stKey:
+				if (c != '"')
+					return false;
+				Pos++;
+				if (!readString (&Token))
+					return false;
+				key (Token);
+				if (skipSpace () != ':')
+					return false;
+				Pos++;
+				state = stValue;
+				break;
+
+			case stAfterValue:
+				Pos++;
+				if (c == ',')
+					state = (stack.back () == '{') ? stKey : stValue;
+				else if (c == stack.back () + 2)	// '}' or ']'
+				{
+					stack.pop_back ();
+					if (c == '}')
+						endObject ();
+					else
+						endArray ();
+				}
+				else
+					return false;
+				break;
+		}
+		if (state == stAfterValue && stack.empty ())
+			return true;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+bool SearchHitReader::Scan (std::istream &f)
+{
+	Path.clear ();
+	Keys.clear ();
+	Field = NULL;
+	NumHits = 0;
+	return JSONScanner::Scan (f);
+}
+
+//------------------------------------------------------------------------------
+// Record the name of a container as it opens: the key it is the value of,
+// or "[]" inside an array
+void SearchHitReader::open ()
+{
+	if (Path.empty ())
+		Path.push_back ("");
+	else if (Keys.back ().empty ())
+		Path.push_back ("[]");
+	else
+		Path.push_back (Keys.back ());
+}
+
+//------------------------------------------------------------------------------
+// A hit is an object inside hits.hits, at depth 4 counting the response
+void SearchHitReader::startObject ()
+{
+	open ();
+	Keys.push_back ("");
+	if (Path.size() == 4 && Path[1] == "hits" && Path[2] == "hits")
+	{
+		Hit.ProcessID.clear ();
+		Hit.Species.clear ();
+		Hit.Seq.clear ();
+	}
+}
+
+//------------------------------------------------------------------------------
+void SearchHitReader::endObject ()
+{
+	if (Path.size() == 4 && Path[1] == "hits" && Path[2] == "hits" && !Hit.Seq.empty ())
+	{
+		NumHits++;
+		hit (Hit);
+		if (MaxHits > 0 && NumHits >= MaxHits)
+			stop ();
+	}
+	Path.pop_back ();
+	Keys.pop_back ();
+}
+
+//------------------------------------------------------------------------------
+void SearchHitReader::startArray ()
+{
+	open ();
+	Keys.push_back ("");
+}
+
+//------------------------------------------------------------------------------
+void SearchHitReader::endArray ()
+{
+	Path.pop_back ();
+	Keys.pop_back ();
+}
+
+//------------------------------------------------------------------------------
+void SearchHitReader::key (const std::string &k)
+{
+	Keys.back () = k;
+}
+
+//------------------------------------------------------------------------------
+bool SearchHitReader::wantString ()
+{
+	Field = NULL;
+	if (Path.size() < 4 || Path[1] != "hits" || Path[2] != "hits")
+		return false;
+	const std::string &k = Keys.back ();
+	if (Path.size() == 4)
+	{
+		if (k == "_id" && Hit.ProcessID.empty ())
+			Field = &Hit.ProcessID;
+	}
+	else if (Path.size() == 5 && Path[4] == "_source")
+	{
+		if (k == "processid")
+			Field = &Hit.ProcessID;
+		else if (k == "species")
+			Field = &Hit.Species;
+		else if (k == "seq")
+			Field = &Hit.Seq;
+	}
+	return Field != NULL;
+}
+
+//------------------------------------------------------------------------------
+void SearchHitReader::stringValue (const std::string &s)
+{
+	if (Field)
+		*Field = s;
+	Field = NULL;
+}
+
+
+//------------------------------------------------------------------------------
+// Hits go from the reading thread to the profiling thread in small batches
+// through a queue guarded by a mutex
+class QueuedHitReader : public SearchHitReader
+{
+public:
+	QueuedHitReader () { Done = false; };
+
+	std::mutex				Lock;
+	std::condition_variable	Ready;
+	std::deque<std::vector<SearchHit> > Queue;
+	std::vector<SearchHit>	Batch;
+	bool					Done;
+
+	void flush ()
+	{
+		if (Batch.empty ())
+			return;
+		{
+			std::lock_guard<std::mutex> guard (Lock);
+			Queue.push_back (std::vector<SearchHit> ());
+			Queue.back ().swap (Batch);
+		}
+		Ready.notify_one ();
+	}
+
+protected:
+	virtual void hit (SearchHit &h)
+	{
+		Batch.push_back (SearchHit ());
+		Batch.back ().ProcessID.swap (h.ProcessID);
+		Batch.back ().Species.swap (h.Species);
+		Batch.back ().Seq.swap (h.Seq);
+		if (Batch.size() >= 16)
+			flush ();
+	}
+};
+
+//------------------------------------------------------------------------------
+int StreamSearchHits (std::istream &f, KTupleProfiles &profiles, SequenceSet *seqs, int maxHits,
+	UniqueSequences *unique)
+{
+	TREELIB_TRACE_SCOPE (trace, "StreamSearchHits");
+	QueuedHitReader reader;
+	reader.SetMaxHits (maxHits);
+	bool ok = false;
+	std::thread scanner ([&]()
+	{
+		ok = reader.Scan (f);
+		reader.flush ();
+		{
+			std::lock_guard<std::mutex> guard (reader.Lock);
+			reader.Done = true;
+		}
+		reader.Ready.notify_one ();
+	});
+
+	int added = 0;
+	std::vector<SearchHit> batch;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard (reader.Lock);
+			reader.Ready.wait (guard, [&]() { return !reader.Queue.empty () || reader.Done; });
+			if (reader.Queue.empty ())
+				break;
+			batch.swap (reader.Queue.front ());
+			reader.Queue.pop_front ();
+		}
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			std::string label = BOLDLabel (batch[i].ProcessID, batch[i].Species);
+			bool isNew = true;
+			if (unique)
+				unique->Add (label, batch[i].Seq, &isNew);
+			if (isNew)
+				profiles.Add (label, batch[i].Seq);
+			if (seqs)
+				seqs->Add (label, batch[i].Seq);
+			added++;
+		}
+		batch.clear ();
+	}
+	scanner.join ();
+	TREELIB_TRACE_ARG (trace, "hits", added);
+
+	profiles.Finish ();
+	return ok ? added : -1;
+}
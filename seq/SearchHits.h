@@ -0,0 +1,129 @@
+/*
+ * SearchHits
+ * Stream sequences out of Elasticsearch search responses.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef SEARCHHITS_H
+#define SEARCHHITS_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Haplotypes.h"
+#include "KTuple.h"
+#include "Sequence.h"
+
+
+//------------------------------------------------------------------------------
+// SAX-style JSON scanner. The input is read in blocks and never held whole;
+// the handlers are called as tokens are met. String values are only decoded
+// if wantString says so, so large values nobody asked for are skipped
+// without being copied. Nesting is kept on an explicit stack.
+class JSONScanner
+{
+public:
+	JSONScanner () { In = NULL; Pos = End = 0; Offset = 0; Stopped = false; };
+	virtual ~JSONScanner () {};
+
+	// Scan one JSON value from f, returns false on a syntax error. A handler
+	// can call stop to end the scan early, which is not an error.
+	virtual bool	Scan (std::istream &f);
+	// Bytes read before the error, or before the end of the value
+	size_t			GetPosition () const { return Offset + Pos; };
+
+protected:
+	virtual void	startObject () {};
+	virtual void	endObject () {};
+	virtual void	startArray () {};
+	virtual void	endArray () {};
+	virtual void	key (const std::string &) {};
+	// A string value is starting; return true to have it passed to stringValue
+	virtual bool	wantString () { return false; };
+	virtual void	stringValue (const std::string &) {};
+	// A number, true, false or null
+	virtual void	otherValue () {};
+
+	std::istream	*In;
+	char			Buffer[65536];
+	size_t			Pos;
+	size_t			End;
+	size_t			Offset;
+	std::string		Token;
+	bool			Stopped;
+
+	void			stop () { Stopped = true; };
+	int				peek ();
+	int				get () { int c = peek (); if (c >= 0) Pos++; return c; };
+	int				skipSpace ();
+	bool			readString (std::string *s);
+	bool			readOther ();
+};
+
+
+//------------------------------------------------------------------------------
+struct SearchHit
+{
+	std::string	ProcessID;		// _source.processid, or _id if it has none
+	std::string	Species;
+	std::string	Seq;
+};
+
+// Pull processid, species and seq from each of hits.hits[]._source of a
+// search response (the only fields dist.php uses), handing each hit to hit
+// as soon as its object closes. Nothing else is decoded.
+class SearchHitReader : public JSONScanner
+{
+public:
+	SearchHitReader () { MaxHits = 0; NumHits = 0; Field = NULL; };
+	virtual ~SearchHitReader () {};
+
+	// Stop after n hits (0 = all)
+	virtual void	SetMaxHits (int n) { MaxHits = n; };
+	virtual bool	Scan (std::istream &f);
+	int				GetNumHits () const { return NumHits; };
+
+protected:
+	int							MaxHits;
+	int							NumHits;
+	std::vector<std::string>	Path;		// names of the open containers, "[]" in arrays
+	std::vector<std::string>	Keys;		// last key of each open object
+	std::string					*Field;		// where the next wanted string goes
+	SearchHit					Hit;
+
+	// Called for each hit with a sequence
+	virtual void	hit (SearchHit &) {};
+
+	virtual void	startObject ();
+	virtual void	endObject ();
+	virtual void	startArray ();
+	virtual void	endArray ();
+	virtual void	key (const std::string &k);
+	virtual bool	wantString ();
+	virtual void	stringValue (const std::string &s);
+
+	void			open ();
+};
+
+// Read a search response from f on a separate thread while the hits are
+// added to profiles (labelled as dist.php does, see BOLDLabel) on this one,
+// so profiling overlaps with reading. Each sequence is also added to seqs if
+// it is not NULL. If unique is not NULL each hit is added to it and only
+// the first hit of each haplotype is profiled, so profile h is haplotype h.
+// Calls profiles.Finish at the end. Returns the number of hits added, or -1
+// if the response could not be parsed.
+int StreamSearchHits (std::istream &f, KTupleProfiles &profiles, SequenceSet *seqs = NULL,
+	int maxHits = 0, UniqueSequences *unique = NULL);
+
+
+#endif // SEARCHHITS_H
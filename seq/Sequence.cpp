@@ -0,0 +1,188 @@
+/*
+ * Sequence
+ * DNA sequence storage and k-mer encoding for the native sequence tools.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Sequence.h"
+
+#define X NUC_OTHER
+
+const unsigned char NucleotideCode[256] =
+{
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, 0, X, 1, X, X, X, 2, X, X, X, X, X, X, X, X,		// @ABCDEFGHIJKLMNO
+	X, X, X, X, 3, X, X, X, X, X, X, X, X, X, X, X,		// PQRSTUVWXYZ
+	X, 0, X, 1, X, X, X, 2, X, X, X, X, X, X, X, X,		// `abcdefghijklmno
+	X, X, X, X, 3, X, X, X, X, X, X, X, X, X, X, X,		// pqrstuvwxyz
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X
+};
+
+#undef X
+
+
+//------------------------------------------------------------------------------
+std::string BOLDLabel (const std::string &processid, const std::string &species)
+{
+	std::string label;
+	label.reserve (processid.size() + species.size() + 1);
+
+	// Drop ".COI-5P" marker suffix and hyphens from the process id
+	std::string::size_type end = processid.find (".COI-5P");
+	if (end == std::string::npos)
+		end = processid.size();
+	for (std::string::size_type i = 0; i < end; i++)
+	{
+		if (processid[i] != '-')
+			label += processid[i];
+	}
+
+	if (species != "")
+	{
+		label += '_';
+		for (std::string::size_type i = 0; i < species.size(); i++)
+		{
+			if (species[i] == ' ')
+				label += '_';
+			else if (species[i] != ':')
+				label += species[i];
+		}
+	}
+	return label;
+}
+
+
+//------------------------------------------------------------------------------
+void PackedSequence::Pack (const char *s, int length)
+{
+	Length = length;
+	Bases.assign (GetPackedSize (length), 0);
+	Other.clear ();
+	for (int i = 0; i < length; i++)
+	{
+		unsigned char c = NucleotideCode[(unsigned char)s[i]];
+		if (c == NUC_OTHER)
+		{
+			if (!Other.empty () && Other.back().first + Other.back().second == i)
+				Other.back().second++;
+			else
+				Other.push_back (std::make_pair (i, 1));
+		}
+		else
+			Bases[i >> 2] |= (unsigned char)(c << ((i & 3) << 1));
+	}
+}
+
+//------------------------------------------------------------------------------
+// Bits under runs and past the end are cleared, as Pack leaves them, so
+// sequences compare equal whichever way they were made
+bool PackedSequence::Set (int length, const unsigned char *bases, const std::vector<std::pair<int, int> > &other)
+{
+	Length = 0;
+	Bases.clear ();
+	Other.clear ();
+	int end = 0;
+	for (size_t j = 0; j < other.size(); j++)
+	{
+		if (other[j].first < end || other[j].second <= 0 || other[j].second > length - other[j].first)
+			return false;
+		end = other[j].first + other[j].second;
+	}
+
+	Length = length;
+	Bases.assign (bases, bases + GetPackedSize (length));
+	Other = other;
+	for (size_t j = 0; j < Other.size(); j++)
+		for (int i = Other[j].first; i < Other[j].first + Other[j].second; i++)
+			Bases[i >> 2] &= (unsigned char)~(3 << ((i & 3) << 1));
+	if (length & 3)
+		Bases.back () &= (unsigned char)((1 << ((length & 3) << 1)) - 1);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void PackedSequence::Unpack (std::string &s) const
+{
+	static const char base[4] = { 'A', 'C', 'G', 'T' };
+	s.resize (Length);
+	for (int i = 0; i < Length; i++)
+		s[i] = base[(Bases[i >> 2] >> ((i & 3) << 1)) & 3];
+	for (size_t j = 0; j < Other.size(); j++)
+		for (int i = Other[j].first; i < Other[j].first + Other[j].second; i++)
+			s[i] = 'N';
+}
+
+
+//------------------------------------------------------------------------------
+int SequenceSet::Add (const std::string &label, const std::string &seq)
+{
+	Labels.push_back (label);
+	Seqs.push_back (seq);
+	return (int)Seqs.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+void SequenceSet::Clear ()
+{
+	Labels.clear ();
+	Seqs.clear ();
+}
+
+//------------------------------------------------------------------------------
+void SequenceSet::Extract (const std::vector<int> &ids, SequenceSet &subset) const
+{
+	for (size_t i = 0; i < ids.size(); i++)
+		subset.Add (Labels[ids[i]], Seqs[ids[i]]);
+}
+
+//------------------------------------------------------------------------------
+int SequenceSet::ReadFasta (std::istream &f)
+{
+	int n = 0;
+	std::string line, label, seq;
+	bool inRecord = false;
+
+	while (std::getline (f, line))
+	{
+		if (line.size() && line[line.size() - 1] == '\r')
+			line.erase (line.size() - 1);
+		if (line.size() && line[0] == '>')
+		{
+			if (inRecord)
+			{
+				Add (label, seq);
+				n++;
+			}
+			label = line.substr (1);
+			seq = "";
+			inRecord = true;
+		}
+		else if (inRecord)
+			seq += line;
+	}
+	if (inRecord)
+	{
+		Add (label, seq);
+		n++;
+	}
+	return n;
+}
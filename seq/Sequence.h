@@ -0,0 +1,160 @@
+/*
+ * Sequence
+ * DNA sequence storage and k-mer encoding for the native sequence tools.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// 2-bit nucleotide codes. Anything that is not A, C, G or T (either case)
+// maps to NUC_OTHER, and any k-mer containing such a residue is ignored,
+// as dist.php does with its [ACGT]{k} test.
+#define NUC_A		0
+#define NUC_C		1
+#define NUC_G		2
+#define NUC_T		3
+#define NUC_OTHER	4
+
+extern const unsigned char NucleotideCode[256];
+
+// Largest k for which a k-mer fits in an unsigned int
+#define MAX_KMER_LENGTH	16
+
+
+// Build a leaf label from a BOLD process id and species name the way
+// dist.php does ("MRMSR005-10" + "Squamata sp. BOLD:AAL6056" becomes
+// "MRMSR00510_Squamata_sp._BOLDAAL6056").
+std::string BOLDLabel (const std::string &processid, const std::string &species);
+
+
+//------------------------------------------------------------------------------
+// Iterate over the k-mers of a sequence as packed 2-bit codes (first residue
+// in the most significant bits), skipping every window that contains a
+// residue other than A, C, G or T.
+class KmerIterator
+{
+public:
+	KmerIterator (const char *s, int length, int k)
+	{
+		Seq = s;
+		Length = length;
+		K = k;
+		Mask = (k >= MAX_KMER_LENGTH) ? 0xffffffffu : ((1u << (2 * k)) - 1);
+		Pos = 0;
+		Valid = 0;
+		Code = 0;
+	}
+
+	// Get next k-mer, returns false when the sequence is exhausted
+	bool Next (unsigned int &kmer)
+	{
+		while (Pos < Length)
+		{
+			unsigned char c = NucleotideCode[(unsigned char)Seq[Pos++]];
+			if (c == NUC_OTHER)
+			{
+				Valid = 0;
+				Code = 0;
+			}
+			else
+			{
+				Code = ((Code << 2) | c) & Mask;
+				if (++Valid >= K)
+				{
+					kmer = Code;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Position of the first residue of the k-mer last returned by Next
+	int GetPosition () const { return Pos - K; };
+
+protected:
+	const char		*Seq;
+	int				Length;
+	int				K;
+	unsigned int	Mask;
+	int				Pos;
+	int				Valid;
+	unsigned int	Code;
+};
+
+
+//------------------------------------------------------------------------------
+// A sequence packed four bases to a byte (first base in the low bits), with
+// residues other than A, C, G and T kept as runs of (start, length) and
+// restored as N.
+class PackedSequence
+{
+public:
+	PackedSequence () { Length = 0; };
+	virtual ~PackedSequence () {};
+
+	virtual void	Pack (const char *s, int length);
+	virtual void	Unpack (std::string &s) const;
+	// Set from bases packed as GetBases has them (GetPackedSize (length)
+	// bytes) and runs of other residues as GetOther has them, as when read
+	// back from a file. Returns false, leaving the sequence empty, if the
+	// runs are not in order, or not within the sequence.
+	virtual bool	Set (int length, const unsigned char *bases, const std::vector<std::pair<int, int> > &other);
+
+	static size_t	GetPackedSize (int length) { return ((size_t)length + 3) / 4; };
+
+	int				GetLength () const { return Length; };
+	const std::vector<unsigned char> &GetBases () const { return Bases; };
+	const std::vector<std::pair<int, int> > &GetOther () const { return Other; };
+
+protected:
+	int				Length;
+	std::vector<unsigned char>			Bases;
+	std::vector<std::pair<int, int> >	Other;
+};
+
+
+//------------------------------------------------------------------------------
+// A collection of labelled sequences, indexed 0..n-1 in order of addition.
+class SequenceSet
+{
+public:
+	SequenceSet () {};
+	virtual ~SequenceSet () {};
+
+	virtual int		Add (const std::string &label, const std::string &seq);
+	virtual void	Clear ();
+
+	// Copy the sequences with the given indices (in that order) into subset
+	virtual void	Extract (const std::vector<int> &ids, SequenceSet &subset) const;
+
+	virtual int		GetNumSequences () const { return (int)Seqs.size(); };
+	virtual const std::string &GetLabel (int i) const { return Labels[i]; };
+	virtual const std::string &GetSequence (int i) const { return Seqs[i]; };
+
+	// Read sequences in FASTA format, returns number of sequences read
+	virtual int		ReadFasta (std::istream &f);
+
+protected:
+	std::vector<std::string>	Labels;
+	std::vector<std::string>	Seqs;
+};
+
+
+#endif // SEQUENCE_H
@@ -0,0 +1,354 @@
+/*
+ * SubtreeDAG
+ * Store a collection of trees with shared subtrees stored once.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "SubtreeDAG.h"
+
+#include <algorithm>
+
+
+//------------------------------------------------------------------------------
+SubtreeDAG::SubtreeDAG (bool rooted)
+{
+	Rooted = rooted;
+	Clear ();
+}
+
+//------------------------------------------------------------------------------
+void SubtreeDAG::Clear ()
+{
+	Labels.clear ();
+	LeafIndex.clear ();
+	Leaf.clear ();
+	Size.clear ();
+	ChildStart.assign (1, 0);
+	Children.clear ();
+	LeafSubtree.clear ();
+	Bucket.clear ();
+	NextInBucket.clear ();
+	Roots.clear ();
+	LengthStart.assign (1, 0);
+	Lengths.clear ();
+	HasLengths.clear ();
+	Names.clear ();
+}
+
+//------------------------------------------------------------------------------
+void SubtreeDAG::SetLeaves (const std::vector<std::string> &labels)
+{
+	Clear ();
+	for (size_t i = 0; i < labels.size(); i++)
+		GetLeafIndex (labels[i]);
+}
+
+//------------------------------------------------------------------------------
+int SubtreeDAG::GetLeafIndex (const std::string &label)
+{
+	std::pair<std::unordered_map<std::string, int>::iterator, bool> r
+		= LeafIndex.insert (std::make_pair (label, (int)Labels.size()));
+	if (r.second)
+		Labels.push_back (label);
+	return r.first->second;
+}
+
+//------------------------------------------------------------------------------
+int SubtreeDAG::leafSubtree (int leaf)
+{
+	if (leaf >= (int)LeafSubtree.size())
+		LeafSubtree.resize (leaf + 1, -1);
+	if (LeafSubtree[leaf] < 0)
+	{
+		LeafSubtree[leaf] = (int)Leaf.size();
+		Leaf.push_back (leaf);
+		Size.push_back (1);
+		ChildStart.push_back ((int)Children.size());
+		NextInBucket.push_back (-1);
+	}
+	return LeafSubtree[leaf];
+}
+
+//------------------------------------------------------------------------------
+// Look the child list up among the subtrees with the same hash, adding it if
+// it is new
+int SubtreeDAG::internalSubtree (const int *children, int n)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	for (int j = 0; j < n; j++)
+		h = (h ^ (unsigned long long)children[j]) * 0x100000001b3ULL;
+	h ^= h >> 29;
+
+	std::unordered_map<unsigned long long, int>::iterator it = Bucket.find (h);
+	int head = (it == Bucket.end ()) ? -1 : it->second;
+	for (int s = head; s >= 0; s = NextInBucket[s])
+		if (GetNumChildren (s) == n
+			&& std::equal (children, children + n, Children.begin() + ChildStart[s]))
+			return s;
+
+	int s = (int)Leaf.size();
+	int size = 0;
+	for (int j = 0; j < n; j++)
+	{
+		Children.push_back (children[j]);
+		size += Size[children[j]];
+	}
+	Leaf.push_back (-1);
+	Size.push_back (size);
+	ChildStart.push_back ((int)Children.size());
+	NextInBucket.push_back (head);
+	Bucket[h] = s;
+	return s;
+}
+
+//------------------------------------------------------------------------------
+// As for TopologyHasher: flatten t, walk it from the new root through an
+// undirected adjacency list, then work back up assigning subtrees, keeping
+// each node's children in canonical order for the edge lengths.
+int SubtreeDAG::Add (Tree &t)
+{
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return -1;
+
+	Workspace &w = Work;
+	t.GetPreorder (w.Nodes, w.Parent);
+	int n = (int)w.Nodes.size();
+
+	int first = 0, smallest = -1;
+	w.Length.resize (n);
+	w.Tip.assign (n, -1);
+	for (int i = 0; i < n; i++)
+	{
+		w.Length[i] = (i > 0) ? w.Nodes[i]->GetEdgeLength () : 0.0f;
+		if (w.Nodes[i]->IsLeaf ())
+		{
+			w.Tip[i] = GetLeafIndex (w.Nodes[i]->GetLabel ());
+			if (smallest < 0 || w.Tip[i] < smallest)
+			{
+				smallest = w.Tip[i];
+				if (!Rooted)
+					first = i;
+			}
+		}
+	}
+
+	w.Start.assign (n + 1, 0);
+	for (int i = 1; i < n; i++)
+	{
+		w.Start[i + 1]++;
+		w.Start[w.Parent[i] + 1]++;
+	}
+	for (int i = 0; i < n; i++)
+		w.Start[i + 1] += w.Start[i];
+	w.Neighbour.resize (w.Start[n]);
+	std::vector<int> fill (w.Start.begin(), w.Start.end() - 1);
+	for (int i = 1; i < n; i++)
+	{
+		w.Neighbour[fill[i]++] = w.Parent[i];
+		w.Neighbour[fill[w.Parent[i]]++] = i;
+	}
+
+	// Preorder from the new root; Above[v] is the length of the edge to v's
+	// new parent, stored with whichever end was the child in t
+	w.Order.clear ();
+	w.Up.assign (n, -1);
+	w.Above.assign (n, 0.0f);
+	std::vector<int> todo (1, first);
+	while (!todo.empty ())
+	{
+		int v = todo.back ();
+		todo.pop_back ();
+		w.Order.push_back (v);
+		for (int j = w.Start[v]; j < w.Start[v + 1]; j++)
+		{
+			int u = w.Neighbour[j];
+			if (u != w.Up[v])
+			{
+				w.Up[u] = v;
+				w.Above[u] = (w.Parent[u] == v) ? w.Length[u] : w.Length[v];
+				todo.push_back (u);
+			}
+		}
+	}
+
+	// Children before parents. Items are (smallest leaf, node), with node -1
+	// for the new root's own leaf.
+	w.Id.assign (n, -1);
+	w.Low.assign (n, 0);
+	w.ItemFirst.assign (n, 0);
+	w.ItemLast.assign (n, 0);
+	w.Sorted.clear ();
+	for (int k = n - 1; k >= 0; k--)
+	{
+		int v = w.Order[k];
+		w.Items.clear ();
+		if (w.Tip[v] >= 0 && v == first && !Rooted)
+			w.Items.push_back (std::make_pair (w.Tip[v], -1));
+		for (int j = w.Start[v]; j < w.Start[v + 1]; j++)
+		{
+			int u = w.Neighbour[j];
+			if (u != w.Up[v])
+				w.Items.push_back (std::make_pair (w.Low[u], u));
+		}
+
+		if (w.Items.size() == 1 && w.Items[0].second >= 0)
+		{
+			// One child: v stands for it, and the edges above both are joined
+			int u = w.Items[0].second;
+			w.Id[v] = w.Id[u];
+			w.Low[v] = w.Low[u];
+			w.ItemFirst[v] = w.ItemFirst[u];
+			w.ItemLast[v] = w.ItemLast[u];
+			w.Above[v] += w.Above[u];
+			continue;
+		}
+		if (w.Items.size() <= 1)
+		{
+			w.Id[v] = (w.Tip[v] >= 0) ? leafSubtree (w.Tip[v]) : -1;
+			w.Low[v] = w.Tip[v];
+			w.ItemFirst[v] = w.ItemLast[v] = (int)w.Sorted.size();
+			continue;
+		}
+
+		std::sort (w.Items.begin(), w.Items.end());
+		w.Ids.clear ();
+		w.ItemFirst[v] = (int)w.Sorted.size();
+		for (size_t j = 0; j < w.Items.size(); j++)
+		{
+			int u = w.Items[j].second;
+			w.Ids.push_back ((u < 0) ? leafSubtree (w.Tip[v]) : w.Id[u]);
+			w.Sorted.push_back (u);
+		}
+		w.ItemLast[v] = (int)w.Sorted.size();
+		w.Id[v] = internalSubtree (&w.Ids[0], (int)w.Ids.size());
+		w.Low[v] = w.Items[0].first;
+	}
+	if (w.Id[first] < 0)
+		return -1;
+
+	// Edge lengths in preorder of the canonical form
+	todo.assign (1, first);
+	while (!todo.empty ())
+	{
+		int v = todo.back ();
+		todo.pop_back ();
+		for (int j = w.ItemLast[v] - 1; j >= w.ItemFirst[v]; j--)
+			if (w.Sorted[j] >= 0)
+				todo.push_back (w.Sorted[j]);
+		for (int j = w.ItemFirst[v]; j < w.ItemLast[v]; j++)
+			if (w.Sorted[j] < 0)
+				Lengths.push_back (0.0f);
+		if (v != first)
+			Lengths.push_back (w.Above[v]);
+	}
+
+	Roots.push_back (w.Id[first]);
+	LengthStart.push_back (Lengths.size());
+	HasLengths.push_back (t.GetHasEdgeLengths () ? 1 : 0);
+	Names.push_back (t.GetName ());
+	return (int)Roots.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+void SubtreeDAG::GetLeafSet (int s, std::vector<int> &leaves) const
+{
+	leaves.clear ();
+	std::vector<int> stack (1, s);
+	while (!stack.empty ())
+	{
+		int v = stack.back ();
+		stack.pop_back ();
+		if (Leaf[v] >= 0)
+			leaves.push_back (Leaf[v]);
+		for (int j = ChildStart[v + 1] - 1; j >= ChildStart[v]; j--)
+			stack.push_back (Children[j]);
+	}
+}
+
+//------------------------------------------------------------------------------
+// A subtree occurs once in each tree containing it (its leaves are distinct),
+// so its count is the number of trees rooted at it plus the counts of its
+// parents. Parents have higher numbers than their children.
+void SubtreeDAG::GetTreeCounts (std::vector<int> &counts) const
+{
+	counts.assign (Leaf.size(), 0);
+	for (size_t i = 0; i < Roots.size(); i++)
+		counts[Roots[i]]++;
+	for (int s = (int)Leaf.size() - 1; s >= 0; s--)
+		if (counts[s] > 0)
+			for (int j = ChildStart[s]; j < ChildStart[s + 1]; j++)
+				counts[Children[j]] += counts[s];
+}
+
+//------------------------------------------------------------------------------
+bool SubtreeDAG::GetTree (int i, Tree &t) const
+{
+	if (i < 0 || i >= (int)Roots.size())
+		return false;
+
+	// The preorder of Add, with the length of each node's edge taken in turn
+	const float *length = GetEdgeLengths (i);
+	int leaves = 0;
+	NodePtr root = NULL;
+	std::vector<std::pair<int, NodePtr> > stack;
+	stack.push_back (std::make_pair (Roots[i], (NodePtr)NULL));
+	while (!stack.empty ())
+	{
+		int s = stack.back().first;
+		NodePtr anc = stack.back().second;
+		stack.pop_back ();
+
+		NodePtr p = t.NewNode ();
+		if (Leaf[s] >= 0)
+		{
+			p->SetLeaf (true);
+			p->SetLabel (Labels[Leaf[s]]);
+			p->SetLeafNumber (++leaves);
+			p->SetWeight (1);
+		}
+		if (anc)
+		{
+			p->SetAnc (anc);
+			p->SetEdgeLength (*length++);
+			if (anc->GetChild () == NULL)
+				anc->SetChild (p);
+			else
+				anc->GetChild()->GetRightMostSibling()->SetSibling (p);
+		}
+		else
+			root = p;
+		for (int j = ChildStart[s + 1] - 1; j >= ChildStart[s]; j--)
+			stack.push_back (std::make_pair (Children[j], p));
+	}
+
+	t.SetRoot (root);
+	t.SetName (Names[i]);
+	t.SetEdgeLengths (HasLengths[i] != 0);
+	t.SetRooted (Rooted);
+	t.Update ();
+	t.MakeNodeList ();
+	return true;
+}
+
+//------------------------------------------------------------------------------
+size_t SubtreeDAG::GetMemoryUsage () const
+{
+	size_t bytes = (Leaf.capacity() + Size.capacity() + ChildStart.capacity() + Children.capacity()
+		+ LeafSubtree.capacity() + NextInBucket.capacity() + Roots.capacity()) * sizeof (int);
+	bytes += Bucket.size() * (sizeof (unsigned long long) + sizeof (int) + 2 * sizeof (void *));
+	bytes += LengthStart.capacity() * sizeof (size_t) + Lengths.capacity() * sizeof (float)
+		+ HasLengths.capacity();
+	for (size_t i = 0; i < Names.size(); i++)
+		bytes += sizeof (std::string) + Names[i].capacity();
+	return bytes;
+}
@@ -0,0 +1,130 @@
+/*
+ * SubtreeDAG
+ * Store a collection of trees with shared subtrees stored once.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef SUBTREEDAG_H
+#define SUBTREEDAG_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+//------------------------------------------------------------------------------
+// Trees are hash-consed: every subtree (a leaf, or an ordered list of child
+// subtrees) is stored once, however many trees contain it, and a tree is a
+// root subtree plus its own edge lengths. Children are kept in canonical
+// order (by smallest leaf index, leaves being numbered by label), so the same
+// clade with the same topology is the same subtree whatever order a tree
+// lists it in. Nodes with a single child are dropped.
+//
+// Unrooted trees (the default) are rooted at the leaf with the smallest index
+// first, so that every subtree is the side of a split away from that leaf and
+// subtrees are shared between trees however they were rooted. The root then
+// has that leaf as its first child, with a zero edge length.
+//
+// Subtrees are numbered children first. Edge lengths of a tree are stored in
+// preorder of its canonical form, one per node below the root.
+class SubtreeDAG
+{
+public:
+	SubtreeDAG (bool rooted = false);
+	virtual ~SubtreeDAG () {};
+
+	virtual void	Clear ();
+
+	// Number leaves in this order rather than as they are met
+	virtual void	SetLeaves (const std::vector<std::string> &labels);
+	// Index of label, added if it is new
+	virtual int		GetLeafIndex (const std::string &label);
+	virtual int		GetNumLeaves () const { return (int)Labels.size(); };
+	virtual const std::string &GetLabel (int leaf) const { return Labels[leaf]; };
+
+	// Add t, returning its index, or -1 if it is empty
+	virtual int		Add (Tree &t);
+	// Rebuild tree i into t, which should be empty
+	virtual bool	GetTree (int i, Tree &t) const;
+
+	virtual int		GetNumTrees () const { return (int)Roots.size(); };
+	virtual int		GetRoot (int i) const { return Roots[i]; };
+	virtual const float *GetEdgeLengths (int i) const { return &Lengths[LengthStart[i]]; };
+	virtual int		GetNumEdges (int i) const { return (int)(LengthStart[i + 1] - LengthStart[i]); };
+
+	virtual int		GetNumSubtrees () const { return (int)Leaf.size(); };
+	// Leaf index of subtree s, or -1 if it is internal
+	virtual int		GetLeaf (int s) const { return Leaf[s]; };
+	virtual int		GetNumChildren (int s) const { return ChildStart[s + 1] - ChildStart[s]; };
+	virtual int		GetChild (int s, int j) const { return Children[ChildStart[s] + j]; };
+	// Number of leaves in subtree s
+	virtual int		GetSize (int s) const { return Size[s]; };
+	virtual void	GetLeafSet (int s, std::vector<int> &leaves) const;
+
+	// Number of trees containing each subtree (its clade, with its topology),
+	// in one pass over the subtrees rather than over every tree
+	virtual void	GetTreeCounts (std::vector<int> &counts) const;
+
+	// Bytes used by subtrees and by per-tree data
+	virtual size_t	GetMemoryUsage () const;
+
+protected:
+	bool				Rooted;
+	std::vector<std::string> Labels;
+	std::unordered_map<std::string, int> LeafIndex;
+
+	// Subtrees
+	std::vector<int>	Leaf;
+	std::vector<int>	Size;
+	std::vector<int>	ChildStart;		// children of s are Children[ChildStart[s] ..
+	std::vector<int>	Children;		// ChildStart[s + 1])
+	std::vector<int>	LeafSubtree;	// subtree for each leaf, or -1
+	std::unordered_map<unsigned long long, int> Bucket;	// hash of children -> first subtree
+	std::vector<int>	NextInBucket;
+
+	// Trees
+	std::vector<int>	Roots;
+	std::vector<size_t>	LengthStart;
+	std::vector<float>	Lengths;
+	std::vector<char>	HasLengths;
+	std::vector<std::string> Names;
+
+	// Kept between calls to Add so its vectors are reused
+	struct Workspace
+	{
+		std::vector<NodePtr>	Nodes;		// preorder of t
+		std::vector<int>		Parent;
+		std::vector<float>		Length;
+		std::vector<int>		Tip;		// leaf index, or -1
+		std::vector<int>		Start;		// neighbours of node i are
+		std::vector<int>		Neighbour;	// Neighbour[Start[i] .. Start[i + 1])
+		std::vector<int>		Order;		// preorder from the new root
+		std::vector<int>		Up;			// parent from the new root
+		std::vector<float>		Above;		// length of the edge to Up
+		std::vector<int>		Id;			// subtree of each node
+		std::vector<int>		Low;		// smallest leaf below
+		std::vector<int>		ItemFirst;	// children of node v in canonical order are
+		std::vector<int>		ItemLast;	// Sorted[ItemFirst[v] .. ItemLast[v])
+		std::vector<int>		Sorted;
+		std::vector<std::pair<int, int> > Items;
+		std::vector<int>		Ids;
+	};
+	Workspace			Work;
+
+	int				leafSubtree (int leaf);
+	int				internalSubtree (const int *children, int n);
+};
+
+
+#endif // SUBTREEDAG_H
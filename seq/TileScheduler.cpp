@@ -0,0 +1,203 @@
+/*
+ * TileScheduler
+ * Work-stealing parallel loop over the tiles of a lower triangular matrix,
+ * and a parallel loop over independent items.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "TileScheduler.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+//------------------------------------------------------------------------------
+int DefaultThreads ()
+{
+	unsigned int n = std::thread::hardware_concurrency ();
+	return (n == 0) ? 1 : (int)n;
+}
+
+//------------------------------------------------------------------------------
+int TileSizeForCache (size_t rowBytes, size_t cacheBytes)
+{
+	if (rowBytes == 0)
+		return 256;
+	size_t b = cacheBytes / (2 * rowBytes);
+	if (b < 1) b = 1;
+	if (b > 256) b = 256;	// keep enough tiles to share out
+	return (int)b;
+}
+
+
+//------------------------------------------------------------------------------
+// One thread's tiles. The owner takes from the front, thieves from the back,
+// so an owner keeps working through its own band of rows in order.
+struct TileQueue
+{
+	std::mutex			Lock;
+	std::vector<Tile>	Tiles;
+	size_t				Front;
+	size_t				Back;
+
+	TileQueue () { Front = Back = 0; };
+
+	bool PopFront (Tile &t)
+	{
+		std::lock_guard<std::mutex> guard (Lock);
+		if (Front == Back)
+			return false;
+		t = Tiles[Front++];
+		return true;
+	};
+	bool PopBack (Tile &t)
+	{
+		std::lock_guard<std::mutex> guard (Lock);
+		if (Front == Back)
+			return false;
+		t = Tiles[--Back];
+		return true;
+	};
+	size_t Remaining ()
+	{
+		std::lock_guard<std::mutex> guard (Lock);
+		return Back - Front;
+	};
+};
+
+//------------------------------------------------------------------------------
+static void worker (std::vector<TileQueue> &queues, int self, const TileFunction &f)
+{
+	Tile t;
+	for (;;)
+	{
+		if (queues[self].PopFront (t))
+		{
+			f (t);
+			continue;
+		}
+
+		// Own queue empty, steal from whichever queue has most left
+		int victim = -1;
+		size_t most = 0;
+		for (int q = 0; q < (int)queues.size(); q++)
+		{
+			size_t r = queues[q].Remaining ();
+			if (r > most)
+			{
+				most = r;
+				victim = q;
+			}
+		}
+		if (victim < 0)
+			return;
+		if (queues[victim].PopBack (t))
+			f (t);
+	}
+}
+
+//------------------------------------------------------------------------------
+void ForEachTile (int n, int tileSize, const TileFunction &f, int threads)
+{
+	if (n < 2)
+		return;
+	if (tileSize < 1)
+		tileSize = 1;
+	if (threads < 1)
+		threads = DefaultThreads ();
+
+	// Tiles in row-band order, with the number of pairs each covers
+	std::vector<Tile> tiles;
+	std::vector<double> work;
+	double total = 0.0;
+	for (int r = 0; r < n; r += tileSize)
+	{
+		Tile t;
+		t.RowBegin = r;
+		t.RowEnd = (r + tileSize < n) ? r + tileSize : n;
+		for (int c = 0; c <= r; c += tileSize)
+		{
+			t.ColBegin = c;
+			t.ColEnd = (c + tileSize < t.RowEnd) ? c + tileSize : t.RowEnd;
+			double w = (c == r)
+				? 0.5 * (double)(t.RowEnd - r) * (t.RowEnd - r - 1)
+				: (double)(t.RowEnd - r) * (t.ColEnd - c);
+			if (w <= 0.0)
+				continue;
+			tiles.push_back (t);
+			work.push_back (w);
+			total += w;
+		}
+	}
+
+	if (threads == 1 || tiles.size() < 2)
+	{
+		for (size_t i = 0; i < tiles.size(); i++)
+			f (tiles[i]);
+		return;
+	}
+	if ((size_t)threads > tiles.size())
+		threads = (int)tiles.size();
+
+	// Deal out contiguous runs of roughly equal work
+	std::vector<TileQueue> queues (threads);
+	double share = total / threads;
+	double done = 0.0;
+	int q = 0;
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		queues[q].Tiles.push_back (tiles[i]);
+		done += work[i];
+		if (done >= share * (q + 1) && q < threads - 1)
+			q++;
+	}
+	for (int i = 0; i < threads; i++)
+		queues[i].Back = queues[i].Tiles.size();
+
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; i++)
+		pool.push_back (std::thread (worker, std::ref (queues), i, std::cref (f)));
+	worker (queues, 0, f);
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join ();
+}
+
+//------------------------------------------------------------------------------
+void ParallelFor (int n, const ItemFunction &f, int threads)
+{
+	if (threads < 1)
+		threads = DefaultThreads ();
+	if (threads > n)
+		threads = n;
+	if (threads <= 1)
+	{
+		for (int i = 0; i < n; i++)
+			f (i, 0);
+		return;
+	}
+
+	std::atomic<int> next (0);
+	auto worker = [&](int thread)
+	{
+		int i;
+		while ((i = next++) < n)
+			f (i, thread);
+	};
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++)
+		pool.push_back (std::thread (worker, t));
+	worker (0);
+	for (size_t i = 0; i < pool.size(); i++)
+		pool[i].join ();
+}
@@ -0,0 +1,64 @@
+/*
+ * TileScheduler
+ * Work-stealing parallel loop over the tiles of a lower triangular matrix,
+ * and a parallel loop over independent items.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <cstddef>
+#include <functional>
+
+
+//------------------------------------------------------------------------------
+// Block of the strict lower triangle: rows [RowBegin, RowEnd) against columns
+// [ColBegin, ColEnd). Tiles on the diagonal are triangles, so the columns for
+// row i stop at min (ColEnd, i).
+struct Tile
+{
+	int RowBegin;
+	int RowEnd;
+	int ColBegin;
+	int ColEnd;
+};
+
+typedef std::function<void (const Tile &)> TileFunction;
+
+// Called with an item number and the number of the thread running it
+typedef std::function<void (int, int)> ItemFunction;
+
+// Number of worker threads to use when the caller asks for 0
+int DefaultThreads ();
+
+// Tile edge so that the rows and columns of one tile, each rowBytes long,
+// fit in roughly cacheBytes (at least 1)
+int TileSizeForCache (size_t rowBytes, size_t cacheBytes = 512 * 1024);
+
+// Call f once for every tile of the lower triangle of an n x n matrix.
+// Tiles are dealt out to the threads in contiguous runs of rows, so each
+// thread writes a compact band of the matrix; a thread that runs out takes
+// tiles from the far end of the busiest queue. f must be safe to call
+// concurrently on different tiles. With threads == 1 everything runs on the
+// calling thread.
+void ForEachTile (int n, int tileSize, const TileFunction &f, int threads = 0);
+
+// Call f (i, thread) for i from 0 to n - 1, the threads taking the next
+// item as each finishes one. thread is less than threads (DefaultThreads ()
+// for 0), so per-thread state can be kept in a vector of that size. f must
+// be safe to call concurrently on different items. With threads == 1
+// everything runs on the calling thread, in order.
+void ParallelFor (int n, const ItemFunction &f, int threads = 0);
+
+
+#endif // TILESCHEDULER_H
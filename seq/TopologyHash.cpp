@@ -0,0 +1,308 @@
+/*
+ * TopologyHash
+ * Canonical hashes of tree topologies, and de-duplication of tree samples.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "TopologyHash.h"
+#include "HashMix.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+
+//------------------------------------------------------------------------------
+void TopologyHasher::SetLeaves (const std::vector<std::string> &labels)
+{
+	LeafIndex.clear ();
+	for (size_t i = 0; i < labels.size(); i++)
+		LeafIndex.insert (std::make_pair (labels[i], (int)LeafIndex.size()));
+}
+
+//------------------------------------------------------------------------------
+int TopologyHasher::GetLeafIndex (const std::string &label)
+{
+	return LeafIndex.insert (std::make_pair (label, (int)LeafIndex.size())).first->second;
+}
+
+//------------------------------------------------------------------------------
+TopologyHash TopologyHasher::Hash (Tree &t)
+{
+	Workspace w;
+	TopologyHash h;
+	t.GetPreorder (w.Nodes, w.Parent);
+	addLeaves (w);
+	fold (h, w);
+	return h;
+}
+
+//------------------------------------------------------------------------------
+bool TopologyHasher::Hash (Tree &t, TopologyHash &h) const
+{
+	Workspace w;
+	t.GetPreorder (w.Nodes, w.Parent);
+	if (!findLeaves (w))
+	{
+		h = TopologyHash ();
+		return false;
+	}
+	fold (h, w);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Index of each leaf of w.Nodes, numbering new labels
+void TopologyHasher::addLeaves (Workspace &w)
+{
+	int n = (int)w.Nodes.size();
+	w.Leaf.assign (n, -1);
+	for (int i = 0; i < n; i++)
+		if (w.Nodes[i]->IsLeaf ())
+			w.Leaf[i] = GetLeafIndex (w.Nodes[i]->GetLabel ());
+}
+
+//------------------------------------------------------------------------------
+// Index of each leaf of w.Nodes, or false if a label has not been numbered
+bool TopologyHasher::findLeaves (Workspace &w) const
+{
+	int n = (int)w.Nodes.size();
+	w.Leaf.assign (n, -1);
+	for (int i = 0; i < n; i++)
+		if (w.Nodes[i]->IsLeaf ())
+		{
+			std::unordered_map<std::string, int>::const_iterator it = LeafIndex.find (w.Nodes[i]->GetLabel ());
+			if (it == LeafIndex.end ())
+				return false;
+			w.Leaf[i] = it->second;
+		}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Hash the tree in w (preorder and parents of t, with leaf indices): make an
+// undirected adjacency list, walk it in preorder from the hashing root (the
+// tree's root, or the smallest leaf if unrooted), then fold hashes in reverse
+// preorder. Each node's items are its children plus itself if it is a leaf
+// (only the unrooted root can be both), sorted by smallest leaf index.
+void TopologyHasher::fold (TopologyHash &h, Workspace &w) const
+{
+	h = TopologyHash ();
+	int n = (int)w.Nodes.size();
+	if (n == 0)
+		return;
+
+	int start = 0, smallest = -1;
+	for (int i = 0; i < n; i++)
+		if (w.Leaf[i] >= 0 && (smallest < 0 || w.Leaf[i] < smallest))
+		{
+			smallest = w.Leaf[i];
+			if (!Rooted)
+				start = i;
+		}
+
+	// Undirected adjacency
+	w.Start.assign (n + 1, 0);
+	for (int i = 1; i < n; i++)
+	{
+		w.Start[i + 1]++;
+		w.Start[w.Parent[i] + 1]++;
+	}
+	for (int i = 0; i < n; i++)
+		w.Start[i + 1] += w.Start[i];
+	w.Neighbour.resize (w.Start[n]);
+	std::vector<int> fill (w.Start.begin(), w.Start.end() - 1);
+	for (int i = 1; i < n; i++)
+	{
+		w.Neighbour[fill[i]++] = w.Parent[i];
+		w.Neighbour[fill[w.Parent[i]]++] = i;
+	}
+
+	// Preorder from the hashing root
+	w.Order.clear ();
+	w.Parent.assign (n, -1);
+	std::vector<int> todo (1, start);
+	while (!todo.empty ())
+	{
+		int v = todo.back ();
+		todo.pop_back ();
+		w.Order.push_back (v);
+		for (int j = w.Start[v]; j < w.Start[v + 1]; j++)
+		{
+			int u = w.Neighbour[j];
+			if (u != w.Parent[v])
+			{
+				w.Parent[u] = v;
+				todo.push_back (u);
+			}
+		}
+	}
+
+	w.Min.assign (n, 0);
+	w.H1.assign (n, 0);
+	w.H2.assign (n, 0);
+	for (int k = n - 1; k >= 0; k--)
+	{
+		int v = w.Order[k];
+		w.Items.clear ();
+		if (w.Leaf[v] >= 0)
+			w.Items.push_back (std::make_pair (w.Leaf[v], -1));
+		for (int j = w.Start[v]; j < w.Start[v + 1]; j++)
+		{
+			int u = w.Neighbour[j];
+			if (u != w.Parent[v])
+				w.Items.push_back (std::make_pair (w.Min[u], u));
+		}
+
+		if (w.Items.size() == 1)
+		{
+			// A leaf, or a node of degree two
+			int u = w.Items[0].second;
+			if (u < 0)
+			{
+				unsigned long long x = (unsigned long long)w.Leaf[v];
+				w.H1[v] = HashMix (x + 0x9e3779b97f4a7c15ULL);
+				w.H2[v] = HashMix ((x << 1) ^ 0x6a09e667f3bcc909ULL);
+				w.Min[v] = w.Leaf[v];
+			}
+			else
+			{
+				w.H1[v] = w.H1[u];
+				w.H2[v] = w.H2[u];
+				w.Min[v] = w.Min[u];
+			}
+			continue;
+		}
+
+		std::sort (w.Items.begin(), w.Items.end());
+		unsigned long long h1 = 0x243f6a8885a308d3ULL, h2 = 0x13198a2e03707344ULL;
+		for (size_t j = 0; j < w.Items.size(); j++)
+		{
+			int u = w.Items[j].second;
+			unsigned long long c1, c2;
+			if (u < 0)
+			{
+				unsigned long long x = (unsigned long long)w.Leaf[v];
+				c1 = HashMix (x + 0x9e3779b97f4a7c15ULL);
+				c2 = HashMix ((x << 1) ^ 0x6a09e667f3bcc909ULL);
+			}
+			else
+			{
+				c1 = w.H1[u];
+				c2 = w.H2[u];
+			}
+			h1 = h1 * 0x100000001b3ULL + c1;
+			h2 = (h2 ^ c2) * 0xbf58476d1ce4e5b9ULL + 0x94d049bb133111ebULL;
+		}
+		w.H1[v] = HashMix (h1 + w.Items.size());
+		w.H2[v] = HashMix (h2 ^ (w.Items.size() << 32));
+		w.Min[v] = w.Items[0].first;
+	}
+
+	h.High = w.H1[start];
+	h.Low = w.H2[start];
+}
+
+//------------------------------------------------------------------------------
+void TopologyHasher::Canonicalize (Tree &t)
+{
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return;
+
+	std::vector<NodePtr> nodes;
+	std::vector<int> parent;
+	t.GetPreorder (nodes, parent);
+
+	// Smallest leaf index below each node, children before parents (leaves
+	// are numbered first, in preorder)
+	std::unordered_map<NodePtr, int> smallest;
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (nodes[i]->IsLeaf ())
+			smallest[nodes[i]] = GetLeafIndex (nodes[i]->GetLabel ());
+	std::vector<std::pair<int, NodePtr> > children;
+	for (int i = (int)nodes.size() - 1; i >= 0; i--)
+	{
+		NodePtr p = nodes[i];
+		if (p->IsLeaf ())
+			continue;
+		children.clear ();
+		for (NodePtr q = p->GetChild (); q; q = q->GetSibling ())
+			children.push_back (std::make_pair (smallest[q], q));
+		if (children.empty ())
+		{
+			smallest[p] = -1;
+			continue;
+		}
+		std::stable_sort (children.begin(), children.end(),
+			[](const std::pair<int, NodePtr> &a, const std::pair<int, NodePtr> &b) { return a.first < b.first; });
+		p->SetChild (children[0].second);
+		for (size_t j = 0; j + 1 < children.size(); j++)
+			children[j].second->SetSibling (children[j + 1].second);
+		children.back().second->SetSibling (NULL);
+		smallest[p] = children[0].first;
+	}
+	t.Invalidate (tcNodeList);
+}
+
+
+//------------------------------------------------------------------------------
+void UniqueTopologies::Clear ()
+{
+	Index.clear ();
+	Hashes.clear ();
+	Counts.clear ();
+	FirstTree.clear ();
+	TopologyOfTree.clear ();
+}
+
+//------------------------------------------------------------------------------
+int UniqueTopologies::add (const TopologyHash &h)
+{
+	std::pair<std::unordered_map<TopologyHash, int, TopologyHashHasher>::iterator, bool> r
+		= Index.insert (std::make_pair (h, (int)Hashes.size()));
+	int i = r.first->second;
+	if (r.second)
+	{
+		Hashes.push_back (h);
+		Counts.push_back (0);
+		FirstTree.push_back ((int)TopologyOfTree.size());
+	}
+	Counts[i]++;
+	TopologyOfTree.push_back (i);
+	return i;
+}
+
+//------------------------------------------------------------------------------
+int UniqueTopologies::Add (Tree &t)
+{
+	return add (Hasher.Hash (t));
+}
+
+//------------------------------------------------------------------------------
+// Leaves are numbered from the first tree before the threads start; a tree
+// with a label that has not been seen is hashed again afterwards, in order.
+void UniqueTopologies::Add (const std::vector<Tree *> &trees, int threads)
+{
+	if (trees.empty ())
+		return;
+	Hasher.Hash (*trees[0]);
+
+	std::vector<TopologyHash> hashes (trees.size());
+	std::vector<char> hashed (trees.size(), 0);
+	ParallelFor ((int)trees.size(), [&](int i, int)
+		{
+			hashed[i] = Hasher.Hash (*trees[i], hashes[i]) ? 1 : 0;
+		}, threads);
+
+	for (size_t i = 0; i < trees.size(); i++)
+		add (hashed[i] ? hashes[i] : Hasher.Hash (*trees[i]));
+}
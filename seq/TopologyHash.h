@@ -0,0 +1,147 @@
+/*
+ * TopologyHash
+ * Canonical hashes of tree topologies, and de-duplication of tree samples.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TOPOLOGYHASH_H
+#define TOPOLOGYHASH_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+struct TopologyHash
+{
+	unsigned long long	High;
+	unsigned long long	Low;
+
+	TopologyHash () { High = Low = 0; };
+
+	bool operator== (const TopologyHash &h) const { return High == h.High && Low == h.Low; };
+	bool operator!= (const TopologyHash &h) const { return !(*this == h); };
+	bool operator< (const TopologyHash &h) const { return High < h.High || (High == h.High && Low < h.Low); };
+};
+
+struct TopologyHashHasher
+{
+	size_t operator() (const TopologyHash &h) const { return (size_t)(h.Low ^ (h.High >> 7)); };
+};
+
+
+//------------------------------------------------------------------------------
+// Leaves are numbered by label (in the order labels are first seen, or as set
+// by SetLeaves), and the canonical form orders each node's children by the
+// smallest leaf index below them. The hash is built in one postorder pass:
+// a leaf hashes its index, and an internal node folds its children's hashes
+// in canonical order into two independent 64-bit lanes. Edge lengths are
+// ignored, and nodes with a single child are passed through.
+//
+// Unrooted topologies (the default) are hashed as if rooted at the leaf with
+// the smallest index, so trees that differ only in where they were rooted,
+// or in having a basal bifurcation rather than a trifurcation, hash the same.
+class TopologyHasher
+{
+public:
+	TopologyHasher (bool rooted = false) { Rooted = rooted; };
+	virtual ~TopologyHasher () {};
+
+	virtual void	SetRooted (bool on) { Rooted = on; };
+	virtual bool	IsRooted () const { return Rooted; };
+
+	// Number leaves in this order rather than as they are met
+	virtual void	SetLeaves (const std::vector<std::string> &labels);
+	// Index of label, added if it is new
+	virtual int		GetLeafIndex (const std::string &label);
+	virtual int		GetNumLeaves () const { return (int)LeafIndex.size(); };
+
+	virtual TopologyHash Hash (Tree &t);
+	// As Hash, but fails (returning false) rather than number a new label, so
+	// it can be called from several threads at once
+	virtual bool	Hash (Tree &t, TopologyHash &h) const;
+
+	// Reorder the children of every node of t into canonical order (as a
+	// rooted tree, t is not rerooted)
+	virtual void	Canonicalize (Tree &t);
+
+protected:
+	bool								Rooted;
+	std::unordered_map<std::string, int> LeafIndex;
+
+	// Per call workspace, so that const hashing is thread safe
+	struct Workspace
+	{
+		std::vector<NodePtr>	Nodes;
+		std::vector<int>		Leaf;		// leaf index, or -1
+		std::vector<int>		Start;		// neighbours of node i are
+		std::vector<int>		Neighbour;	// Neighbour[Start[i] .. Start[i + 1])
+		std::vector<int>		Order;		// preorder from the hashing root
+		std::vector<int>		Parent;
+		std::vector<int>		Min;
+		std::vector<unsigned long long> H1, H2;
+		std::vector<std::pair<int, int> > Items;
+	};
+
+	void			addLeaves (Workspace &w);
+	bool			findLeaves (Workspace &w) const;
+	void			fold (TopologyHash &h, Workspace &w) const;
+};
+
+
+//------------------------------------------------------------------------------
+// A collection of trees reduced to its distinct topologies, with the number
+// of trees having each one and the first tree (in order added) that has it,
+// so later work can be done once per topology and weighted by count.
+// Topologies are compared by hash alone; with 128 bits a collision between
+// different topologies is vanishingly unlikely.
+class UniqueTopologies
+{
+public:
+	UniqueTopologies (bool rooted = false) : Hasher (rooted) {};
+	virtual ~UniqueTopologies () {};
+
+	virtual void	Clear ();
+
+	// Add a tree, returning the index of its topology
+	virtual int		Add (Tree &t);
+	// Add trees, hashing them in parallel; topologies are numbered in the
+	// order the trees are given, as if they had been added one at a time
+	virtual void	Add (const std::vector<Tree *> &trees, int threads = 0);
+
+	virtual int		GetNumTopologies () const { return (int)Hashes.size(); };
+	virtual int		GetNumTrees () const { return (int)TopologyOfTree.size(); };
+	virtual const TopologyHash &GetHash (int i) const { return Hashes[i]; };
+	virtual int		GetCount (int i) const { return Counts[i]; };
+	// Index (among all trees added) of the first tree with topology i
+	virtual int		GetFirstTree (int i) const { return FirstTree[i]; };
+	// Topology of each tree added
+	virtual const std::vector<int> &GetTopologyOfTrees () const { return TopologyOfTree; };
+
+	TopologyHasher	&GetHasher () { return Hasher; };
+
+protected:
+	TopologyHasher		Hasher;
+	std::unordered_map<TopologyHash, int, TopologyHashHasher> Index;
+	std::vector<TopologyHash>	Hashes;
+	std::vector<int>	Counts;
+	std::vector<int>	FirstTree;
+	std::vector<int>	TopologyOfTree;
+
+	int				add (const TopologyHash &h);
+};
+
+
+#endif // TOPOLOGYHASH_H
@@ -0,0 +1,218 @@
+/*
+ * Trace
+ * Scoped timers and counters for profiling the tree pipeline.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "Trace.h"
+
+#include <atomic>
+#include <fstream>
+
+
+static std::atomic<TraceSession *> activeSession (NULL);
+static std::atomic<int> nextThread (0);
+
+static thread_local int threadIndex = -1;
+static thread_local long long allocatedBytes = 0;
+
+//------------------------------------------------------------------------------
+static int currentThread ()
+{
+	if (threadIndex < 0)
+		threadIndex = nextThread++;
+	return threadIndex;
+}
+
+//------------------------------------------------------------------------------
+static void writeString (std::ostream &f, const char *s)
+{
+	f << '"';
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			f << '\\';
+		if ((unsigned char)*s >= 0x20)
+			f << *s;
+	}
+	f << '"';
+}
+
+
+//------------------------------------------------------------------------------
+TraceSession::TraceSession ()
+{
+	Origin = std::chrono::steady_clock::now ();
+}
+
+//------------------------------------------------------------------------------
+TraceSession::~TraceSession ()
+{
+	Stop ();
+}
+
+//------------------------------------------------------------------------------
+void TraceSession::Start ()
+{
+	{
+		std::lock_guard<std::mutex> guard (Lock);
+		Events.clear ();
+		Origin = std::chrono::steady_clock::now ();
+	}
+	activeSession = this;
+}
+
+//------------------------------------------------------------------------------
+void TraceSession::Stop ()
+{
+	TraceSession *self = this;
+	activeSession.compare_exchange_strong (self, NULL);
+}
+
+//------------------------------------------------------------------------------
+bool TraceSession::IsActive () const
+{
+	return activeSession == this;
+}
+
+//------------------------------------------------------------------------------
+TraceSession *TraceSession::GetActive ()
+{
+	return activeSession;
+}
+
+//------------------------------------------------------------------------------
+long long TraceSession::Now () const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>
+		(std::chrono::steady_clock::now () - Origin).count ();
+}
+
+//------------------------------------------------------------------------------
+void TraceSession::Record (TraceEvent &e)
+{
+	std::lock_guard<std::mutex> guard (Lock);
+	Events.push_back (TraceEvent ());
+	std::swap (Events.back(), e);
+}
+
+//------------------------------------------------------------------------------
+size_t TraceSession::GetNumEvents () const
+{
+	std::lock_guard<std::mutex> guard (Lock);
+	return Events.size ();
+}
+
+//------------------------------------------------------------------------------
+void TraceSession::Write (std::ostream &f) const
+{
+	std::lock_guard<std::mutex> guard (Lock);
+	f << "{\"traceEvents\":[";
+	for (size_t i = 0; i < Events.size(); i++)
+	{
+		const TraceEvent &e = Events[i];
+		if (i > 0)
+			f << ',';
+		f << "\n{\"name\":";
+		writeString (f, e.Name);
+		f << ",\"cat\":\"treelib\",\"ph\":\"" << e.Phase << "\",\"pid\":1,\"tid\":" << e.Thread
+			<< ",\"ts\":" << e.Start;
+		if (e.Phase == 'X')
+			f << ",\"dur\":" << e.Duration;
+		if (!e.Args.empty ())
+		{
+			f << ",\"args\":{";
+			for (size_t j = 0; j < e.Args.size(); j++)
+			{
+				if (j > 0)
+					f << ',';
+				writeString (f, e.Args[j].first);
+				f << ':' << e.Args[j].second;
+			}
+			f << '}';
+		}
+		f << '}';
+	}
+	f << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+//------------------------------------------------------------------------------
+bool TraceSession::Write (const std::string &filename) const
+{
+	std::ofstream f (filename.c_str());
+	if (!f)
+		return false;
+	Write (f);
+	return f.good ();
+}
+
+
+//------------------------------------------------------------------------------
+TraceScope::TraceScope (const char *name)
+{
+	Session = TraceSession::GetActive ();
+	if (!Session)
+		return;
+	Event.Name = name;
+	Event.Phase = 'X';
+	Event.Thread = currentThread ();
+	Event.Start = Session->Now ();
+	Event.Duration = 0;
+	Allocated = allocatedBytes;
+}
+
+//------------------------------------------------------------------------------
+TraceScope::~TraceScope ()
+{
+	if (!Session || TraceSession::GetActive () != Session)
+		return;
+	Event.Duration = Session->Now () - Event.Start;
+	if (allocatedBytes > Allocated)
+		Event.Args.push_back (std::make_pair ("alloc_bytes", allocatedBytes - Allocated));
+	Session->Record (Event);
+}
+
+//------------------------------------------------------------------------------
+void TraceScope::AddArg (const char *key, long long value)
+{
+	if (Session)
+		Event.Args.push_back (std::make_pair (key, value));
+}
+
+
+//------------------------------------------------------------------------------
+void TraceCounter (const char *name, long long value)
+{
+	TraceSession *session = TraceSession::GetActive ();
+	if (!session)
+		return;
+	TraceEvent e;
+	e.Name = name;
+	e.Phase = 'C';
+	e.Thread = currentThread ();
+	e.Start = session->Now ();
+	e.Duration = 0;
+	e.Args.push_back (std::make_pair (name, value));
+	session->Record (e);
+}
+
+//------------------------------------------------------------------------------
+void TraceAllocated (long long bytes)
+{
+	allocatedBytes += bytes;
+}
+
+//------------------------------------------------------------------------------
+long long TraceAllocatedBytes ()
+{
+	return allocatedBytes;
+}
@@ -0,0 +1,123 @@
+/*
+ * Trace
+ * Scoped timers and counters for profiling the tree pipeline.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+//------------------------------------------------------------------------------
+// Instrumentation is compiled in only when TREELIB_TRACE is defined; otherwise
+// the macros below expand to nothing and their arguments are not evaluated.
+//
+//	TREELIB_TRACE_SCOPE (s, "NJ")		time from here to the end of the block
+//	TREELIB_TRACE_ARG (s, "taxa", n)	attach a count to scope s
+//	TREELIB_TRACE_COUNTER ("pairs", n)	a counter sample
+//	TREELIB_TRACE_ALLOC (bytes)			count an allocation
+//
+// Scopes record the bytes counted by TREELIB_TRACE_ALLOC on their own thread
+// while they were open ("alloc_bytes"). Events go to the active TraceSession,
+// if there is one, and are dropped otherwise.
+#ifdef TREELIB_TRACE
+	#define TREELIB_TRACE_SCOPE(var, name)		TraceScope var (name)
+	#define TREELIB_TRACE_ARG(var, key, value)	var.AddArg (key, (long long)(value))
+	#define TREELIB_TRACE_COUNTER(name, value)	TraceCounter (name, (long long)(value))
+	#define TREELIB_TRACE_ALLOC(bytes)			TraceAllocated ((long long)(bytes))
+#else
+	#define TREELIB_TRACE_SCOPE(var, name)
+	#define TREELIB_TRACE_ARG(var, key, value)	((void)0)
+	#define TREELIB_TRACE_COUNTER(name, value)	((void)0)
+	#define TREELIB_TRACE_ALLOC(bytes)			((void)0)
+#endif
+
+
+struct TraceEvent
+{
+	const char		*Name;		// a string literal
+	char			Phase;		// 'X' (complete) or 'C' (counter)
+	int				Thread;
+	long long		Start;		// microseconds since the session started
+	long long		Duration;
+	std::vector<std::pair<const char *, long long> > Args;
+};
+
+
+//------------------------------------------------------------------------------
+// Collects the events of one request. Start makes the session the active one
+// (there is one at a time per process) and Stop detaches it; Write gives the
+// Chrome trace event format, which chrome://tracing and Perfetto load.
+// Scopes still open when the session stops are dropped, so stop it once the
+// request's work has finished.
+class TraceSession
+{
+public:
+	TraceSession ();
+	virtual ~TraceSession ();
+
+	virtual void	Start ();
+	virtual void	Stop ();
+	virtual bool	IsActive () const;
+
+	virtual void	Write (std::ostream &f) const;
+	virtual bool	Write (const std::string &filename) const;
+
+	virtual size_t	GetNumEvents () const;
+
+	// Thread safe
+	void			Record (TraceEvent &e);
+	long long		Now () const;
+
+	static TraceSession *GetActive ();
+
+protected:
+	std::chrono::steady_clock::time_point	Origin;
+	mutable std::mutex						Lock;
+	std::vector<TraceEvent>					Events;
+};
+
+
+//------------------------------------------------------------------------------
+class TraceScope
+{
+public:
+	TraceScope (const char *name);
+	~TraceScope ();
+
+	void	AddArg (const char *key, long long value);
+
+protected:
+	TraceSession	*Session;
+	TraceEvent		Event;
+	long long		Allocated;
+
+	TraceScope (const TraceScope &);
+	TraceScope &operator= (const TraceScope &);
+};
+
+
+void		TraceCounter (const char *name, long long value);
+void		TraceAllocated (long long bytes);
+// Bytes counted so far on the calling thread
+long long	TraceAllocatedBytes ();
+
+
+#endif // TRACE_H
@@ -0,0 +1,386 @@
+/*
+ * TreeBuilder
+ * Build TreeLib trees from distance matrices.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "TreeBuilder.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+
+//------------------------------------------------------------------------------
+NodePtr DistanceTreeBuilder::MakeLeaf (Tree &t, const DistanceMatrix &D, int i)
+{
+	NodePtr p = t.NewNode ();
+	p->SetLeaf (true);
+	p->SetLabel (D.GetLabel (i));
+	p->SetLeafNumber (i + 1);
+	p->SetWeight (1);
+	return p;
+}
+
+//------------------------------------------------------------------------------
+NodePtr DistanceTreeBuilder::MakeInternal (Tree &t)
+{
+	return t.NewNode ();
+}
+
+//------------------------------------------------------------------------------
+// Make child the rightmost child of parent
+void DistanceTreeBuilder::AddChild (NodePtr parent, NodePtr child, float length)
+{
+	child->SetAnc (parent);
+	child->SetSibling (NULL);
+	child->SetEdgeLength (length);
+	if (parent->GetChild() == NULL)
+		parent->SetChild (child);
+	else
+		parent->GetChild()->GetRightMostSibling()->SetSibling (child);
+}
+
+//------------------------------------------------------------------------------
+// Install root and fill in weights, degrees, counts and the node list
+void DistanceTreeBuilder::Finish (Tree &t, NodePtr root, bool rooted)
+{
+	t.SetRoot (root);
+	t.SetEdgeLengths (true);
+	t.SetRooted (rooted);
+	t.Update ();
+	t.MakeNodeList ();
+}
+
+//------------------------------------------------------------------------------
+void DistanceTreeBuilder::WorkingCopy (const DistanceMatrix &D, DistanceMatrix &d)
+{
+	int n = D.GetSize ();
+	TREELIB_TRACE_SCOPE (trace, "WorkingCopy");
+	TREELIB_TRACE_ARG (trace, "taxa", n);
+	if (ScratchFile.empty () || !d.MapFile (ScratchFile, n))
+		d.SetSize (n);
+	for (int i = 1; i < n; i++)
+	{
+		const float *src = D.GetRow (i);
+		float *dst = d.GetRow (i);
+		for (int j = 0; j < i; j++)
+			dst[j] = src[j];
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void NJBuilder::Build (const DistanceMatrix &D, Tree &t)
+{
+	int n = D.GetSize ();
+	TREELIB_TRACE_SCOPE (trace, "NJBuilder::Build");
+	TREELIB_TRACE_ARG (trace, "taxa", n);
+	if (n == 0)
+		return;
+
+	std::vector<NodePtr> cluster (n);
+	for (int i = 0; i < n; i++)
+		cluster[i] = MakeLeaf (t, D, i);
+
+	if (n == 1)
+	{
+		Finish (t, cluster[0], false);
+		return;
+	}
+	if (n == 2)
+	{
+		NodePtr root = MakeInternal (t);
+		float half = D.Get (0, 1) / 2.0f;
+		AddChild (root, cluster[0], half);
+		AddChild (root, cluster[1], half);
+		Finish (t, root, false);
+		return;
+	}
+
+	// Working copy of the lower triangle, in memory or in the scratch file,
+	// with row sums over the active clusters
+	DistanceMatrix d;
+	WorkingCopy (D, d);
+	std::vector<double> r (n, 0.0);
+	for (int i = 1; i < n; i++)
+	{
+		const float *di = d.GetRow (i);
+		for (int j = 0; j < i; j++)
+		{
+			r[i] += di[j];
+			r[j] += di[j];
+		}
+	}
+
+	// Retired rows stay in the triangle; giving them a huge negative row sum
+	// means Q for any pair involving them is never the minimum, so the scan
+	// below can read each row straight through
+	const double retired = -1.0e300;
+	std::vector<char> alive (n, 1);
+
+	int m = n;
+	while (m > 3)
+	{
+		// Pair minimising Q(i,j) = (m - 2) d(i,j) - r(i) - r(j)
+		int bestI = 1, bestJ = 0;
+		double bestQ = 0.0;
+		bool first = true;
+		for (int i = 1; i < n; i++)
+		{
+			if (!alive[i])
+				continue;
+			const float *di = d.GetRow (i);
+			double ri = r[i];
+			for (int j = 0; j < i; j++)
+			{
+				double q = (m - 2) * (double)di[j] - ri - r[j];
+				if (first || q < bestQ)
+				{
+					bestQ = q;
+					bestI = i;
+					bestJ = j;
+					first = false;
+				}
+			}
+		}
+
+		int i = bestI;
+		int j = bestJ;
+		double dij = d.Get (i, j);
+		double li = 0.5 * dij + (r[i] - r[j]) / (2.0 * (m - 2));
+		double lj = dij - li;
+		if (!(li > 0.0)) li = 0.0;	// also catches -0
+		if (!(lj > 0.0)) lj = 0.0;
+
+		NodePtr u = MakeInternal (t);
+		AddChild (u, cluster[i], (float)li);
+		AddChild (u, cluster[j], (float)lj);
+
+		// The new cluster takes over row j, row i is retired
+		double ru = 0.0;
+		for (int k = 0; k < n; k++)
+		{
+			if (!alive[k] || k == i || k == j)
+				continue;
+			double dik = d.Get (i, k);
+			double djk = d.Get (j, k);
+			double duk = 0.5 * (dik + djk - dij);
+			r[k] += duk - dik - djk;
+			d.Set (j, k, (float)duk);
+			ru += duk;
+		}
+		r[j] = ru;
+		cluster[j] = u;
+		alive[i] = 0;
+		r[i] = retired;
+		m--;
+	}
+
+	// Join the last three clusters at the root
+	int last[3], c = 0;
+	for (int k = 0; k < n && c < 3; k++)
+		if (alive[k])
+			last[c++] = k;
+	int a = last[0], b = last[1];
+	c = last[2];
+	double dab = d.Get (a, b);
+	double dac = d.Get (a, c);
+	double dbc = d.Get (b, c);
+	double la = 0.5 * (dab + dac - dbc);
+	double lb = 0.5 * (dab + dbc - dac);
+	double lc = 0.5 * (dac + dbc - dab);
+
+	NodePtr root = MakeInternal (t);
+	AddChild (root, cluster[a], (float)(la > 0.0 ? la : 0.0));
+	AddChild (root, cluster[b], (float)(lb > 0.0 ? lb : 0.0));
+	AddChild (root, cluster[c], (float)(lc > 0.0 ? lc : 0.0));
+	Finish (t, root, false);
+}
+
+
+//------------------------------------------------------------------------------
+void UPGMABuilder::Build (const DistanceMatrix &D, Tree &t)
+{
+	int n = D.GetSize ();
+	TREELIB_TRACE_SCOPE (trace, "UPGMABuilder::Build");
+	TREELIB_TRACE_ARG (trace, "taxa", n);
+	if (n == 0)
+		return;
+
+	std::vector<NodePtr> cluster (n);
+	for (int i = 0; i < n; i++)
+		cluster[i] = MakeLeaf (t, D, i);
+	if (n == 1)
+	{
+		Finish (t, cluster[0], true);
+		return;
+	}
+
+	DistanceMatrix d;
+	WorkingCopy (D, d);
+	std::vector<int> size (n, 1);
+	std::vector<double> height (n, 0.0);
+	std::vector<char> alive (n, 1);
+	std::vector<int> chain;
+	chain.reserve (n);
+	int remaining = n;
+	int firstAlive = 0;
+
+	while (remaining > 1)
+	{
+		if (chain.empty ())
+		{
+			while (!alive[firstAlive])
+				firstAlive++;
+			chain.push_back (firstAlive);
+		}
+
+		// Nearest neighbour of the top of the chain, preferring the previous
+		// cluster on the chain in case of ties, so the chain cannot cycle
+		int a = chain.back ();
+		int prev = (chain.size() > 1) ? chain[chain.size() - 2] : -1;
+		int b = prev;
+		double best = (prev >= 0) ? d.Get (a, prev) : 0.0;
+		for (int k = 0; k < n; k++)
+		{
+			if (!alive[k] || k == a)
+				continue;
+			double dak = d.Get (a, k);
+			if (b < 0 || dak < best)
+			{
+				best = dak;
+				b = k;
+			}
+		}
+
+		if (b != prev)
+		{
+			chain.push_back (b);
+			continue;
+		}
+
+		// a and b are reciprocal nearest neighbours
+		chain.pop_back ();
+		chain.pop_back ();
+
+		double h = 0.5 * best;
+		NodePtr u = MakeInternal (t);
+		AddChild (u, cluster[a], (float)std::max (0.0, h - height[a]));
+		AddChild (u, cluster[b], (float)std::max (0.0, h - height[b]));
+
+		// The new cluster takes over the lower of the two rows
+		int keep = std::min (a, b);
+		int drop = std::max (a, b);
+		for (int k = 0; k < n; k++)
+		{
+			if (!alive[k] || k == a || k == b)
+				continue;
+			d.Set (keep, k, (float)Linkage (d.Get (a, k), d.Get (b, k), size[a], size[b]));
+		}
+		size[keep] = size[a] + size[b];
+		height[keep] = h;
+		cluster[keep] = u;
+		alive[drop] = 0;
+		remaining--;
+	}
+
+	int last = 0;
+	while (!alive[last])
+		last++;
+	Finish (t, cluster[last], true);
+}
+
+
+//------------------------------------------------------------------------------
+void SingleLinkageBuilder::Build (const DistanceMatrix &D, Tree &t)
+{
+	int n = D.GetSize ();
+	TREELIB_TRACE_SCOPE (trace, "SingleLinkageBuilder::Build");
+	TREELIB_TRACE_ARG (trace, "taxa", n);
+	if (n == 0)
+		return;
+
+	std::vector<NodePtr> cluster (n);
+	for (int i = 0; i < n; i++)
+		cluster[i] = MakeLeaf (t, D, i);
+	if (n == 1)
+	{
+		Finish (t, cluster[0], true);
+		return;
+	}
+
+	// Prim's algorithm: nearest[k] is the distance from k to the tree so far,
+	// via[k] the tree vertex it is nearest to
+	struct Edge
+	{
+		float	Length;
+		int		From;
+		int		To;
+		bool operator< (const Edge &e) const { return Length < e.Length; };
+	};
+	std::vector<Edge> edges;
+	edges.reserve (n - 1);
+	std::vector<float> nearest (n, 0.0f);
+	std::vector<int> via (n, 0);
+	std::vector<char> inTree (n, 0);
+	inTree[0] = 1;
+	for (int k = 1; k < n; k++)
+		nearest[k] = D.Get (0, k);
+
+	for (int step = 1; step < n; step++)
+	{
+		int next = -1;
+		for (int k = 0; k < n; k++)
+			if (!inTree[k] && (next < 0 || nearest[k] < nearest[next]))
+				next = k;
+		Edge e = { nearest[next], via[next], next };
+		edges.push_back (e);
+		inTree[next] = 1;
+		for (int k = 0; k < n; k++)
+		{
+			if (inTree[k])
+				continue;
+			float dk = D.Get (next, k);
+			if (dk < nearest[k])
+			{
+				nearest[k] = dk;
+				via[k] = next;
+			}
+		}
+	}
+
+	// Join shortest edges first, tracking clusters with union-find
+	std::stable_sort (edges.begin(), edges.end());
+	std::vector<int> parent (n);
+	std::vector<double> height (n, 0.0);
+	for (int i = 0; i < n; i++)
+		parent[i] = i;
+	int root = 0;
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		int a = edges[i].From, b = edges[i].To;
+		while (parent[a] != a)
+			a = parent[a] = parent[parent[a]];
+		while (parent[b] != b)
+			b = parent[b] = parent[parent[b]];
+
+		double h = 0.5 * edges[i].Length;
+		NodePtr u = MakeInternal (t);
+		AddChild (u, cluster[a], (float)std::max (0.0, h - height[a]));
+		AddChild (u, cluster[b], (float)std::max (0.0, h - height[b]));
+		parent[b] = a;
+		cluster[a] = u;
+		height[a] = h;
+		root = a;
+	}
+	Finish (t, cluster[root], true);
+}
@@ -0,0 +1,130 @@
+/*
+ * TreeBuilder
+ * Build TreeLib trees from distance matrices.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TREEBUILDER_H
+#define TREEBUILDER_H
+
+#include <string>
+#include <vector>
+
+#include "TreeLib.h"
+#include "DistanceMatrix.h"
+
+
+//------------------------------------------------------------------------------
+// Base class for distance-based tree builders. Build expects an empty Tree
+// and leaves it with edge lengths, leaf i of the matrix as leaf number i + 1
+// and the node list made, so t[i] is the leaf for matrix row i.
+class DistanceTreeBuilder
+{
+public:
+	DistanceTreeBuilder () {};
+	virtual ~DistanceTreeBuilder () {};
+
+	virtual void	Build (const DistanceMatrix &D, Tree &t) = 0;
+
+	// Builders that update a working copy of the matrix keep it in filename
+	// rather than in memory; if the file cannot be mapped the copy falls back
+	// to memory
+	virtual void	SetScratchFile (const std::string &filename) { ScratchFile = filename; };
+
+protected:
+	std::string		ScratchFile;
+
+	virtual NodePtr	MakeLeaf (Tree &t, const DistanceMatrix &D, int i);
+	virtual NodePtr	MakeInternal (Tree &t);
+	virtual void	AddChild (NodePtr parent, NodePtr child, float length);
+	virtual void	Finish (Tree &t, NodePtr root, bool rooted);
+	// Copy D into d, mapped to the scratch file if there is one
+	virtual void	WorkingCopy (const DistanceMatrix &D, DistanceMatrix &d);
+};
+
+
+//------------------------------------------------------------------------------
+// Neighbour joining (Saitou & Nei 1987, Studier & Keppler 1988). The result
+// is unrooted, with a basal trifurcation. Negative edge lengths are set to 0.
+//
+// NJ works on a copy of the lower triangle that it updates as clusters are
+// joined, reading it a row at a time. For matrices too big for memory set a
+// scratch file and the copy is memory mapped there (D itself can also be
+// mapped, see DistanceMatrix::MapFile).
+class NJBuilder : public DistanceTreeBuilder
+{
+public:
+	NJBuilder () {};
+	virtual ~NJBuilder () {};
+
+	virtual void	Build (const DistanceMatrix &D, Tree &t);
+};
+
+
+//------------------------------------------------------------------------------
+// Average linkage clustering by the nearest-neighbour chain algorithm
+// (Murtagh 1983): follow nearest neighbours from any cluster until two
+// clusters are each other's nearest neighbour, join them, and carry on from
+// what is left of the chain. Every join takes O(n), so the whole tree takes
+// O(n^2) time, with the same working matrix as NJ.
+//
+// Trees are rooted and ultrametric: two clusters joined at distance d meet at
+// height d / 2.
+class UPGMABuilder : public DistanceTreeBuilder
+{
+public:
+	UPGMABuilder () {};
+	virtual ~UPGMABuilder () {};
+
+	virtual void	Build (const DistanceMatrix &D, Tree &t);
+
+protected:
+	// Distance from the union of a and b (of na and nb leaves) to a third
+	// cluster, given the distances from a and b to it
+	virtual double	Linkage (double da, double db, int na, int nb) const
+	{
+		return (na * da + nb * db) / (na + nb);
+	};
+};
+
+//------------------------------------------------------------------------------
+// As UPGMA, but the two clusters being joined get equal weight whatever
+// their size
+class WPGMABuilder : public UPGMABuilder
+{
+public:
+	WPGMABuilder () {};
+	virtual ~WPGMABuilder () {};
+
+protected:
+	virtual double	Linkage (double da, double db, int, int) const
+	{
+		return 0.5 * (da + db);
+	};
+};
+
+//------------------------------------------------------------------------------
+// Single linkage clustering from a minimum spanning tree (Prim's algorithm
+// on the full matrix, O(n^2) time and O(n) memory besides the matrix, which
+// is only read). Joining the tree's edges shortest first gives the single
+// linkage hierarchy. Heights are half the joining distance, as for UPGMA.
+class SingleLinkageBuilder : public DistanceTreeBuilder
+{
+public:
+	SingleLinkageBuilder () {};
+	virtual ~SingleLinkageBuilder () {};
+
+	virtual void	Build (const DistanceMatrix &D, Tree &t);
+};
+
+
+#endif // TREEBUILDER_H
@@ -0,0 +1,195 @@
+/*
+ * TreeCluster
+ * Cut a tree into clusters of leaves at a distance threshold (OTUs).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "TreeCluster.h"
+
+#include <algorithm>
+
+
+//------------------------------------------------------------------------------
+bool TreeClusters::Compute (Tree &t, ClusterCriterion criterion)
+{
+	Criterion = criterion;
+	Nodes.clear ();
+	Parent.clear ();
+	Cluster.clear ();
+	First.assign (1, 0);
+	Members.clear ();
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return false;
+	bool lengths = t.GetHasEdgeLengths ();
+
+	// Preorder, so leaves come out in the order they are drawn
+	t.GetPreorder (Nodes, Parent);
+
+	int n = (int)Nodes.size();
+	int leaves = 0;
+	LeafIndex.assign (n, -1);
+	for (int i = 0; i < n; i++)
+		if (Nodes[i]->GetChild () == NULL)
+			leaves++;
+	Leaves.assign (leaves, (NodePtr)NULL);
+	for (int i = 0; i < n; i++)
+		if (Nodes[i]->GetChild () == NULL)
+		{
+			int leaf = Nodes[i]->GetLeafNumber () - 1;
+			if (leaf < 0 || leaf >= leaves || Leaves[leaf])
+			{
+				Nodes.clear ();
+				return false;
+			}
+			LeafIndex[i] = leaf;
+			Leaves[leaf] = Nodes[i];
+		}
+
+	// Children before parents: Deep is the longest path down to a leaf and
+	// Deep2 the longest through a different child, so the diameter through a
+	// node is Deep + Deep2
+	std::vector<double> deep (n, 0.0), deep2 (n, 0.0);
+	Value.assign (n, 0.0);
+	for (int i = n - 1; i > 0; i--)
+	{
+		double d = 1.0;
+		if (lengths)
+			d = (Nodes[i]->GetEdgeLength () > 0.0f) ? Nodes[i]->GetEdgeLength () : 0.0;
+		double down = deep[i] + d;
+		int p = Parent[i];
+		if (down > deep[p])
+		{
+			deep2[p] = deep[p];
+			deep[p] = down;
+		}
+		else if (down > deep2[p])
+			deep2[p] = down;
+
+		if (criterion == ccDiameter)
+		{
+			double through = deep[i] + deep2[i];
+			if (through > Value[i])
+				Value[i] = through;
+			if (Value[i] > Value[p])
+				Value[p] = Value[i];
+		}
+		else
+			Value[i] = deep[i];
+	}
+	Value[0] = (criterion == ccDiameter)
+		? std::max (Value[0], deep[0] + deep2[0]) : deep[0];
+	return true;
+}
+
+//------------------------------------------------------------------------------
+int TreeClusters::Cut (double threshold)
+{
+	int n = (int)Nodes.size();
+	Cluster.assign (Leaves.size(), -1);
+	First.clear ();
+	Members.clear ();
+
+	// A node is in its parent's cluster if the parent has one, otherwise it
+	// heads a new cluster if it is small enough (leaves always are)
+	std::vector<int> node (n, -1);
+	for (int i = 0; i < n; i++)
+	{
+		int p = Parent[i];
+		if (p >= 0 && node[p] >= 0)
+			node[i] = node[p];
+		else if (LeafIndex[i] >= 0 || Value[i] <= threshold)
+		{
+			node[i] = (int)First.size();
+			First.push_back ((int)Members.size());
+		}
+		if (LeafIndex[i] >= 0)
+		{
+			Cluster[LeafIndex[i]] = node[i];
+			Members.push_back (LeafIndex[i]);
+		}
+	}
+	First.push_back ((int)Members.size());
+	return (int)First.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+void TreeClusters::Sweep (const std::vector<double> &thresholds, std::vector<int> &counts) const
+{
+	// Internal nodes head a cluster for value <= x < parent's value, leaves
+	// for x < parent's value
+	int n = (int)Nodes.size();
+	std::vector<double> lo, hi;
+	int leaves = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (LeafIndex[i] >= 0)
+			leaves++;
+		else
+			lo.push_back (Value[i]);
+		if (Parent[i] >= 0)
+			hi.push_back (Value[Parent[i]]);
+	}
+	std::sort (lo.begin(), lo.end());
+	std::sort (hi.begin(), hi.end());
+
+	counts.resize (thresholds.size());
+	for (size_t k = 0; k < thresholds.size(); k++)
+	{
+		double x = thresholds[k];
+		int below = (int)(std::upper_bound (lo.begin(), lo.end(), x) - lo.begin());
+		int closed = (int)(std::upper_bound (hi.begin(), hi.end(), x) - hi.begin());
+		counts[k] = leaves + below - closed;
+	}
+}
+
+//------------------------------------------------------------------------------
+void TreeClusters::Compare (const std::vector<int> &reference, int &match, int &split, int &lumped) const
+{
+	match = split = lumped = 0;
+	std::vector<std::pair<int, int> > pairs;
+	for (size_t i = 0; i < Cluster.size() && i < reference.size(); i++)
+		if (reference[i] >= 0 && Cluster[i] >= 0)
+			pairs.push_back (std::make_pair (Cluster[i], reference[i]));
+	std::sort (pairs.begin(), pairs.end());
+	pairs.erase (std::unique (pairs.begin(), pairs.end()), pairs.end());
+
+	// Number of groups in each cluster, and of clusters holding each group
+	int groups = 0;
+	for (size_t i = 0; i < pairs.size(); i++)
+		if (pairs[i].second >= groups)
+			groups = pairs[i].second + 1;
+	std::vector<int> perCluster (GetNumClusters (), 0), perGroup (groups, 0);
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		perCluster[pairs[i].first]++;
+		perGroup[pairs[i].second]++;
+	}
+
+	for (int k = 0; k < (int)perCluster.size(); k++)
+		if (perCluster[k] > 1)
+			lumped++;
+	for (int g = 0; g < groups; g++)
+		if (perGroup[g] > 1)
+			split++;
+	for (size_t i = 0; i < pairs.size(); i++)
+		if (perCluster[pairs[i].first] == 1 && perGroup[pairs[i].second] == 1)
+			match++;
+}
+
+//------------------------------------------------------------------------------
+void TreeClusters::WriteClusters (std::ostream &f) const
+{
+	for (int k = 0; k < GetNumClusters (); k++)
+		for (int m = First[k]; m < First[k + 1]; m++)
+			f << k << '\t' << Leaves[Members[m]]->GetLabel () << std::endl;
+}
@@ -0,0 +1,92 @@
+/*
+ * TreeCluster
+ * Cut a tree into clusters of leaves at a distance threshold (OTUs).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TREECLUSTER_H
+#define TREECLUSTER_H
+
+#include <iostream>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+enum ClusterCriterion
+{
+	ccDiameter,		// greatest patristic distance between two leaves of the clade
+	ccHeight		// greatest distance from the clade's root to one of its leaves
+};
+
+
+//------------------------------------------------------------------------------
+// Clusters are the largest clades whose diameter (or height) is at most the
+// threshold, so every leaf is in exactly one cluster. Distances are edge
+// lengths, or edge counts if the tree has none.
+//
+// Compute () gives every node its diameter or height in one postorder pass.
+// Negative edge lengths (which NJ can give) count as zero, so values never
+// decrease towards the root and a node heads a cluster at threshold x exactly
+// when value <= x < parent's value. Cut () is then one preorder pass, and
+// Sweep () counts clusters for any number of thresholds from the values
+// sorted once.
+//
+// Leaves are identified by index, GetLeafNumber () - 1, which for trees from
+// the distance builders is the matrix row.
+class TreeClusters
+{
+public:
+	TreeClusters () { Criterion = ccDiameter; };
+	virtual ~TreeClusters () {};
+
+	// Returns false if t is empty or its leaf numbers are not 1 .. leaves
+	virtual bool	Compute (Tree &t, ClusterCriterion criterion = ccDiameter);
+
+	// Returns the number of clusters
+	virtual int		Cut (double threshold);
+
+	// Number of clusters at each threshold, without cutting
+	virtual void	Sweep (const std::vector<double> &thresholds, std::vector<int> &counts) const;
+
+	int				GetNumLeaves () const { return (int)Cluster.size(); };
+	int				GetNumClusters () const { return (int)First.size() - 1; };
+	int				GetCluster (int leaf) const { return Cluster[leaf]; };
+	int				GetClusterSize (int k) const { return First[k + 1] - First[k]; };
+	const int		*GetClusterLeaves (int k) const { return &Members[First[k]]; };
+	NodePtr			GetLeaf (int leaf) const { return Leaves[leaf]; };
+
+	// Agreement with a reference grouping of the leaves, such as BOLD BINs
+	// (one group number per leaf index, -1 if unknown, unknown leaves being
+	// ignored): clusters that are exactly one group, groups split between
+	// clusters, and clusters that lump groups together
+	virtual void	Compare (const std::vector<int> &reference, int &match, int &split, int &lumped) const;
+
+	// One line per leaf of the last cut: cluster number, tab, label
+	virtual void	WriteClusters (std::ostream &f) const;
+
+protected:
+	ClusterCriterion		Criterion;
+	std::vector<NodePtr>	Nodes;		// preorder
+	std::vector<int>		Parent;
+	std::vector<double>		Value;		// diameter or height
+	std::vector<int>		LeafIndex;	// per node, -1 for internals
+	std::vector<NodePtr>	Leaves;		// per leaf index
+
+	// Last cut
+	std::vector<int>		Cluster;	// per leaf index
+	std::vector<int>		First;		// cluster k's leaves are Members[First[k] .. First[k + 1])
+	std::vector<int>		Members;
+};
+
+
+#endif // TREECLUSTER_H
@@ -0,0 +1,577 @@
+/*
+ * TreeLayout
+ * Node coordinates for drawing TreeLib trees in the browser.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "TreeLayout.h"
+
+#include <cmath>
+#include <cstdio>
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+
+//------------------------------------------------------------------------------
+// Coordinates are written with one decimal place, which is plenty for pixels
+// and keeps the output small
+static inline void writeNumber (std::ostream &f, double x)
+{
+	char buf[32];
+	int n = snprintf (buf, sizeof (buf), "%.1f", x);
+	if (n > 2 && buf[n - 1] == '0' && buf[n - 2] == '.')
+		n -= 2;	// "12.0" -> "12"
+	if (n == 2 && buf[0] == '-' && buf[1] == '0')
+	{
+		buf[0] = '0';	// "-0" -> "0"
+		n = 1;
+	}
+	f.write (buf, n);
+}
+
+//------------------------------------------------------------------------------
+static void writeJSONString (std::ostream &f, const std::string &s)
+{
+	f << '"';
+	for (size_t i = 0; i < s.length(); i++)
+	{
+		unsigned char c = s[i];
+		switch (c)
+		{
+			case '"':	f << "\\\""; break;
+			case '\\':	f << "\\\\"; break;
+			case '\n':	f << "\\n"; break;
+			case '\r':	f << "\\r"; break;
+			case '\t':	f << "\\t"; break;
+			default:
+				if (c < 0x20)
+				{
+					char buf[8];
+					snprintf (buf, sizeof (buf), "\\u%04x", c);
+					f << buf;
+				}
+				else
+					f << s[i];
+				break;
+		}
+	}
+	f << '"';
+}
+
+//------------------------------------------------------------------------------
+static void writeXMLString (std::ostream &f, const std::string &s)
+{
+	for (size_t i = 0; i < s.length(); i++)
+	{
+		switch (s[i])
+		{
+			case '&':	f << "&amp;"; break;
+			case '<':	f << "&lt;"; break;
+			case '>':	f << "&gt;"; break;
+			case '"':	f << "&quot;"; break;
+			default:	f << s[i]; break;
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void TreeLayout::Compute (Tree &t, const LayoutOptions &options)
+{
+	Options = options;
+	Style = options.Style;
+	CentreX = options.Width / 2.0;
+	CentreY = options.Height / 2.0;
+
+	flatten (t);
+	if (Nodes.empty ())
+		return;
+
+	switch (Style)
+	{
+		case lsRadial:		radial (); break;
+		case lsCircular:	circular (); break;
+		default:			rectangular (); break;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Copy the tree into arrays in preorder, then fill in each node's row, leaf
+// span and deepest descendant in one reverse pass (every node comes after its
+// ancestors in preorder, so visiting backwards sees children before parents).
+void TreeLayout::flatten (Tree &t)
+{
+	Nodes.clear ();
+	Parent.clear ();
+	Depth.clear ();
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return;
+
+	// Depth is the path length from the root, or for cladograms the height
+	// as GetNodeHeights has it (leaves less the node's weight). Both are
+	// found here rather than by TreeLib, whose passes recurse.
+	bool phylogram = Options.UseEdgeLengths && t.GetHasEdgeLengths ();
+	int leaves = t.GetNumLeaves ();
+
+	t.GetPreorder (Nodes, Parent);
+	int n = (int)Nodes.size();
+	Depth.resize (n);
+	for (int i = 0; i < n; i++)
+	{
+		NodePtr p = Nodes[i];
+		if (!phylogram)
+			Depth[i] = (float)(leaves - p->GetWeight ());
+		else if (i == 0)
+			Depth[i] = 0.0f;
+		else
+		{
+			float l = p->GetEdgeLength ();
+			if (l < 0.000001)	// negative lengths count as zero, as in getPathLengths
+				l = 0.0f;
+			Depth[i] = Depth[Parent[i]] + l;
+		}
+	}
+
+	End.assign (n, 0);
+	Far.assign (Depth.begin(), Depth.end());
+	Lo.assign (n, 0.0f);
+	Hi.assign (n, 0.0f);
+	Mid.assign (n, 0.0f);
+	std::vector<float> cmin (n, HUGE_VALF), cmax (n, -HUGE_VALF);
+	std::vector<int> size (n, 1);
+
+	int leaf = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (Nodes[i]->GetChild () == NULL)
+		{
+			Lo[i] = Hi[i] = Mid[i] = (float)leaf++;
+		}
+		else
+		{
+			Lo[i] = HUGE_VALF;
+			Hi[i] = -HUGE_VALF;
+		}
+	}
+
+	for (int i = n - 1; i >= 0; i--)
+	{
+		if (Nodes[i]->GetChild () != NULL)
+			Mid[i] = 0.5f * (cmin[i] + cmax[i]);
+		End[i] = i + size[i];
+
+		int p = Parent[i];
+		if (p < 0)
+			continue;
+		size[p] += size[i];
+		if (Lo[i] < Lo[p]) Lo[p] = Lo[i];
+		if (Hi[i] > Hi[p]) Hi[p] = Hi[i];
+		if (Far[i] > Far[p]) Far[p] = Far[i];
+		if (Mid[i] < cmin[p]) cmin[p] = Mid[i];
+		if (Mid[i] > cmax[p]) cmax[p] = Mid[i];
+	}
+
+	X.assign (n, 0.0f);
+	Y.assign (n, 0.0f);
+	Angle.assign (n, 0.0f);
+	State.assign (n, nsVisible);
+	Triangle.assign ((size_t)n * 4, 0.0f);
+}
+
+//------------------------------------------------------------------------------
+// Collapse the highest clades whose leaves, spacing pixels apart, would span
+// less than MinCladeSpacing, and hide everything below them
+void TreeLayout::collapse (double spacing)
+{
+	int n = (int)Nodes.size();
+	State.assign (n, nsVisible);
+	LabelLeaves = (spacing >= Options.MinLabelSpacing);
+	if (Options.MinCladeSpacing <= 0.0)
+		return;
+
+	int i = 1;	// never collapse the root
+	while (i < n)
+	{
+		double leaves = Hi[i] - Lo[i] + 1.0;
+		if (End[i] - i > 1 && leaves * spacing < Options.MinCladeSpacing)
+		{
+			State[i] = nsCollapsed;
+			for (int j = i + 1; j < End[i]; j++)
+				State[j] = nsHidden;
+			i = End[i];
+		}
+		else
+			i++;
+	}
+}
+
+//------------------------------------------------------------------------------
+void TreeLayout::rectangular ()
+{
+	int n = (int)Nodes.size();
+	int leaves = (int)Hi[0] + 1;
+	double left = Options.Margin;
+	double top = Options.Margin;
+	double width = Options.Width - 2.0 * Options.Margin - Options.LabelSpace;
+	double height = Options.Height - 2.0 * Options.Margin;
+	if (width < 1.0) width = 1.0;
+	if (height < 1.0) height = 1.0;
+
+	double xscale = (Far[0] > Depth[0]) ? width / (Far[0] - Depth[0]) : 0.0;
+	double spacing = (leaves > 1) ? height / (leaves - 1) : 0.0;
+	if (leaves == 1)
+		top += height / 2.0;
+
+	for (int i = 0; i < n; i++)
+	{
+		X[i] = (float)(left + (Depth[i] - Depth[0]) * xscale);
+		Y[i] = (float)(top + Mid[i] * spacing);
+	}
+
+	collapse (leaves > 1 ? spacing : height);
+	for (int i = 0; i < n; i++)
+	{
+		if (State[i] != nsCollapsed)
+			continue;
+		float x = (float)(left + (Far[i] - Depth[0]) * xscale);
+		Triangle[4 * i]		= x;
+		Triangle[4 * i + 1]	= (float)(top + Lo[i] * spacing);
+		Triangle[4 * i + 2]	= x;
+		Triangle[4 * i + 3]	= (float)(top + Hi[i] * spacing);
+	}
+}
+
+//------------------------------------------------------------------------------
+// The rectangular layout with rows mapped to angles and depth to radius
+void TreeLayout::circular ()
+{
+	int n = (int)Nodes.size();
+	int leaves = (int)Hi[0] + 1;
+	double half = (Options.Width < Options.Height ? Options.Width : Options.Height) / 2.0;
+	double radius = half - Options.Margin - Options.LabelSpace;
+	if (radius < 10.0)
+		radius = 10.0;
+
+	double rscale = (Far[0] > Depth[0]) ? radius / (Far[0] - Depth[0]) : 0.0;
+	double step = 2.0 * M_PI / leaves;
+
+	for (int i = 0; i < n; i++)
+	{
+		double a = Mid[i] * step;
+		double r = (Depth[i] - Depth[0]) * rscale;
+		Angle[i] = (float)a;
+		X[i] = (float)(CentreX + r * cos (a));
+		Y[i] = (float)(CentreY + r * sin (a));
+	}
+
+	collapse (radius * step);
+	for (int i = 0; i < n; i++)
+	{
+		if (State[i] != nsCollapsed)
+			continue;
+		double r = (Far[i] - Depth[0]) * rscale;
+		Triangle[4 * i]		= (float)(CentreX + r * cos (Lo[i] * step));
+		Triangle[4 * i + 1]	= (float)(CentreY + r * sin (Lo[i] * step));
+		Triangle[4 * i + 2]	= (float)(CentreX + r * cos (Hi[i] * step));
+		Triangle[4 * i + 3]	= (float)(CentreY + r * sin (Hi[i] * step));
+	}
+}
+
+//------------------------------------------------------------------------------
+// Equal angle layout: each node gets a wedge in proportion to its number of
+// leaves, split among its children in order, and each edge points down the
+// middle of its node's wedge. Drawn in tree units, then scaled to fit.
+void TreeLayout::radial ()
+{
+	int n = (int)Nodes.size();
+	int leaves = (int)Hi[0] + 1;
+	std::vector<double> start (n, 0.0), cursor (n, 0.0);
+	std::vector<double> x (n, 0.0), y (n, 0.0);
+	double unit = 2.0 * M_PI / leaves;
+
+	for (int i = 1; i < n; i++)
+	{
+		int p = Parent[i];
+		double wedge = (Hi[i] - Lo[i] + 1.0) * unit;
+		start[i] = cursor[p];
+		cursor[p] += wedge;
+		cursor[i] = start[i];
+
+		double a = start[i] + wedge / 2.0;
+		double l = Depth[i] - Depth[p];
+		Angle[i] = (float)a;
+		x[i] = x[p] + l * cos (a);
+		y[i] = y[p] + l * sin (a);
+	}
+
+	// Uniform scale into the drawing area, centred
+	double minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+	for (int i = 1; i < n; i++)
+	{
+		if (x[i] < minX) minX = x[i];
+		if (x[i] > maxX) maxX = x[i];
+		if (y[i] < minY) minY = y[i];
+		if (y[i] > maxY) maxY = y[i];
+	}
+	double width = Options.Width - 2.0 * Options.Margin;
+	double height = Options.Height - 2.0 * Options.Margin;
+	double sx = (maxX > minX) ? width / (maxX - minX) : 0.0;
+	double sy = (maxY > minY) ? height / (maxY - minY) : 0.0;
+	double scale = (sx == 0.0) ? sy : ((sy == 0.0) ? sx : (sx < sy ? sx : sy));
+	double ox = CentreX - scale * (minX + maxX) / 2.0;
+	double oy = CentreY - scale * (minY + maxY) / 2.0;
+	for (int i = 0; i < n; i++)
+	{
+		X[i] = (float)(ox + scale * x[i]);
+		Y[i] = (float)(oy + scale * y[i]);
+	}
+
+	// Space per leaf on the outermost circle
+	collapse (scale * (Far[0] - Depth[0]) * unit);
+	for (int i = 0; i < n; i++)
+	{
+		if (State[i] != nsCollapsed)
+			continue;
+		double r = scale * (Far[i] - Depth[i]);
+		double a0 = start[i];
+		double a1 = start[i] + (Hi[i] - Lo[i] + 1.0) * unit;
+		Triangle[4 * i]		= (float)(X[i] + r * cos (a0));
+		Triangle[4 * i + 1]	= (float)(Y[i] + r * sin (a0));
+		Triangle[4 * i + 2]	= (float)(X[i] + r * cos (a1));
+		Triangle[4 * i + 3]	= (float)(Y[i] + r * sin (a1));
+	}
+}
+
+//------------------------------------------------------------------------------
+void TreeLayout::WriteJSON (std::ostream &f) const
+{
+	int n = (int)Nodes.size();
+	std::vector<int> index (n, -1);
+	int visible = 0;
+	for (int i = 0; i < n; i++)
+		if (State[i] != nsHidden)
+			index[i] = visible++;
+
+	const char *style = (Style == lsRadial) ? "radial" : ((Style == lsCircular) ? "circular" : "rectangular");
+	f << "{\"style\":\"" << style << "\",\"width\":";
+	writeNumber (f, Options.Width);
+	f << ",\"height\":";
+	writeNumber (f, Options.Height);
+
+	const std::vector<float> *coords[2] = { &X, &Y };
+	const char *names[2] = { "x", "y" };
+	for (int c = 0; c < 2; c++)
+	{
+		f << ",\"" << names[c] << "\":[";
+		bool first = true;
+		for (int i = 0; i < n; i++)
+		{
+			if (index[i] < 0)
+				continue;
+			if (!first) f << ',';
+			writeNumber (f, (*coords[c])[i]);
+			first = false;
+		}
+		f << ']';
+	}
+
+	f << ",\"parent\":[";
+	for (int i = 0; i < n; i++)
+	{
+		if (index[i] < 0)
+			continue;
+		if (index[i] > 0) f << ',';
+		f << (Parent[i] < 0 ? -1 : index[Parent[i]]);
+	}
+	f << "],\"label\":[";
+	for (int i = 0; i < n; i++)
+	{
+		if (index[i] < 0)
+			continue;
+		if (index[i] > 0) f << ',';
+		writeJSONString (f, Nodes[i]->GetLabel ());
+	}
+	f << "],\"collapsed\":[";
+	bool first = true;
+	for (int i = 0; i < n; i++)
+	{
+		if (State[i] != nsCollapsed)
+			continue;
+		if (!first) f << ',';
+		f << '[' << index[i] << ',' << (int)(Hi[i] - Lo[i] + 1.0f);
+		for (int k = 0; k < 4; k++)
+		{
+			f << ',';
+			writeNumber (f, Triangle[4 * i + k]);
+		}
+		f << ']';
+		first = false;
+	}
+	f << "]}";
+}
+
+//------------------------------------------------------------------------------
+void TreeLayout::WriteSVG (std::ostream &f) const
+{
+	int n = (int)Nodes.size();
+	f << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+	writeNumber (f, Options.Width);
+	f << "\" height=\"";
+	writeNumber (f, Options.Height);
+	f << "\">" << std::endl;
+
+	// All edges as one path
+	f << "<path fill=\"none\" stroke=\"black\" stroke-width=\"1\" d=\"";
+	if (Style == lsRectangular || Style == lsCircular)
+	{
+		// Span of the children of each drawn internal node
+		std::vector<int> first (n, -1), last (n, -1);
+		for (int i = 1; i < n; i++)
+		{
+			int p = Parent[i];
+			if (State[i] == nsHidden)
+				continue;
+			if (first[p] < 0 || Mid[i] < Mid[first[p]]) first[p] = i;
+			if (last[p] < 0 || Mid[i] > Mid[last[p]]) last[p] = i;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			if (State[i] == nsHidden)
+				continue;
+			int p = Parent[i];
+			if (Style == lsRectangular)
+			{
+				if (p >= 0)
+				{
+					f << 'M'; writeNumber (f, X[p]); f << ' '; writeNumber (f, Y[i]);
+					f << 'H'; writeNumber (f, X[i]);
+				}
+				if (first[i] >= 0 && first[i] != last[i])
+				{
+					f << 'M'; writeNumber (f, X[i]); f << ' '; writeNumber (f, Y[first[i]]);
+					f << 'V'; writeNumber (f, Y[last[i]]);
+				}
+			}
+			else
+			{
+				// Radial line from the parent's circle out to the node
+				if (p >= 0)
+				{
+					double r = hypot (X[p] - CentreX, Y[p] - CentreY);
+					f << 'M'; writeNumber (f, CentreX + r * cos (Angle[i]));
+					f << ' '; writeNumber (f, CentreY + r * sin (Angle[i]));
+					f << 'L'; writeNumber (f, X[i]); f << ' '; writeNumber (f, Y[i]);
+				}
+				// Arc joining the children
+				double r = hypot (X[i] - CentreX, Y[i] - CentreY);
+				if (first[i] >= 0 && first[i] != last[i] && r > 0.05)
+				{
+					double a0 = Angle[first[i]], a1 = Angle[last[i]];
+					f << 'M'; writeNumber (f, CentreX + r * cos (a0));
+					f << ' '; writeNumber (f, CentreY + r * sin (a0));
+					f << 'A'; writeNumber (f, r); f << ' '; writeNumber (f, r);
+					f << " 0 " << (a1 - a0 > M_PI ? 1 : 0) << " 1 ";
+					writeNumber (f, CentreX + r * cos (a1));
+					f << ' '; writeNumber (f, CentreY + r * sin (a1));
+				}
+			}
+		}
+	}
+	else
+	{
+		for (int i = 1; i < n; i++)
+		{
+			if (State[i] == nsHidden)
+				continue;
+			int p = Parent[i];
+			f << 'M'; writeNumber (f, X[p]); f << ' '; writeNumber (f, Y[p]);
+			f << 'L'; writeNumber (f, X[i]); f << ' '; writeNumber (f, Y[i]);
+		}
+	}
+	f << "\"/>" << std::endl;
+
+	// Collapsed clades as one filled path
+	bool any = false;
+	for (int i = 0; i < n; i++)
+	{
+		if (State[i] != nsCollapsed)
+			continue;
+		if (!any)
+			f << "<path fill=\"#ccc\" stroke=\"black\" stroke-width=\"1\" d=\"";
+		any = true;
+		f << 'M'; writeNumber (f, X[i]); f << ' '; writeNumber (f, Y[i]);
+		f << 'L'; writeNumber (f, Triangle[4 * i]); f << ' '; writeNumber (f, Triangle[4 * i + 1]);
+		f << 'L'; writeNumber (f, Triangle[4 * i + 2]); f << ' '; writeNumber (f, Triangle[4 * i + 3]);
+		f << 'Z';
+	}
+	if (any)
+		f << "\"/>" << std::endl;
+
+	// Labels for leaves if there is room, and leaf counts for collapsed clades
+	f << "<g font-family=\"sans-serif\" font-size=\"10\">" << std::endl;
+	for (int i = 0; i < n; i++)
+	{
+		bool leaf = (Nodes[i]->GetChild () == NULL);
+		if (State[i] == nsHidden || (State[i] == nsVisible && (!leaf || !LabelLeaves)))
+			continue;
+
+		std::string label = Nodes[i]->GetLabel ();
+		double x = X[i], y = Y[i], a = Angle[i];
+		if (State[i] == nsCollapsed)
+		{
+			std::ostringstream s;
+			if (!label.empty ())
+				s << label << " ";
+			s << "(" << (int)(Hi[i] - Lo[i] + 1.0f) << ")";
+			label = s.str();
+			x = (Triangle[4 * i] + Triangle[4 * i + 2]) / 2.0;
+			y = (Triangle[4 * i + 1] + Triangle[4 * i + 3]) / 2.0;
+		}
+		if (label.empty ())
+			continue;
+
+		f << "<text";
+		if (Style == lsRectangular)
+		{
+			f << " x=\""; writeNumber (f, x + 4.0);
+			f << "\" y=\""; writeNumber (f, y + 3.0);
+			f << "\"";
+		}
+		else
+		{
+			// Text runs outwards along the edge, flipped on the left so it
+			// is never upside down
+			double deg = a * 180.0 / M_PI;
+			bool flip = (cos (a) < 0.0);
+			double tx = x + 4.0 * cos (a), ty = y + 4.0 * sin (a);
+			f << " x=\""; writeNumber (f, tx);
+			f << "\" y=\""; writeNumber (f, ty);
+			f << "\" dy=\"3\"";
+			if (flip)
+				f << " text-anchor=\"end\"";
+			f << " transform=\"rotate(";
+			writeNumber (f, flip ? deg + 180.0 : deg);
+			f << " "; writeNumber (f, tx);
+			f << " "; writeNumber (f, ty);
+			f << ")\"";
+		}
+		f << ">";
+		writeXMLString (f, label);
+		f << "</text>" << std::endl;
+	}
+	f << "</g>" << std::endl;
+	f << "</svg>" << std::endl;
+}
@@ -0,0 +1,125 @@
+/*
+ * TreeLayout
+ * Node coordinates for drawing TreeLib trees in the browser.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TREELAYOUT_H
+#define TREELAYOUT_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TreeLib.h"
+
+
+enum LayoutStyle
+{
+	lsRectangular,		// root on the left, leaves in rows
+	lsRadial,			// unrooted, equal angle (Felsenstein's "drawtree")
+	lsCircular			// rectangular wrapped round a circle
+};
+
+struct LayoutOptions
+{
+	LayoutStyle	Style;
+	double		Width;				// drawing size in pixels
+	double		Height;
+	double		Margin;
+	double		LabelSpace;			// room left for leaf labels (rectangular, circular)
+	bool		UseEdgeLengths;		// phylogram if the tree has edge lengths
+	double		MinCladeSpacing;	// collapse clades narrower than this (pixels, 0 = never)
+	double		MinLabelSpacing;	// only label leaves at least this far apart
+
+	LayoutOptions ()
+	{
+		Style = lsRectangular;
+		Width = 800.0;
+		Height = 600.0;
+		Margin = 10.0;
+		LabelSpace = 150.0;
+		UseEdgeLengths = true;
+		MinCladeSpacing = 0.0;
+		MinLabelSpacing = 8.0;
+	};
+};
+
+
+//------------------------------------------------------------------------------
+// Coordinates for every node of a tree, computed with one preorder and one
+// reverse preorder pass over a flat copy of the tree. Path lengths (or, for
+// cladograms, heights as GetNodeHeights has them) are found in the preorder
+// pass rather than by TreeLib's GetPathLengths and GetNodeHeights, which
+// recurse, so trees with tens of thousands of leaves lay out in milliseconds
+// and without deep recursion.
+//
+// Nodes are numbered in preorder. A clade whose leaves would be drawn closer
+// together than MinCladeSpacing is collapsed: it is drawn as a triangle and
+// its descendants are left out of the output, so the size of the SVG or JSON
+// depends on the size of the drawing rather than of the tree.
+class TreeLayout
+{
+public:
+	TreeLayout () { Style = lsRectangular; LabelLeaves = true; };
+	virtual ~TreeLayout () {};
+
+	// t must have been through Update () (as Parse and the builders do), since
+	// node weights are used for leaf counts
+	virtual void	Compute (Tree &t, const LayoutOptions &options);
+
+	int				GetNumNodes () const { return (int)Nodes.size(); };
+	NodePtr			GetNode (int i) const { return Nodes[i]; };
+	int				GetParent (int i) const { return Parent[i]; };
+	float			GetX (int i) const { return X[i]; };
+	float			GetY (int i) const { return Y[i]; };
+	bool			IsCollapsed (int i) const { return State[i] == nsCollapsed; };
+	bool			IsVisible (int i) const { return State[i] != nsHidden; };
+
+	// Coordinate arrays of the visible nodes, with parents renumbered to match:
+	// {"style":..., "width":..., "height":..., "x":[], "y":[], "parent":[],
+	//  "label":[], "collapsed":[[node, leaves, x, y, x, y], ...]} where the
+	//  collapsed clade is drawn as a triangle from the node to the two points
+	virtual void	WriteJSON (std::ostream &f) const;
+	virtual void	WriteSVG (std::ostream &f) const;
+
+protected:
+	enum NodeState { nsVisible, nsCollapsed, nsHidden };
+
+	LayoutStyle				Style;
+	LayoutOptions			Options;
+	bool					LabelLeaves;
+	double					CentreX;		// centre for radial and circular
+	double					CentreY;
+	std::vector<NodePtr>	Nodes;
+	std::vector<int>		Parent;
+	std::vector<int>		End;			// one past the node's last descendant
+	std::vector<float>		Depth;			// path length or height from the root
+	std::vector<float>		Far;			// greatest Depth in the clade
+	std::vector<float>		Lo;				// leaf positions (0 .. leaves - 1) spanned
+	std::vector<float>		Hi;
+	std::vector<float>		Mid;			// row (rectangular, circular) of the node
+	std::vector<float>		X;
+	std::vector<float>		Y;
+	std::vector<float>		Angle;			// circular and radial
+	std::vector<char>		State;
+	std::vector<float>		Triangle;		// 4 per node, far corners of a collapsed clade
+
+	virtual void	flatten (Tree &t);
+	virtual void	rectangular ();
+	virtual void	circular ();
+	virtual void	radial ();
+	virtual void	collapse (double spacing);
+};
+
+
+#endif // TREELAYOUT_H
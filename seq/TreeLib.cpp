@@ -24,85 +24,36 @@
 #include "TreeLib.h"
 #include "Parse.h"
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 
 // Convert a string to a NEXUS format string
 std::string NEXUSString (const std::string s)
 {
-	std::string outputString ="";
-	bool enclose = false;
-	int i = 0;
-
-	if (isalpha (s[0]))
-	{
-		// First character is a letter, check the rest
-		i = 1;
-		while ((i < s.length()) && !enclose)
-		{
-			if (!isalnum (s[i]) && (s[i] != ' ') && (s[i] != '_') && (s[i] != '.'))
-				enclose = true;
-			i++;
-		}
-	}
-	else
-		enclose = true;
-
-	if (enclose)
-	{
-		outputString = "'";
-	}
-
-	i = 0;
-	while (i < s.length())
-	{
-		if (s[i] == '\'')
-			outputString += "''";
-		else if ((s[i] == ' ') && !enclose)
-			outputString += '_';
-		else
-			outputString += s[i];
-		i++;
-	}
-
-
-	if (enclose)
-	{
-		outputString += "'";
-	}
-	
+	std::string outputString;
+	outputString.reserve (s.size() + 2);
+	AppendNEXUSLabel (s, outputString);
 	return outputString;
 }
 
 // Convert NEXUS string to a display string
 std::string NEXUSToDisplayString (const std::string s)
 {
-	std::string outputString ="";
-	int i = 0;
-	while (i < s.size())
-	{
-		if (s[i] == '_')
-			outputString += ' ';
-		else
-			outputString += s[i];
-		i++;
-	}
+	std::string outputString (s);
+	TranslateLabel (outputString, '_', ' ');
 	return outputString;
 }
 
 // Convert NEXUS string to a display string
 std::string ReplaceCharacter (const std::string s, char needle, char replace)
 {
-	std::string outputString ="";
-	int i = 0;
-	while (i < s.size())
-	{
-		if (s[i] == needle)
-			outputString += replace;
-		else
-			outputString += s[i];
-		i++;
-	}
+	std::string outputString (s);
+	TranslateLabel (outputString, needle, replace);
 	return outputString;
 }
 
@@ -127,6 +78,7 @@ Node::Node ()
 	Index = 0;
 	
 	Latitude = Longitude = 0.0;
+	Located = false;
 	
 	Value = 0;
 }
@@ -140,6 +92,9 @@ void Node::Copy (Node *theCopy)
 	theCopy->SetLeafNumber (LeafNumber);
 	theCopy->SetLabelNumber (LabelNumber);
 	theCopy->SetEdgeLength (Length);
+	theCopy->SetLatitude (Latitude);
+	theCopy->SetLongitude (Longitude);
+	theCopy->SetLocated (Located);
 }
 
 void Node::Dump (std::ostream &f)
@@ -233,6 +188,11 @@ Tree::Tree ()
 	InternalLabels 	= false;
 	EdgeLengths 	= false;
 	Nodes 		= NULL;
+	Nodes_dimension	= 0;
+	Cached		= 0;
+	Translation	= NULL;
+	TranslateLabels	= true;
+	UnderscoresToSpaces = false;
 	Name 		= "";
 	Rooted 		= false;
 	Weight		= 1.0;
@@ -252,12 +212,19 @@ Tree::Tree (const Tree &t)
         InternalLabels 	= false;
         EdgeLengths 	= false;
         Nodes 		= NULL;
+        Nodes_dimension	= 0;
+        Cached		= 0;
+        Translation	= NULL;
+        TranslateLabels	= true;
+        UnderscoresToSpaces = false;
         Name 		= "";
         Rooted 		= false;
         Weight		= 1.0;
     }
     else
     {
+		TREELIB_TRACE_SCOPE (trace, "Tree::copyTraverse");
+		TREELIB_TRACE_ARG (trace, "nodes", t.GetNumLeaves () + t.GetNumInternals ());
 		CurNode 		= t.GetRoot();   		
 		NodePtr placeHolder;  				
 		t.copyTraverse (CurNode, placeHolder );
@@ -270,6 +237,11 @@ Tree::Tree (const Tree &t)
 		InternalLabels 	= t.GetHasInternalLabels ();;
 		EdgeLengths 	= t.GetHasEdgeLengths ();
 		Nodes 		= NULL;
+		Nodes_dimension	= 0;
+		Cached		= 0;
+		Translation	= t.GetTranslationTable ();
+		TranslateLabels	= t.TranslateLabels;
+		UnderscoresToSpaces = t.UnderscoresToSpaces;
 		Rooted 		= t.IsRooted();
 		Weight		= t.GetWeight();
 	}
@@ -358,6 +330,7 @@ void Tree::copyTraverse (NodePtr p1, NodePtr &p2) const
 //------------------------------------------------------------------------------
 NodePtr Tree::CopyOfSubtree (NodePtr RootedAt) 
 {
+	TREELIB_TRACE_SCOPE (trace, "Tree::copyTraverse");
 	CurNode = RootedAt;   // Store this to avoid copying too much of the tree
 	NodePtr placeHolder;  // This becomes the root of the subtree
 	copyTraverse (CurNode, placeHolder);
@@ -374,7 +347,7 @@ void Tree::writeTraverse (NodePtr p)
 	{
 		if (p->IsLeaf())
 		{
-			*treeStream << NEXUSString (p->GetLabel());
+			writeLeaf (p);
 
 			if (EdgeLengths)
 			{
@@ -396,9 +369,9 @@ void Tree::writeTraverse (NodePtr p)
 			if (p != CurNode)
 			{
 				*treeStream << ")";
-				if ((p->GetAnc()->GetLabel() != ""))
+				if (!p->GetAnc()->Label.empty ())
 				{
-					*treeStream <<  NEXUSString (p->GetAnc()->GetLabel ()) ;
+					WriteNEXUSLabel (*treeStream, p->GetAnc()->Label);
 				}
 				if (EdgeLengths && (p->GetAnc () != CurNode))
 				{
@@ -455,6 +428,7 @@ string Tree::GetErrorMsg ()
 // Make CurNode a leaf, called by tree reading code
 void Tree::MakeCurNodeALeaf (int i)
 {
+	Invalidate ();
 	Leaves++;
 	CurNode->SetLeaf(true);
 	CurNode->SetWeight(1);
@@ -469,6 +443,7 @@ void Tree::MakeCurNodeALeaf (int i)
 // Make a child of CurNode and make it CurNode
 void Tree::MakeChild ()
 {
+	Invalidate ();
 	NodePtr	q = NewNode();
 	CurNode->SetChild(q);
 	q->SetAnc(CurNode);
@@ -481,6 +456,7 @@ void Tree::MakeChild ()
 // Create a new node and make it the root of the tree, and set CurNode=Root.
 void Tree::MakeRoot ()
 {
+	Invalidate ();
 	CurNode   = NewNode();
 	Root 	  = CurNode;
 }
@@ -489,6 +465,7 @@ void Tree::MakeRoot ()
 // Make a sibling of CurNode and make CurNode the new node.
 void Tree::MakeSibling ()
 {
+	Invalidate ();
 	NodePtr	q = NewNode ();
 	NodePtr	ancestor = CurNode->GetAnc();
 	CurNode->SetSibling(q);
@@ -512,7 +489,11 @@ int Tree::Parse (const char *TreeDescr)
 	tokentype	token;
 	float 		f;
 
+	TREELIB_TRACE_SCOPE (trace, "Tree::Parse");
+	TREELIB_TRACE_ARG (trace, "bytes", strlen (TreeDescr));
+
 	 // Initialise tree variables
+	Invalidate ();
 	Root 		= NULL;
 	Leaves 		= 0;
 	Internals 	= 0;
@@ -539,23 +520,26 @@ int Tree::Parse (const char *TreeDescr)
 						token = p.NextToken ();
 						break;
 					case STRING:
-						// to do: handle translation
+						// Translate tables are keyed by integers, so only
+						// NUMBER tokens are looked up
 						Leaves++;
 						CurNode->SetLeaf (true);
 						CurNode->SetLeafNumber (Leaves);
 						CurNode->SetWeight (1);
 						CurNode->SetLabel (p.GetToken());
+						if (UnderscoresToSpaces)
+							TranslateLabel (CurNode->Label, '_', ' ');
 						CurNode->SetDegree (0);
 						token = p.NextToken ();
 						state = stGETINTERNODE;
 						break;
 					case NUMBER:
-						// to do: handle translation
 						Leaves++;
 						CurNode->SetLeaf (true);
 						CurNode->SetLeafNumber (Leaves);
 						CurNode->SetWeight (1);
-						CurNode->SetLabel (p.GetToken());
+						if (!Translation || !translateLeaf (CurNode, p.GetTokenAsCstr()))
+							CurNode->SetLabel (p.GetToken());
 						CurNode->SetDegree (0);
 						token = p.NextToken ();
 						state = stGETINTERNODE;
@@ -697,6 +681,8 @@ int Tree::Parse (const char *TreeDescr)
 						// internal label
 						InternalLabels = true;
 						CurNode->SetLabel (p.GetToken());
+						if (UnderscoresToSpaces)
+							TranslateLabel (CurNode->Label, '_', ' ');
 						token = p.NextToken ();
 						break;
 
@@ -779,6 +765,8 @@ int Tree::Parse (const char *TreeDescr)
 	else
 	{
 		Root->SetWeight(Leaves);
+		Cached = tcWeights;
+		TREELIB_TRACE_ARG (trace, "nodes", Leaves + Internals);
 		return (0);
 	}
 }
@@ -802,11 +790,53 @@ int Tree::Read (istream &f)
 //------------------------------------------------------------------------------
 void Tree::Write (ostream &f)
 {
+	TREELIB_TRACE_SCOPE (trace, "Tree::Write");
+	TREELIB_TRACE_ARG (trace, "nodes", Leaves + Internals);
 	treeStream = &f;
 	traverse (Root);
 	f << ";";
 }
 
+//------------------------------------------------------------------------------
+// Leaves in the translation table are written as their key. A leaf parsed
+// with the table keeps the key as its label number, which saves the lookup.
+void Tree::writeLeaf (NodePtr p)
+{
+	if (Translation)
+	{
+		const std::string &s = p->Label;
+		int key = p->GetLabelNumber ();
+		const std::string *label = Translation->GetLabel (key);
+		// Leaves parsed without labels have only their key
+		if (!label || (*label != s && s != ""))
+			key = Translation->GetKey (s);
+		if (key > 0)
+		{
+			*treeStream << key;
+			return;
+		}
+	}
+	WriteNEXUSLabel (*treeStream, p->Label);
+}
+
+//------------------------------------------------------------------------------
+// Look up a NUMBER token in the translation table, returning false if it is
+// not there
+bool Tree::translateLeaf (NodePtr p, const char *token)
+{
+	char *end;
+	long key = strtol (token, &end, 10);
+	if (*end != '\0' || key <= 0 || key > INT_MAX)
+		return false;
+	const std::string *label = Translation->GetLabel ((int)key);
+	if (!label)
+		return false;
+	p->SetLabelNumber ((int)key);
+	if (TranslateLabels)
+		p->SetLabel (*label);
+	return true;
+}
+
 //------------------------------------------------------------------------------
 void Tree::traverse (NodePtr p)
 {
@@ -815,7 +845,7 @@ void Tree::traverse (NodePtr p)
 	{
 		if (p->IsLeaf())
 		{
-			*treeStream << NEXUSString (p->GetLabel());
+			writeLeaf (p);
 
 			if (EdgeLengths)
 			{
@@ -838,9 +868,9 @@ void Tree::traverse (NodePtr p)
 			{
 				*treeStream << ")";
 				// 29/3/96
-				if ((p->GetAnc()->GetLabel() != "") && InternalLabels)
+				if (!p->GetAnc()->Label.empty () && InternalLabels)
 				{
-					*treeStream << '\'' << NEXUSString (p->GetAnc()->GetLabel ()) << '\'';
+					WriteNEXUSLabel (*treeStream, p->GetAnc()->Label);	// quotes if needed
 				}
 				if (EdgeLengths && (p->GetAnc () != Root))
 				{
@@ -1097,8 +1127,7 @@ void Tree::Draw (ostream &f)
 	{
 		string s (Leaves + 2, ' ');
         Line = s;
-		MaxHeight = 0;
-		getNodeHeights (Root);
+		GetNodeHeights ();
 		drawAsTextTraverse (Root);
 	}
 	else f << "(No tree)" << endl;
@@ -1140,9 +1169,65 @@ void Tree::getNodeDepth(NodePtr p)
 // Compute node depth (i.e, height above root).
 void Tree::GetNodeDepths ()
 {
+	if (Cached & tcDepths)
+		return;
 	count = 0;
 	MaxDepth = 0;
 	getNodeDepth (Root);
+	Cached |= tcDepths;
+}
+
+//------------------------------------------------------------------------------
+// Heights (leaves - weight) as used by Draw, maximum in MaxHeight
+void Tree::GetNodeHeights ()
+{
+	if (Cached & tcHeights)
+		return;
+	if (!(Cached & tcWeights))
+		Update ();
+	MaxHeight = 0;
+	getNodeHeights (Root);
+	Cached |= tcHeights;
+}
+
+//------------------------------------------------------------------------------
+// Path lengths from the root, maximum in MaxPathLength
+void Tree::GetPathLengths ()
+{
+	if (Cached & tcPathLengths)
+		return;
+	MaxPathLength = 0.0;
+	if (Root)
+	{
+		Root->SetPathLength (0.0);
+		getPathLengths (Root);
+	}
+	Cached |= tcPathLengths;
+}
+
+//------------------------------------------------------------------------------
+void Tree::GetPreorder (std::vector<NodePtr> &nodes, std::vector<int> &parent) const
+{
+	nodes.clear ();
+	parent.clear ();
+	if (!Root)
+		return;
+	std::vector<std::pair<NodePtr, int> > stack;
+	stack.push_back (std::make_pair (Root, -1));
+	while (!stack.empty ())
+	{
+		NodePtr p = stack.back().first;
+		int anc = stack.back().second;
+		stack.pop_back ();
+		int index = (int)nodes.size();
+		nodes.push_back (p);
+		parent.push_back (anc);
+		// Children go on right to left, so they come off left to right
+		size_t first = stack.size();
+		for (NodePtr q = p->GetChild (); q; q = q->GetSibling ())
+			stack.push_back (std::make_pair (q, index));
+		std::reverse (stack.begin() + first, stack.end());
+	}
 }
 
 
@@ -1191,6 +1276,8 @@ void Tree::makeNodeList (NodePtr p)
 //------------------------------------------------------------------------------
 void Tree::MakeNodeList ()
 {
+	if (Cached & tcNodeList)
+		return;
 	if (Nodes == NULL)
 	{
 		Nodes = new NodePtr [Leaves + Internals];
@@ -1198,12 +1285,14 @@ void Tree::MakeNodeList ()
 	}
 	else if (Nodes_dimension != Leaves + Internals)  //The tree size has changed since Nodes was allocated - need to allocate correct amount of space before re-building array!
 	{
-		delete Nodes; //Nodes has already been allocated - need to free it!
+		delete [] Nodes; //Nodes has already been allocated - need to free it!
 		Nodes = new NodePtr [Leaves + Internals];
 		Nodes_dimension = Leaves + Internals;
 	}
 	count = Leaves;
+	LeafList.clear ();
 	makeNodeList (Root);
+	Cached |= tcNodeList;
 }
 
 //------------------------------------------------------------------------------
@@ -1219,11 +1308,14 @@ NodePtr Tree::GetLeafWithLabel (string s)
 }
 
 //------------------------------------------------------------------------------
-// Add Node below Below. Doesn't update any clusters, weights, etc.
+// Add Node below Below, joined by a new binary node. Doesn't update any
+// clusters, weights, etc.
 void Tree::AddNodeBelow (NodePtr Node, NodePtr Below)
 {
+	Invalidate ();
 	NodePtr Ancestor = NewNode ();
 	Ancestor->SetChild (Node);
+	Ancestor->SetDegree (2);
 	Node->SetAnc (Ancestor);
 	NodePtr q = Below->GetAnc ();
 	Internals++;
@@ -1311,6 +1403,7 @@ void Tree::Update ()
 	count = 0;
 	Leaves = Internals = 0;
 	buildtraverse (Root);
+	Cached = tcWeights;
 }
 
 //------------------------------------------------------------------------------
@@ -1340,12 +1433,13 @@ void Tree::resetTraverse (NodePtr p)
 
 void Tree::Reset()
 {
+	Invalidate ();
 	Leaves = Internals = 0;
 	resetTraverse (Root);
 	delete [] Nodes; 
 	Nodes = NULL;
-	MakeNodeList();
 	Update();
+	MakeNodeList();
 }
 
 void Tree::Plant(NodePtr p)
@@ -1425,6 +1519,7 @@ void Tree::Dump(ostream &f)
 NodePtr Tree::RemoveNode (NodePtr Node)
 {
 	NodePtr result = NULL;
+	Invalidate ();
 
 	if (Node == Root)
 	{
@@ -1496,6 +1591,7 @@ NodePtr Tree::RemoveNode (NodePtr Node)
 		Ancestor->SetDegree (Ancestor->GetDegree() - 1);
 		result = q;
 	}
+	return result;
 }
 
 
@@ -1510,3 +1606,164 @@ NodePtr Tree::RemoveNode (NodePtr Node)
 
 
 
+
+
+//------------------------------------------------------------------------------
+void TranslationTable::Clear ()
+{
+	Labels.clear ();
+	Used.clear ();
+	Keys.clear ();
+	Sparse.clear ();
+}
+
+//------------------------------------------------------------------------------
+bool TranslationTable::Add (int key, const std::string &label)
+{
+	if (key <= 0)
+		return false;
+	if (key >= (int)Labels.size())
+	{
+		// Grow the vector only if key is within a few times the number of
+		// entries, and move any sparse keys it now covers into it
+		if ((size_t)key > 2 * Keys.size() + 1024)
+		{
+			if (!Sparse.insert (std::make_pair (key, label)).second)
+				return false;
+			Keys.insert (std::make_pair (label, key));
+			return true;
+		}
+		Labels.resize ((size_t)key + 1);
+		Used.resize ((size_t)key + 1, 0);
+		while (!Sparse.empty () && Sparse.begin()->first <= key)
+		{
+			Labels[Sparse.begin()->first].swap (Sparse.begin()->second);
+			Used[Sparse.begin()->first] = 1;
+			Sparse.erase (Sparse.begin ());
+		}
+	}
+	if (Used[key])
+		return false;
+	Labels[key] = label;
+	Used[key] = 1;
+	Keys.insert (std::make_pair (label, key));
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void TranslationTable::AddLeaves (Tree &t)
+{
+	int next = Labels.empty () ? 1 : (int)Labels.size();
+	std::vector<NodePtr> stack;
+	if (t.GetRoot ())
+		stack.push_back (t.GetRoot ());
+	while (!stack.empty ())
+	{
+		NodePtr p = stack.back ();
+		stack.pop_back ();
+		if (p->IsLeaf () && Keys.find (p->GetLabel ()) == Keys.end ())
+		{
+			// Skip keys already taken by sparse entries
+			while (!Add (next, p->GetLabel ()))
+				next++;
+			next++;
+		}
+		if (p->GetSibling ())
+			stack.push_back (p->GetSibling ());
+		if (p->GetChild ())
+			stack.push_back (p->GetChild ());
+	}
+}
+
+//------------------------------------------------------------------------------
+int TranslationTable::GetKey (const std::string &label) const
+{
+	std::map<std::string, int>::const_iterator it = Keys.find (label);
+	return (it == Keys.end ()) ? 0 : it->second;
+}
+
+//------------------------------------------------------------------------------
+// Read a NEXUS word: quoted (with '' for a quote), or up to white space or
+// punctuation. Comments in square brackets are skipped before it.
+static const char *nexusWord (const char *s, std::string &word)
+{
+	word = "";
+	for (;;)
+	{
+		while (*s && isspace ((unsigned char)*s))
+			s++;
+		if (*s != '[')
+			break;
+		while (*s && *s != ']')
+			s++;
+		if (*s)
+			s++;
+	}
+	if (*s == '\'')
+	{
+		for (s++; *s; s++)
+		{
+			if (*s == '\'')
+			{
+				if (s[1] != '\'')
+					return s + 1;
+				s++;
+			}
+			word += *s;
+		}
+		return NULL;
+	}
+	while (*s && !isspace ((unsigned char)*s) && !strchr (",;[", *s))
+		word += *s++;
+	return word.empty () ? NULL : s;
+}
+
+//------------------------------------------------------------------------------
+int TranslationTable::Parse (const char *s)
+{
+	Clear ();
+	const char *start = s;
+	std::string key, label;
+	for (;;)
+	{
+		const char *q = nexusWord (s, key);
+		if (!q)
+			return (int)(s - start) + 1;
+		s = q;
+		char *end;
+		long k = strtol (key.c_str(), &end, 10);
+		if (*end != '\0' || k <= 0 || k > INT_MAX)
+			return (int)(s - start);
+		q = nexusWord (s, label);
+		if (!q || !Add ((int)k, label))
+			return (int)(s - start) + 1;
+		s = q;
+		while (*s && isspace ((unsigned char)*s))
+			s++;
+		if (*s == ';')
+			return 0;
+		if (*s != ',')
+			return (int)(s - start) + 1;
+		s++;
+	}
+}
+
+//------------------------------------------------------------------------------
+void TranslationTable::Write (std::ostream &f) const
+{
+	f << "\ttranslate";
+	bool first = true;
+	for (size_t i = 1; i < Labels.size(); i++)
+	{
+		if (!Used[i])
+			continue;
+		f << (first ? "\n" : ",\n") << "\t\t" << i << ' ' << NEXUSString (Labels[i]);
+		first = false;
+	}
+	for (std::map<int, std::string>::const_iterator it = Sparse.begin (); it != Sparse.end (); ++it)
+	{
+		f << (first ? "\n" : ",\n") << "\t\t" << it->first << ' ' << NEXUSString (it->second);
+		first = false;
+	}
+	f << "\n\t\t;\n";
+}
@@ -44,6 +44,9 @@
 #include <map>
 #include <iomanip>
 
+#include "LabelCodec.h"
+#include "Trace.h"
+
 
 #ifdef __BORLANDC__
     #pragma warn .pch
@@ -158,6 +161,9 @@ public:
 	virtual void	SetLongitude( double l) { Longitude = l; }
 	virtual double	GetLatitude () { return Latitude; };
 	virtual double	GetLongitude () { return Longitude; };
+	virtual void	SetLocation (double latitude, double longitude) { Latitude = latitude; Longitude = longitude; Located = true; };
+	virtual void	SetLocated (bool on) { Located = on; };
+	virtual bool	IsLocated () { return Located; };		// Latitude and Longitude are known
 	
 	virtual void SetValue(int v) { Value = v; };
 	virtual int GetValue() { return Value; };
@@ -183,6 +189,7 @@ protected:
 	
 	double		Latitude;
 	double		Longitude;
+	bool		Located;
 };
 typedef Node *NodePtr;
 
@@ -199,6 +206,64 @@ typedef std::map<int, NodePtr, std::less <int> > IntegerNodeMap;
 #define errSTACKNOTEMPTY	5
 #define errSEMICOLON		6
 
+// Derived quantities a tree caches. Tree's own mutators (Parse, AddNodeBelow,
+// RemoveNode, SetRoot, ...) invalidate them; after changing nodes directly
+// (edge lengths, children) call Update or Invalidate. Heights depend on
+// weights, so invalidating weights invalidates heights too.
+#define tcDepths		0x01
+#define tcHeights		0x02
+#define tcPathLengths	0x04
+#define tcWeights		0x08
+#define tcNodeList		0x10
+#define tcAll			0x1f
+
+
+class Tree;
+
+//------------------------------------------------------------------------------
+// A NEXUS translate table, mapping integer tokens to leaf labels. Labels are
+// held in a vector indexed by key, so translating a leaf while parsing is an
+// array lookup rather than a string comparison.
+class TranslationTable
+{
+public:
+	TranslationTable () {};
+	virtual ~TranslationTable () {};
+
+	virtual void	Clear ();
+	// Keys must be positive; returns false if key is already used. Keys
+	// are normally numbered from 1, and are stored in a vector; a key far
+	// beyond the number in the table is kept in a map instead, so one large
+	// key cannot make the vector huge.
+	virtual bool	Add (int key, const std::string &label);
+	// Give each leaf label of t not already in the table the next key
+	virtual void	AddLeaves (Tree &t);
+
+	// NULL if key is not in the table
+	virtual const std::string *GetLabel (int key) const
+	{
+		if (key > 0 && key < (int)Labels.size())
+			return Used[key] ? &Labels[key] : NULL;
+		std::map<int, std::string>::const_iterator it = Sparse.find (key);
+		return (it == Sparse.end ()) ? NULL : &it->second;
+	};
+	// 0 if label is not in the table
+	virtual int		GetKey (const std::string &label) const;
+	virtual int		GetSize () const { return (int)Keys.size(); };
+
+	// Read the body of a translate command ("1 label, 2 'other label';"),
+	// replacing the table. Returns 0, or the position of the error.
+	virtual int		Parse (const char *s);
+	// Write a translate command, ending with a semicolon
+	virtual void	Write (std::ostream &f) const;
+
+protected:
+	std::vector<std::string>	Labels;
+	std::vector<char>			Used;
+	std::map<std::string, int>	Keys;
+	std::map<int, std::string>	Sparse;		// keys >= Labels.size() that are too big for it
+};
+
 
 class Tree
 {
@@ -225,9 +290,18 @@ public:
 	virtual bool	GetHasEdgeLengths () const { return EdgeLengths; };
 	virtual bool 	GetHasInternalLabels () const { return InternalLabels; };
 	virtual NodePtr GetLeafWithLabel (std::string s);
+	// Depths, heights and path lengths are computed when first asked for and
+	// kept until the tree changes
 	virtual int GetMaxNodeDepth() { GetNodeDepths(); return MaxDepth; };
+	virtual int		GetMaxHeight () const { return MaxHeight; };
+	virtual float	GetMaxPathLength () const { return MaxPathLength; };
 	virtual std::string  	GetName () const { return Name; };
 	virtual void 	GetNodeDepths ();
+	virtual void	GetNodeHeights ();
+	virtual void	GetPathLengths ();
+	// Nodes in preorder, children left to right, and the position of each
+	// node's parent (-1 for the root). Uses a stack, so deep trees are fine.
+	virtual void	GetPreorder (std::vector<NodePtr> &nodes, std::vector<int> &parent) const;
 	virtual int		GetNumInternals () const { return Internals; };
 	virtual int 	GetNumLeaves () const { return Leaves; };
 	virtual int		GetNumNodes () const { return Leaves + Internals; };
@@ -243,8 +317,11 @@ public:
 	virtual void	MakeSibling ();
    	virtual void 	MakeNodeList ();
 
+	virtual void	Invalidate (unsigned int what = tcAll) { Cached &= ~((what & tcWeights) ? (what | tcHeights) : what); };
+	virtual bool	IsCached (unsigned int what) const { return (Cached & what) == what; };
+
 	virtual void	MarkNodes (bool on);
-	virtual NodePtr NewNode () const { return new Node; };
+	virtual NodePtr NewNode () const { TREELIB_TRACE_ALLOC (sizeof (Node)); return new Node; };
 
 	virtual int 	Parse (const char *TreeDescr);
 	
@@ -266,10 +343,28 @@ public:
 	virtual void	SetName (const std::string s) { Name = s; };
 	virtual void	SetNumInternals (const int n) { Internals = n; };
 	virtual void	SetNumLeaves (const int n) { Leaves = n; };
-	virtual void 	SetRoot (NodePtr r) { Root = r; };
+	virtual void 	SetRoot (NodePtr r) { Root = r; Invalidate (); };
 	virtual void	SetRooted (bool on) { Rooted = on; };
+	// Parse labels with underscores made spaces, as NEXUS reads unquoted
+	// labels; Write makes them underscores again. Off by default, as the
+	// tokenizer does not say which labels were quoted.
+	virtual void	SetUnderscoresToSpaces (bool on) { UnderscoresToSpaces = on; };
+	virtual bool	GetUnderscoresToSpaces () const { return UnderscoresToSpaces; };
+	// With a translation table, numeric leaf tokens are looked up in it when
+	// parsing (the key is kept as the leaf's label number), and leaves whose
+	// label is in it are written as their key. If labels is false, parsed
+	// leaves get only the label number, leaving the label empty. The table
+	// is not copied and must outlive its use by the tree.
+	virtual void	SetTranslationTable (const TranslationTable *table, bool labels = true)
+	{
+		Translation = table;
+		TranslateLabels = labels;
+	};
+	virtual const TranslationTable *GetTranslationTable () const { return Translation; };
 	virtual void	SetWeight (const double w) { Weight = w; };
 
+	// Recompute weights, degrees and node counts after changing the tree
+	// directly; the other cached quantities are invalidated
 	virtual void	Update ();
 
 
@@ -306,6 +401,11 @@ protected:
 	
 	double			Weight;
 
+	const TranslationTable	*Translation;
+	bool			TranslateLabels;
+	bool			UnderscoresToSpaces;
+
+	unsigned int	Cached;						// tc* flags for quantities that are up to date
 	unsigned int     Nodes_dimension;             // stores the current dimension of the Nodes array - needed to rebuild Nodes if treesize changes JAC 13/05/04
 #if defined __BORLANDC__ && (__BORLANDC__ < 0x0550)
 	ostream				*treeStream;
@@ -316,6 +416,8 @@ protected:
 	int				count;
 
 	virtual void 		traverse (NodePtr p);
+	virtual void		writeLeaf (NodePtr p);
+	virtual bool		translateLeaf (NodePtr p, const char *token);
 
 	virtual void 		buildtraverse (NodePtr p);
    	virtual void 		copyTraverse (NodePtr p1, NodePtr &p2) const;
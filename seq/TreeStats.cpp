@@ -0,0 +1,178 @@
+/*
+ * TreeStats
+ * Balance and shape statistics for trees and collections of trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#include "TreeStats.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+
+//------------------------------------------------------------------------------
+void PostorderTree::Assign (Tree &t)
+{
+	Parent.clear ();
+	Length.clear ();
+	EdgeLengths = t.GetHasEdgeLengths ();
+	NodePtr root = t.GetRoot ();
+	if (!root)
+		return;
+
+	// Preorder, then reversed, puts children before parents
+	std::vector<NodePtr> nodes;
+	std::vector<int> parent;
+	t.GetPreorder (nodes, parent);
+
+	int n = (int)nodes.size();
+	Parent.resize (n);
+	Length.resize (n);
+	for (int i = 0; i < n; i++)
+	{
+		int j = n - 1 - i;
+		Parent[j] = (parent[i] < 0) ? -1 : n - 1 - parent[i];
+		Length[j] = nodes[i]->GetEdgeLength ();
+	}
+}
+
+
+//------------------------------------------------------------------------------
+void TreeStatsTable::Resize (size_t rows, int statistics)
+{
+	Leaves.assign (rows, 0);
+	Colless.assign ((statistics & tsColless) ? rows : 0, 0);
+	Sackin.assign ((statistics & tsSackin) ? rows : 0, 0);
+	Cherries.assign ((statistics & tsCherries) ? rows : 0, 0);
+	Height.assign ((statistics & tsHeight) ? rows : 0, 0.0);
+	Length.assign ((statistics & tsLength) ? rows : 0, 0.0);
+	Gamma.assign ((statistics & tsGamma) ? rows : 0, 0.0);
+}
+
+
+//------------------------------------------------------------------------------
+void TreeStats::Compute (const PostorderTree &t, TreeStatsTable &table, size_t row) const
+{
+	int n = t.GetNumNodes ();
+	if (n == 0)
+		return;
+
+	// Per node, filled in by the children before the node is reached
+	std::vector<int> leaves (n, 0), children (n, 0), leafChildren (n, 0);
+	std::vector<int> fewest (n, std::numeric_limits<int>::max()), most (n, 0);
+	std::vector<double> deep (n, 0.0);
+	std::vector<double> ages;
+
+	int numLeaves = 0;
+	long colless = 0, sackin = 0;
+	int cherries = 0;
+	double length = 0.0;
+	for (int i = 0; i < n; i++)
+	{
+		if (children[i] == 0)
+		{
+			leaves[i] = 1;
+			numLeaves++;
+		}
+		else
+		{
+			colless += most[i] - fewest[i];
+			sackin += leaves[i];
+			if (children[i] == 2 && leafChildren[i] == 2)
+				cherries++;
+			if (Statistics & tsGamma)
+				for (int c = 1; c < children[i]; c++)
+					ages.push_back (deep[i]);
+		}
+
+		int p = t.Parent[i];
+		if (p < 0)
+			continue;
+		double d = t.EdgeLengths ? t.Length[i] : 1.0;
+		length += d;
+		leaves[p] += leaves[i];
+		children[p]++;
+		if (children[i] == 0)
+			leafChildren[p]++;
+		if (leaves[i] < fewest[p])
+			fewest[p] = leaves[i];
+		if (leaves[i] > most[p])
+			most[p] = leaves[i];
+		if (deep[i] + d > deep[p])
+			deep[p] = deep[i] + d;
+	}
+
+	table.Leaves[row] = numLeaves;
+	if (Statistics & tsColless)
+		table.Colless[row] = (int)colless;
+	if (Statistics & tsSackin)
+		table.Sackin[row] = sackin;
+	if (Statistics & tsCherries)
+		table.Cherries[row] = cherries;
+	if (Statistics & tsHeight)
+		table.Height[row] = deep[n - 1];
+	if (Statistics & tsLength)
+		table.Length[row] = length;
+
+	if (Statistics & tsGamma)
+	{
+		// With ages from oldest to youngest, there are k lineages for
+		// g[k] = ages[k - 2] - ages[k - 1], the last interval ending at the
+		// leaves (Pybus & Harvey 2000)
+		double gamma = std::numeric_limits<double>::quiet_NaN ();
+		int m = numLeaves;
+		if (m > 2 && (int)ages.size() == m - 1)
+		{
+			std::sort (ages.begin(), ages.end(), std::greater<double> ());
+			double T = 0.0, partial = 0.0, sum = 0.0;
+			for (int k = 2; k <= m; k++)
+			{
+				double g = ages[k - 2] - ((k - 1 < m - 1) ? ages[k - 1] : 0.0);
+				T += k * g;
+				if (k < m)
+				{
+					partial += k * g;
+					sum += partial;
+				}
+			}
+			if (T > 0.0)
+				gamma = (sum / (m - 2) - T / 2.0) / (T * std::sqrt (1.0 / (12.0 * (m - 2))));
+		}
+		table.Gamma[row] = gamma;
+	}
+}
+
+//------------------------------------------------------------------------------
+void TreeStats::Compute (Tree &t, TreeStatsTable &table) const
+{
+	PostorderTree p;
+	p.Assign (t);
+	table.Resize (1, Statistics);
+	Compute (p, table, 0);
+}
+
+//------------------------------------------------------------------------------
+void TreeStats::Compute (const std::vector<Tree *> &trees, TreeStatsTable &table) const
+{
+	table.Resize (trees.size(), Statistics);
+
+	// Trees are only read, so threads can take them one at a time
+	std::vector<PostorderTree> p ((Threads > 0) ? Threads : DefaultThreads ());
+	ParallelFor ((int)trees.size(), [&](int i, int thread)
+		{
+			p[thread].Assign (*trees[i]);
+			Compute (p[thread], table, i);
+		}, Threads);
+}
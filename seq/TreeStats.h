@@ -0,0 +1,103 @@
+/*
+ * TreeStats
+ * Balance and shape statistics for trees and collections of trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <vector>
+
+#include "TreeLib.h"
+
+
+// Statistics to compute, or'ed together
+enum TreeStatistic
+{
+	tsColless	= 0x01,		// sum over internal nodes of |left leaves - right leaves|
+	tsSackin	= 0x02,		// sum of leaf depths (in edges)
+	tsCherries	= 0x04,		// nodes whose two children are both leaves
+	tsHeight	= 0x08,		// longest path from the root to a leaf
+	tsLength	= 0x10,		// sum of edge lengths
+	tsGamma		= 0x20,		// Pybus & Harvey's gamma (ultrametric trees)
+	tsAll		= 0x3f
+};
+
+
+//------------------------------------------------------------------------------
+// A tree as two arrays with children before their parents and the root last,
+// which is all the statistics need. Assign () builds one from a Tree without
+// recursion.
+struct PostorderTree
+{
+	std::vector<int>	Parent;		// -1 for the root
+	std::vector<float>	Length;		// edge length above each node
+	bool				EdgeLengths;
+
+	PostorderTree () { EdgeLengths = false; };
+	void	Assign (Tree &t);
+	int		GetNumNodes () const { return (int)Parent.size(); };
+};
+
+
+//------------------------------------------------------------------------------
+// One row per tree, one column per statistic; columns for statistics that
+// were not asked for are left empty
+struct TreeStatsTable
+{
+	std::vector<int>	Leaves;
+	std::vector<int>	Colless;
+	std::vector<long>	Sackin;
+	std::vector<int>	Cherries;
+	std::vector<double>	Height;
+	std::vector<double>	Length;
+	std::vector<double>	Gamma;
+
+	void	Resize (size_t rows, int statistics);
+	size_t	GetNumRows () const { return Leaves.size(); };
+};
+
+
+//------------------------------------------------------------------------------
+// Every statistic comes from one pass over the postorder arrays: each node is
+// finished (its leaf count, deepest leaf and child counts are complete) when
+// it is reached, adds its terms, and passes its values to its parent. Gamma
+// also sorts the internal node ages. Colless is defined for binary nodes;
+// a polytomy adds its largest minus its smallest child leaf count. Heights
+// and gamma use edge lengths, or edge counts if the tree has none.
+//
+// Collections are spread over threads one tree at a time, each thread writing
+// its own rows of the table.
+class TreeStats
+{
+public:
+	TreeStats (int statistics = tsAll) { Statistics = statistics; Threads = 0; };
+	virtual ~TreeStats () {};
+
+	virtual void	SetStatistics (int statistics) { Statistics = statistics; };
+	virtual void	SetThreads (int n) { Threads = n; };	// 0 = one per core
+
+	// Fill row of table, which must have been sized with Resize ()
+	virtual void	Compute (const PostorderTree &t, TreeStatsTable &table, size_t row) const;
+
+	// Statistics for one tree, or all of them in parallel, resizing table
+	virtual void	Compute (Tree &t, TreeStatsTable &table) const;
+	virtual void	Compute (const std::vector<Tree *> &trees, TreeStatsTable &table) const;
+
+protected:
+	int				Statistics;
+	int				Threads;
+};
+
+
+#endif // TREESTATS_H
@@ -0,0 +1,180 @@
+/*
+ * LabelCodecBench
+ * Timings for label quoting and translation on BOLD-style labels.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+// Build from seq/:
+//
+//   g++ -O2 -std=c++11 -I. bench/LabelCodecBench.cpp LabelCodec.cpp -o label-bench
+//
+// Usage: label-bench [--labels n]
+//
+// Makes n (default 1,000,000) labels the way dist.php does (BOLDLabel), plus
+// one in twenty with spaces or a quote, then times the character-by-character
+// NEXUSString and NEXUSToDisplayString that TreeLib used to have against
+// AppendNEXUSLabel, WriteNEXUSLabel and TranslateLabel, checking that the
+// output is the same.
+
+#include "LabelCodec.h"
+
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+//------------------------------------------------------------------------------
+// TreeLib's original NEXUSString, for comparison
+static std::string oldNEXUSString (const std::string s)
+{
+	std::string outputString ="";
+	bool enclose = false;
+	size_t i = 0;
+
+	if (isalpha (s[0]))
+	{
+		i = 1;
+		while ((i < s.length()) && !enclose)
+		{
+			if (!isalnum (s[i]) && (s[i] != ' ') && (s[i] != '_') && (s[i] != '.'))
+				enclose = true;
+			i++;
+		}
+	}
+	else
+		enclose = true;
+
+	if (enclose)
+		outputString = "'";
+	i = 0;
+	while (i < s.length())
+	{
+		if (s[i] == '\'')
+			outputString += "''";
+		else if ((s[i] == ' ') && !enclose)
+			outputString += '_';
+		else
+			outputString += s[i];
+		i++;
+	}
+	if (enclose)
+		outputString += "'";
+	return outputString;
+}
+
+//------------------------------------------------------------------------------
+static std::string oldNEXUSToDisplayString (const std::string s)
+{
+	std::string outputString ="";
+	size_t i = 0;
+	while (i < s.size())
+	{
+		if (s[i] == '_')
+			outputString += ' ';
+		else
+			outputString += s[i];
+		i++;
+	}
+	return outputString;
+}
+
+//------------------------------------------------------------------------------
+// "MRMSR00510_Squamata_sp._BOLDAAL6056", as BOLDLabel makes them
+static void makeLabels (int n, std::vector<std::string> &labels)
+{
+	static const char *genera[] = { "Squamata", "Anabas", "Channa", "Puntius", "Rasbora", "Danio", "Homo" };
+	static const char *species[] = { "sp.", "testudineus", "striata", "sophore", "daniconius", "rerio", "sapiens" };
+	std::mt19937 rng (1);
+	char buf[128];
+	labels.resize (n);
+	for (int i = 0; i < n; i++)
+	{
+		int g = rng () % 7, s = rng () % 7;
+		snprintf (buf, sizeof (buf), "%c%c%c%c%c%03u%02u_%s_%s_BOLD%c%c%c%04u",
+			(int)('A' + rng () % 26), (int)('A' + rng () % 26), (int)('A' + rng () % 26), (int)('A' + rng () % 26), (int)('A' + rng () % 26),
+			(unsigned)(rng () % 1000), (unsigned)(rng () % 20), genera[g], species[s],
+			(int)('A' + rng () % 26), (int)('A' + rng () % 26), (int)('A' + rng () % 26), (unsigned)(rng () % 10000));
+		labels[i] = buf;
+		switch (rng () % 40)
+		{
+			case 0:	labels[i] = std::string (genera[g]) + " " + species[s]; break;	// spaces
+			case 1:	labels[i] += "'s"; break;										// needs quotes
+			default: break;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+static double seconds (const std::function<void ()> &f)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+	f ();
+	return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+//------------------------------------------------------------------------------
+int main (int argc, char **argv)
+{
+	int n = 1000000;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp (argv[i], "--labels") == 0 && i + 1 < argc)
+			n = atoi (argv[++i]);
+		else
+		{
+			fprintf (stderr, "Usage: label-bench [--labels n]\n");
+			return 1;
+		}
+	}
+
+	std::vector<std::string> labels;
+	makeLabels (n, labels);
+	size_t bytes = 0;
+	for (int i = 0; i < n; i++)
+		bytes += labels[i].size();
+	printf ("%d labels, %.1f bytes each\n\n", n, (double)bytes / n);
+
+	// Quoting
+	std::string a, b;
+	a.reserve (bytes * 2);
+	b.reserve (bytes * 2);
+	double oldQuote = seconds ([&]() { for (int i = 0; i < n; i++) a += oldNEXUSString (labels[i]); });
+	double newQuote = seconds ([&]() { for (int i = 0; i < n; i++) AppendNEXUSLabel (labels[i], b); });
+	bool same = (a == b);
+
+	std::ostringstream oldStream, newStream;
+	double oldWrite = seconds ([&]() { for (int i = 0; i < n; i++) oldStream << oldNEXUSString (labels[i]); });
+	double newWrite = seconds ([&]() { for (int i = 0; i < n; i++) WriteNEXUSLabel (newStream, labels[i]); });
+	same = same && (oldStream.str () == newStream.str ());
+
+	// Underscores to spaces
+	std::vector<std::string> copies (labels);
+	size_t check = 0;
+	double oldDisplay = seconds ([&]() { for (int i = 0; i < n; i++) check += oldNEXUSToDisplayString (labels[i]).size(); });
+	double newDisplay = seconds ([&]() { for (int i = 0; i < n; i++) TranslateLabel (copies[i], '_', ' '); });
+	for (int i = 0; i < n && same; i++)
+		same = (copies[i] == oldNEXUSToDisplayString (labels[i]));
+
+	printf ("%-28s %10s %10s %8s\n", "", "old ns", "new ns", "speedup");
+	printf ("%-28s %10.1f %10.1f %7.1fx\n", "NEXUSString to string", 1e9 * oldQuote / n, 1e9 * newQuote / n, oldQuote / newQuote);
+	printf ("%-28s %10.1f %10.1f %7.1fx\n", "NEXUSString to stream", 1e9 * oldWrite / n, 1e9 * newWrite / n, oldWrite / newWrite);
+	printf ("%-28s %10.1f %10.1f %7.1fx\n", "Underscores to spaces", 1e9 * oldDisplay / n, 1e9 * newDisplay / n, oldDisplay / newDisplay);
+	printf ("\nOutput %s\n", same ? "identical" : "DIFFERS");
+	return (same && check > 0) ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+/*
+ * TreeLibBench
+ * Timings for TreeLib's core operations on synthetic and real trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+// Build from seq/ with TreeLib's Parse.h on the include path:
+//
+//   g++ -O2 -std=c++11 -I. bench/TreeLibBench.cpp TreeLib.cpp LabelCodec.cpp -o treelib-bench
+//
+// Usage: treelib-bench [--max-leaves n] [--min-time seconds] [--csv] [tree file ...]
+//
+// Each operation is repeated until it has run for at least the minimum time
+// (and at least once), and the mean time is reported per call and per node,
+// with the process's peak resident set size so far. Tree files may be Newick
+// or NEXUS (the first tree is used); d4.tre is used if none are given and it
+// can be found. Remove+AddBelow is timed per move rather than per tree, so
+// its per-node figure means little.
+//
+// Caterpillars stop at 10,000 leaves: TreeLib's traversals are recursive, so
+// deeper trees overflow the default stack.
+
+#include "TreeLib.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/resource.h>
+#endif
+
+
+//------------------------------------------------------------------------------
+// Peak resident set size in megabytes, 0 if unknown
+static double peakRSS ()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	struct rusage usage;
+	if (getrusage (RUSAGE_SELF, &usage) == 0)
+	{
+	#if defined(__APPLE__)
+		return usage.ru_maxrss / (1024.0 * 1024.0);	// bytes
+	#else
+		return usage.ru_maxrss / 1024.0;			// kilobytes
+	#endif
+	}
+#endif
+	return 0.0;
+}
+
+
+//------------------------------------------------------------------------------
+// A tree as parent pointers (node 0 the root) with edge lengths, turned into
+// Newick without recursion so that deep trees can be written
+struct ShapeTree
+{
+	std::vector<int>	Parent;
+	std::vector<double>	Length;
+
+	int		add (int parent, double length)
+	{
+		Parent.push_back (parent);
+		Length.push_back (length);
+		return (int)Parent.size() - 1;
+	}
+
+	std::string	newick () const
+	{
+		int n = (int)Parent.size();
+		std::vector<int> first (n + 1, 0), kids (n > 0 ? n - 1 : 0);
+		for (int i = 1; i < n; i++)
+			first[Parent[i] + 1]++;
+		for (int i = 0; i < n; i++)
+			first[i + 1] += first[i];
+		std::vector<int> fill (first.begin(), first.end() - 1);
+		for (int i = 1; i < n; i++)
+			kids[fill[Parent[i]]++] = i;
+
+		std::string s;
+		s.reserve ((size_t)n * 16);
+		char buf[32];
+		int leaf = 0;
+		// Stack of (node, next child); a node is closed when its children are done
+		std::vector<std::pair<int, int> > stack;
+		stack.push_back (std::make_pair (0, first[0]));
+		if (first[1] > first[0])
+			s += '(';
+		while (!stack.empty ())
+		{
+			int v = stack.back().first;
+			int &next = stack.back().second;
+			if (next < first[v + 1])
+			{
+				int c = kids[next];
+				if (next > first[v])
+					s += ',';
+				next++;
+				stack.push_back (std::make_pair (c, first[c]));
+				if (first[c + 1] > first[c])
+					s += '(';
+				continue;
+			}
+			if (first[v + 1] > first[v])
+				s += ')';
+			else
+			{
+				snprintf (buf, sizeof (buf), "t%d", ++leaf);
+				s += buf;
+			}
+			if (v != 0)
+			{
+				snprintf (buf, sizeof (buf), ":%.6g", Length[v]);
+				s += buf;
+			}
+			stack.pop_back ();
+		}
+		s += ';';
+		return s;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Perfectly balanced as far as possible: each internal node splits its leaves
+// in half
+static std::string balancedTree (int leaves)
+{
+	ShapeTree t;
+	std::vector<std::pair<int, int> > todo;	// node, leaves below it
+	todo.push_back (std::make_pair (t.add (-1, 0.0), leaves));
+	while (!todo.empty ())
+	{
+		int v = todo.back().first, m = todo.back().second;
+		todo.pop_back ();
+		if (m > 1)
+		{
+			todo.push_back (std::make_pair (t.add (v, 1.0), m / 2));
+			todo.push_back (std::make_pair (t.add (v, 1.0), m - m / 2));
+		}
+	}
+	return t.newick ();
+}
+
+//------------------------------------------------------------------------------
+// Every internal node has a leaf child
+static std::string caterpillarTree (int leaves)
+{
+	ShapeTree t;
+	int v = t.add (-1, 0.0);
+	for (int i = 0; i < leaves - 1; i++)
+	{
+		t.add (v, 1.0);
+		if (i == leaves - 2)
+			t.add (v, 1.0);
+		else
+			v = t.add (v, 1.0);
+	}
+	return t.newick ();
+}
+
+//------------------------------------------------------------------------------
+// Kingman coalescent: lineages merge in random pairs, with exponential
+// waiting times, giving an ultrametric tree
+static std::string coalescentTree (int leaves, unsigned int seed)
+{
+	std::mt19937 rng (seed);
+	int n = 2 * leaves - 1;
+	std::vector<int> parent (n, -1);
+	std::vector<double> height (n, 0.0);
+	std::vector<int> lineages (leaves);
+	for (int i = 0; i < leaves; i++)
+		lineages[i] = i;
+	double now = 0.0;
+	int next = leaves;
+	for (int k = leaves; k > 1; k--)
+	{
+		std::exponential_distribution<double> wait (k * (k - 1) / 2.0);
+		now += wait (rng);
+		int a = (int)(rng () % k);
+		std::swap (lineages[a], lineages[k - 1]);
+		int b = (int)(rng () % (k - 1));
+		int x = lineages[k - 1], y = lineages[b];
+		parent[x] = parent[y] = next;
+		height[next] = now;
+		lineages[b] = next++;
+	}
+
+	// Renumber with the root first
+	ShapeTree t;
+	std::vector<int> number (n, -1);
+	std::vector<std::vector<int> > children (n);
+	for (int i = 0; i < n - 1; i++)
+		children[parent[i]].push_back (i);
+	std::vector<int> stack (1, n - 1);
+	while (!stack.empty ())
+	{
+		int v = stack.back ();
+		stack.pop_back ();
+		number[v] = t.add ((parent[v] < 0) ? -1 : number[parent[v]],
+			(parent[v] < 0) ? 0.0 : height[parent[v]] - height[v]);
+		for (size_t c = 0; c < children[v].size(); c++)
+			stack.push_back (children[v][c]);
+	}
+	return t.newick ();
+}
+
+//------------------------------------------------------------------------------
+// The first tree in a Newick or NEXUS file, without comments
+static std::string readTree (const char *filename)
+{
+	std::ifstream f (filename);
+	if (!f)
+		return "";
+	std::stringstream ss;
+	ss << f.rdbuf ();
+	std::string text = ss.str ();
+
+	std::string s;
+	int comment = 0;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] == '[')
+			comment++;
+		else if (text[i] == ']' && comment > 0)
+			comment--;
+		else if (comment == 0)
+			s += text[i];
+	}
+	size_t start = s.find ('(');
+	size_t end = (start == std::string::npos) ? start : s.find (';', start);
+	if (end == std::string::npos)
+		return "";
+	return s.substr (start, end - start + 1);
+}
+
+
+//------------------------------------------------------------------------------
+struct Options
+{
+	int			MaxLeaves;
+	double		MinTime;
+	bool		CSV;
+};
+
+//------------------------------------------------------------------------------
+// Run body (after setup, which is not timed) until MinTime has passed,
+// and report the mean
+static void run (const Options &options, const std::string &tree, int leaves, int nodes,
+	const std::string &name, const std::function<void ()> &setup,
+	const std::function<void ()> &body, int callsPerBody = 1)
+{
+	typedef std::chrono::steady_clock Clock;
+	double total = 0.0;
+	long calls = 0;
+	do
+	{
+		if (setup)
+			setup ();
+		Clock::time_point start = Clock::now ();
+		body ();
+		total += std::chrono::duration<double> (Clock::now () - start).count ();
+		calls += callsPerBody;
+	} while (total < options.MinTime);
+
+	double ns = 1.0e9 * total / calls;
+	if (options.CSV)
+		std::cout << tree << ',' << leaves << ',' << name << ',' << ns << ','
+			<< ns / nodes << ',' << peakRSS () << std::endl;
+	else
+		std::cout << std::left << std::setw (14) << tree << std::right
+			<< std::setw (9) << leaves << "  " << std::left << std::setw (14) << name << std::right
+			<< std::fixed << std::setprecision (0) << std::setw (14) << ns << " ns"
+			<< std::setprecision (1) << std::setw (10) << ns / nodes << " ns/node"
+			<< std::setw (9) << peakRSS () << " MB" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+static void benchmark (const Options &options, const std::string &name, const std::string &newick)
+{
+	Tree t;
+	if (t.Parse (newick.c_str ()) != 0)
+	{
+		std::cerr << name << ": could not parse tree" << std::endl;
+		return;
+	}
+	t.Update ();
+	int leaves = t.GetNumLeaves ();
+	int nodes = t.GetNumNodes ();
+
+	run (options, name, leaves, nodes, "Parse", NULL, [&]()
+		{
+			Tree p;
+			p.Parse (newick.c_str ());
+		});
+
+	std::ostringstream out;
+	run (options, name, leaves, nodes, "Write", [&]() { out.str (""); }, [&]() { t.Write (out); });
+
+	run (options, name, leaves, nodes, "Copy", NULL, [&]() { Tree c (t); });
+
+	Tree *doomed = NULL;
+	run (options, name, leaves, nodes, "Destroy", [&]() { doomed = new Tree (t); },
+		[&]() { delete doomed; });
+
+	// Node lists and depths are cached, so invalidate them to time the walks
+	run (options, name, leaves, nodes, "MakeNodeList", [&]() { t.Invalidate (tcNodeList); },
+		[&]() { t.MakeNodeList (); });
+	run (options, name, leaves, nodes, "Update", NULL, [&]() { t.Update (); });
+	run (options, name, leaves, nodes, "GetNodeDepths", [&]() { t.Invalidate (tcDepths); },
+		[&]() { t.GetNodeDepths (); });
+	volatile int depth = 0;
+	run (options, name, leaves, nodes, "GetMaxNodeDepth", NULL, [&]() { depth = t.GetMaxNodeDepth (); });
+
+	// Prune a random leaf and graft it back beside another, 1000 times per
+	// run; the tree stays the same size.
+	if (leaves > 3)
+	{
+		Tree m (t);
+		m.Update ();
+		m.MakeNodeList ();
+		std::vector<NodePtr> leaf (leaves);
+		for (int i = 0; i < leaves; i++)
+			leaf[i] = m[i];
+		std::mt19937 rng (1);
+		const int moves = 1000;
+		run (options, name, leaves, nodes, "Remove+AddBelow", NULL, [&]()
+			{
+				for (int k = 0; k < moves; k++)
+				{
+					NodePtr x = leaf[rng () % leaves];
+					NodePtr below;
+					do
+						below = leaf[rng () % leaves];
+					while (below == x);
+					m.RemoveNode (x);
+					m.AddNodeBelow (x, below);
+				}
+			}, moves);
+	}
+}
+
+
+//------------------------------------------------------------------------------
+int main (int argc, char **argv)
+{
+	Options options;
+	options.MaxLeaves = 1000000;
+	options.MinTime = 0.2;
+	options.CSV = false;
+	std::vector<const char *> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp (argv[i], "--max-leaves") == 0 && i + 1 < argc)
+			options.MaxLeaves = atoi (argv[++i]);
+		else if (strcmp (argv[i], "--min-time") == 0 && i + 1 < argc)
+			options.MinTime = atof (argv[++i]);
+		else if (strcmp (argv[i], "--csv") == 0)
+			options.CSV = true;
+		else
+			files.push_back (argv[i]);
+	}
+	if (files.empty ())
+	{
+		const char *candidates[] = { "d4.tre", "../d4.tre", "seq/d4.tre" };
+		for (int i = 0; i < 3; i++)
+			if (std::ifstream (candidates[i]))
+			{
+				files.push_back (candidates[i]);
+				break;
+			}
+	}
+
+	if (options.CSV)
+		std::cout << "tree,leaves,operation,ns,ns_per_node,peak_rss_mb" << std::endl;
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		std::string newick = readTree (files[i]);
+		if (newick.empty ())
+			std::cerr << files[i] << ": no tree found" << std::endl;
+		else
+			benchmark (options, files[i], newick);
+	}
+	for (int n = 100; n <= options.MaxLeaves; n *= 10)
+	{
+		benchmark (options, "balanced", balancedTree (n));
+		benchmark (options, "coalescent", coalescentTree (n, n));
+		if (n <= 10000)
+			benchmark (options, "caterpillar", caterpillarTree (n));
+	}
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * IngestTest
+ * Checks that the _bulk output of SequenceIngest is valid JSON for the
+ * number forms found in real dumps.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+// Build from seq/:
+//
+//   g++ -O2 -std=c++11 -pthread -I. tests/IngestTest.cpp Ingest.cpp Sequence.cpp TileScheduler.cpp -o ingest-test
+//
+// Usage: ingest-test
+//
+// Ingests a small dump whose coordinates are written the ways strtod takes
+// but JSON does not (".5", "+12.5", "007", "-1.", "0x10", "nan", ...), and
+// checks that every coordinate in the bulk output is a JSON number with the
+// right value, and that non-decimal forms are left out. Prints each failure
+// and returns 1 if there were any.
+
+#include "Ingest.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+
+//------------------------------------------------------------------------------
+// The JSON number grammar (RFC 8259)
+static bool isJSONNumber (const std::string &s)
+{
+	size_t i = 0, n = s.size();
+	if (i < n && s[i] == '-')
+		i++;
+	if (i < n && s[i] == '0')
+		i++;
+	else if (i < n && s[i] >= '1' && s[i] <= '9')
+		while (i < n && isdigit ((unsigned char)s[i]))
+			i++;
+	else
+		return false;
+	if (i < n && s[i] == '.')
+	{
+		i++;
+		if (i == n || !isdigit ((unsigned char)s[i]))
+			return false;
+		while (i < n && isdigit ((unsigned char)s[i]))
+			i++;
+	}
+	if (i < n && (s[i] == 'e' || s[i] == 'E'))
+	{
+		i++;
+		if (i < n && (s[i] == '+' || s[i] == '-'))
+			i++;
+		if (i == n || !isdigit ((unsigned char)s[i]))
+			return false;
+		while (i < n && isdigit ((unsigned char)s[i]))
+			i++;
+	}
+	return i == n;
+}
+
+//------------------------------------------------------------------------------
+int main ()
+{
+	// Latitude, longitude, and whether the record should have a Point
+	struct { const char *lat, *lon; bool point; } cases[] =
+	{
+		{ "12.5",		"100.25",	true },
+		{ "+12.5",		".5",		true },
+		{ "007",		"-1.",		true },
+		{ " 7",			"-.25",		true },
+		{ "1e1",		"-0",		true },
+		{ "0.1",		"179.99999999999997", true },
+		{ "1E-5",		"00.000",	true },
+		{ "7",			"0x10",		false },
+		{ "nan",		"10",		false },
+		{ "10",			"inf",		false },
+		{ "91",			"10",		false },
+		{ "10",			"-180.5",	false },
+		{ "1.2.3",		"10",		false },
+		{ "",			"10",		false },
+		{ "-",			"10",		false },
+	};
+	int numCases = (int)(sizeof (cases) / sizeof (cases[0]));
+
+	std::string dump = "processid\tnucraw\tlat\tlon\n";
+	for (int i = 0; i < numCases; i++)
+		dump += "R" + std::to_string (i) + "\tACGTACGT\t" + cases[i].lat + "\t" + cases[i].lon + "\n";
+
+	SequenceIngest ingest;
+	ingest.SetThreads (1);
+	std::istringstream in (dump);
+	std::ostringstream bulk;
+	IngestStats stats;
+	if (!ingest.Run (in, &bulk, NULL, stats))
+	{
+		printf ("Run failed\n");
+		return 1;
+	}
+
+	// Documents are every second line, in input order
+	int failures = 0;
+	std::istringstream out (bulk.str ());
+	std::string line;
+	int i = 0;
+	while (std::getline (out, line))
+	{
+		if (!std::getline (out, line))
+			break;
+		if (i >= numCases)
+		{
+			printf ("More documents than records\n");
+			return 1;
+		}
+		const char *tag = "\"coordinates\":[";
+		size_t p = line.find (tag);
+		if ((p != std::string::npos) != cases[i].point)
+		{
+			printf ("%s,%s: Point %s\n", cases[i].lat, cases[i].lon, cases[i].point ? "missing" : "not expected");
+			failures++;
+		}
+		else if (p != std::string::npos)
+		{
+			p += strlen (tag);
+			size_t comma = line.find (',', p), close = line.find (']', p);
+			std::string lon = line.substr (p, comma - p), lat = line.substr (comma + 1, close - comma - 1);
+			if (!isJSONNumber (lon) || !isJSONNumber (lat)
+				|| strtod (lon.c_str (), NULL) != strtod (cases[i].lon, NULL)
+				|| strtod (lat.c_str (), NULL) != strtod (cases[i].lat, NULL))
+			{
+				printf ("%s,%s: written as [%s,%s]\n", cases[i].lat, cases[i].lon, lon.c_str (), lat.c_str ());
+				failures++;
+			}
+		}
+		i++;
+	}
+	if (i != numCases)
+	{
+		printf ("%d documents for %d records\n", i, numCases);
+		failures++;
+	}
+	printf ("%d cases, %d failed\n", numCases, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * SeqHitsTree
+ * Build a tree straight from an Elasticsearch search response.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+// Build from seq/ with TreeLib's Parse.h on the include path:
+//
+//   g++ -O2 -std=c++11 -pthread -I. tools/SeqHitsTree.cpp SearchHits.cpp KTuple.cpp Sequence.cpp Haplotypes.cpp DistanceMatrix.cpp TreeBuilder.cpp TreeLib.cpp LabelCodec.cpp TileScheduler.cpp Trace.cpp -o seq-hits-tree
+//
+// Usage: seq-hits-tree [--k n] [--model name] [--max-hits n] [--threads n] [--collapse] [response.json]
+//
+// Reads a search response (as dist.php gets from the dna index) from the
+// file or standard input and writes the neighbour-joining tree of its hits
+// in Newick format, as dist.php does, without holding the response in
+// memory. With --collapse identical sequences are profiled and joined once
+// and put back as polytomies in the final tree. For example:
+//
+//   curl -s -XPOST localhost:9200/dna/_search -d @search.request | ./seq-hits-tree
+
+#include "DistanceMatrix.h"
+#include "Haplotypes.h"
+#include "KTuple.h"
+#include "SearchHits.h"
+#include "TreeBuilder.h"
+#include "TreeLib.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+
+//------------------------------------------------------------------------------
+static void usage ()
+{
+	std::cerr << "Usage: seq-hits-tree [--k n] [--model name] [--max-hits n] [--threads n] [--collapse] [response.json]" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+int main (int argc, char *argv[])
+{
+	int k = 5, maxHits = 0, threads = 0;
+	bool collapse = false;
+	DistanceModel model = dmSquaredEuclidean;
+	std::string input;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		bool more = (i + 1 < argc);
+		if (strcmp (arg, "--k") == 0 && more)
+			k = atoi (argv[++i]);
+		else if (strcmp (arg, "--max-hits") == 0 && more)
+			maxHits = atoi (argv[++i]);
+		else if (strcmp (arg, "--threads") == 0 && more)
+			threads = atoi (argv[++i]);
+		else if (strcmp (arg, "--collapse") == 0)
+			collapse = true;
+		else if (strcmp (arg, "--model") == 0 && more)
+		{
+			if (!ParseDistanceModel (argv[++i], model))
+			{
+				std::cerr << "Unknown distance model " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg[0] == '-' && arg[1] != '\0')
+		{
+			usage ();
+			return 1;
+		}
+		else
+			input = arg;
+	}
+
+	std::ifstream file;
+	if (!input.empty ())
+	{
+		file.open (input.c_str(), std::ios::binary);
+		if (!file)
+		{
+			std::cerr << "Could not open " << input << std::endl;
+			return 1;
+		}
+	}
+	std::istream &in = input.empty () ? std::cin : file;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+	KTupleProfiles profiles (k, model);
+	UniqueSequences unique;
+	int n = StreamSearchHits (in, profiles, NULL, maxHits, collapse ? &unique : NULL);
+	if (n < 0)
+	{
+		std::cerr << "Could not parse search response" << std::endl;
+		return 1;
+	}
+	if (n < 3)
+	{
+		std::cerr << "Only " << n << " hits, need at least 3 for a tree" << std::endl;
+		return 1;
+	}
+	std::chrono::steady_clock::time_point read = std::chrono::steady_clock::now ();
+
+	DistanceMatrix D;
+	profiles.Distances (D, threads);
+	Tree t;
+	NJBuilder nj;
+	nj.Build (D, t);
+	if (collapse)
+		unique.Expand (t);
+	t.Write (std::cout);
+	std::cout << std::endl;
+	std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now ();
+
+	std::cerr << n << " hits";
+	if (collapse)
+		std::cerr << " (" << unique.GetNumHaplotypes () << " haplotypes)";
+	std::cerr << ", read and profiled in "
+		<< std::chrono::duration<double> (read - start).count () << " s, tree in "
+		<< std::chrono::duration<double> (done - read).count () << " s" << std::endl;
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * SeqIngest
+ * Bulk load a sequence dump into Elasticsearch and a profile store.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+// Build from seq/:
+//
+//   g++ -O2 -std=c++11 -pthread -I. tools/SeqIngest.cpp Ingest.cpp Sequence.cpp TileScheduler.cpp -o seq-ingest
+//
+// Usage: seq-ingest [--bulk file] [--store file] [--k n] [--threads n]
+//                   [--batch n] [--index name] [--type name] [dump]
+//
+// Reads a tab-separated dump with a header line (an export of ibol_public,
+// or a Darwin Core occurrence file) from dump or standard input. The bulk
+// file can be posted as is to Elasticsearch's _bulk endpoint:
+//
+//   curl -s -H 'Content-Type: application/x-ndjson' -XPOST localhost:9200/_bulk --data-binary @dna.ndjson
+
+#include "Ingest.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+
+//------------------------------------------------------------------------------
+static void usage ()
+{
+	std::cerr << "Usage: seq-ingest [--bulk file] [--store file] [--k n] [--threads n]" << std::endl
+		<< "                  [--batch n] [--index name] [--type name] [dump]" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+int main (int argc, char *argv[])
+{
+	SequenceIngest ingest;
+	std::string input, bulkName, storeName;
+	std::string index = "dna", type = "sequence";
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		bool more = (i + 1 < argc);
+		if (strcmp (arg, "--bulk") == 0 && more)
+			bulkName = argv[++i];
+		else if (strcmp (arg, "--store") == 0 && more)
+			storeName = argv[++i];
+		else if (strcmp (arg, "--k") == 0 && more)
+			ingest.SetK (atoi (argv[++i]));
+		else if (strcmp (arg, "--threads") == 0 && more)
+			ingest.SetThreads (atoi (argv[++i]));
+		else if (strcmp (arg, "--batch") == 0 && more)
+			ingest.SetBatchSize (atoi (argv[++i]));
+		else if (strcmp (arg, "--index") == 0 && more)
+			index = argv[++i];
+		else if (strcmp (arg, "--type") == 0 && more)
+			type = argv[++i];
+		else if (arg[0] == '-' && arg[1] != '\0')
+		{
+			usage ();
+			return 1;
+		}
+		else
+			input = arg;
+	}
+	ingest.SetIndex (index, type);
+
+	std::ifstream file;
+	if (!input.empty ())
+	{
+		file.open (input.c_str(), std::ios::binary);
+		if (!file)
+		{
+			std::cerr << "Could not open " << input << std::endl;
+			return 1;
+		}
+	}
+	std::istream &in = input.empty () ? std::cin : file;
+
+	std::ofstream bulk, store;
+	if (!bulkName.empty ())
+	{
+		bulk.open (bulkName.c_str(), std::ios::binary);
+		if (!bulk)
+		{
+			std::cerr << "Could not create " << bulkName << std::endl;
+			return 1;
+		}
+	}
+	if (!storeName.empty ())
+	{
+		store.open (storeName.c_str(), std::ios::binary);
+		if (!store)
+		{
+			std::cerr << "Could not create " << storeName << std::endl;
+			return 1;
+		}
+	}
+
+	IngestStats stats;
+	if (!ingest.Run (in, bulkName.empty () ? NULL : &bulk, storeName.empty () ? NULL : &store, stats))
+	{
+		std::cerr << "No id column in header" << std::endl;
+		return 1;
+	}
+	if ((bulk.is_open () && !bulk) || (store.is_open () && !store))
+	{
+		std::cerr << "Error writing output" << std::endl;
+		return 1;
+	}
+
+	std::cerr << stats.Records << " records, " << stats.Skipped << " skipped, "
+		<< stats.Bytes / (1024.0 * 1024.0) << " MB in " << stats.Seconds << " s ("
+		<< (long long)stats.GetRecordsPerSecond () << " records/s)" << std::endl;
+	return 0;
+}